@@ -45,4 +45,6 @@ rm -rf %{buildroot}
 %manifest gst-plugins-emulator.manifest
 %defattr(-,root,root,-)
 %{_libdir}/gstreamer-1.0/libgstemul.so
+%{_bindir}/gst-maru-codec-broker
+%{_bindir}/gst-maru-codec-replay
 /usr/share/license/%{name}
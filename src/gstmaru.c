@@ -29,6 +29,7 @@
 #include "gstmaru.h"
 #include "gstmaruutils.h"
 #include "gstmaruinterface.h"
+#include "gstmarudevice.h"
 
 GST_DEBUG_CATEGORY (maru_debug);
 
@@ -47,12 +48,72 @@ gboolean gst_maruviddec_register (GstPlugin *plugin, GList *element);
 gboolean gst_maruvidenc_register (GstPlugin *plugin, GList *element);
 gboolean gst_maruauddec_register (GstPlugin *plugin, GList *element);
 gboolean gst_maruaudenc_register (GstPlugin *plugin, GList *element);
+gboolean gst_marutranscode_register (GstPlugin *plugin, GList *element);
+gboolean gst_marumosaic_register (GstPlugin *plugin, GList *element);
+gboolean gst_maruimagedec_register (GstPlugin *plugin, GList *element);
 
 static GList *elements = NULL;
 static gboolean codec_element_init = FALSE;
 static GMutex gst_maru_mutex;
 
 int device_version;
+CodecCapabilities device_caps;
+
+// the interface of the device version without the entries of features
+// the host does not have
+static Interface interface_with_caps;
+
+static void
+gst_maru_codec_select_features (int fd)
+{
+  device_caps.flags = 0;
+  device_caps.mem_size = CODEC_DEVICE_MEM_SIZE;
+
+  if (!interface->get_capabilities ||
+      interface->get_capabilities (fd, &device_caps) < 0) {
+    // hosts older than the capability query. they block in
+    // IOCTL_CMD_SECURE_BUFFER, the non-blocking one came with the query.
+    device_caps.flags = CHECK_VERSION(3) ? CODEC_CAP_DECODE_AND_COPY : 0;
+  } else if (device_caps.mem_size == 0) {
+    device_caps.mem_size = CODEC_DEVICE_MEM_SIZE;
+  }
+  GST_INFO ("device capabilities: 0x%x, memory: %u bytes",
+    device_caps.flags, device_caps.mem_size);
+
+  interface_with_caps = *interface;
+  if (!CHECK_CAPS(CODEC_CAP_VIDEO_ENCODE_BATCH)) {
+    interface_with_caps.encode_video_batch = NULL;
+  }
+  if (!CHECK_CAPS(CODEC_CAP_AUDIO_DECODE_BATCH)) {
+    interface_with_caps.decode_audio_batch = NULL;
+  }
+  if (!CHECK_CAPS(CODEC_CAP_AUDIO_ENCODE_BATCH)) {
+    interface_with_caps.encode_audio_batch = NULL;
+  }
+  if (!CHECK_CAPS(CODEC_CAP_ASYNC)) {
+    interface_with_caps.register_completion_fd = NULL;
+    interface_with_caps.submit_request = NULL;
+    interface_with_caps.reap_completion = NULL;
+  }
+  if (!CHECK_CAPS(CODEC_CAP_RINGS)) {
+    interface_with_caps.setup_rings = NULL;
+    interface_with_caps.release_rings = NULL;
+  }
+  if (!CHECK_CAPS(CODEC_CAP_TIMED)) {
+    interface_with_caps.cancel_requests = NULL;
+  }
+  if (!CHECK_CAPS(CODEC_CAP_TRANSCODE)) {
+    interface_with_caps.transcode_video = NULL;
+  }
+  if (!CHECK_CAPS(CODEC_CAP_MOSAIC)) {
+    interface_with_caps.decode_video_to_mosaic = NULL;
+    interface_with_caps.copy_mosaic = NULL;
+  }
+  if (!CHECK_CAPS(CODEC_CAP_IMAGE_BATCH)) {
+    interface_with_caps.decode_image_batch = NULL;
+  }
+  interface = &interface_with_caps;
+}
 
 static gboolean
 gst_maru_codec_element_init ()
@@ -62,7 +123,9 @@ gst_maru_codec_element_init ()
 
   codec_element_init = TRUE;
 
-  fd = open (CODEC_DEV, O_RDWR);
+  gst_maru_codec_device_select ();
+
+  fd = device_ops->open ();
   if (fd < 0) {
     perror ("[gst-maru] failed to open codec device");
     GST_ERROR ("failed to open codec device");
@@ -96,6 +159,9 @@ gst_maru_codec_element_init ()
     goto out;
   }
 
+  // pick the paths the host supports
+  gst_maru_codec_select_features (fd);
+
   // prepare elements
   if ((elements = interface->prepare_elements(fd)) == NULL) {
     perror ("[gst-maru] cannot prepare elements");
@@ -105,7 +171,7 @@ gst_maru_codec_element_init ()
   }
 
   // try to mmap device memory
-  buffer = mmap (NULL, 4096, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  buffer = device_ops->mmap (fd, 4096);
   if (buffer == MAP_FAILED) {
     perror ("[gst-maru] memory mapping failure");
     GST_ERROR ("memory mapping failure");
@@ -114,10 +180,10 @@ gst_maru_codec_element_init ()
 
 out:
   if (buffer != MAP_FAILED) {
-    munmap (buffer, 4096);
+    device_ops->munmap (buffer, 4096);
   }
   if (fd >= 0) {
-    close (fd);
+    device_ops->close (fd);
   }
 
   return ret;
@@ -129,8 +195,6 @@ plugin_init (GstPlugin *plugin)
   GST_DEBUG_CATEGORY_INIT (maru_debug,
       "tizen-emul", 0, "Tizen Emulator Codec Elements");
 
-  gst_maru_init_pix_fmt_info ();
-
   g_mutex_lock (&gst_maru_mutex);
   if (!codec_element_init) {
     if (!gst_maru_codec_element_init ()) {
@@ -149,6 +213,18 @@ plugin_init (GstPlugin *plugin)
     GST_ERROR ("failed to register encoder elements");
     return FALSE;
   }
+  if (!gst_marutranscode_register (plugin, elements)) {
+    GST_ERROR ("failed to register transcode element");
+    return FALSE;
+  }
+  if (!gst_marumosaic_register (plugin, elements)) {
+    GST_ERROR ("failed to register mosaic element");
+    return FALSE;
+  }
+  if (!gst_maruimagedec_register (plugin, elements)) {
+    GST_ERROR ("failed to register image decoder element");
+    return FALSE;
+  }
 #if 0
   if (!gst_maruauddec_register (plugin, elements)) {
     GST_ERROR ("failed to register decoder elements");
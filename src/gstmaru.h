@@ -121,6 +121,41 @@ typedef struct {
   int64_t channel_layout;
 } __attribute__((packed)) AudioData;
 
+/* the values match AVDiscard of the host codec library. */
+enum SkipFrame {
+  SKIP_FRAME_NONE = 0,
+  SKIP_FRAME_NONREF = 8,
+  SKIP_FRAME_NONKEY = 32,
+  SKIP_FRAME_ALL = 48,
+};
+
+/* which requests the device scheduler serves first. contexts are normal
+ * unless their element says otherwise. */
+enum CodecPriority {
+  CODEC_PRIORITY_REALTIME = -1,
+  CODEC_PRIORITY_NORMAL = 0,
+  CODEC_PRIORITY_BACKGROUND = 1,
+};
+
+#define CODEC_PRIORITY_LEVELS 3
+
+/* how a context waits for the device. with the hybrid wait it spins for
+ * the reply of a request before blocking, following the average latency.
+ * with the async wait it sleeps until the completion thread reaps it.
+ * requests for device memory wait in line while the memory is full. */
+typedef struct {
+  gboolean hybrid;
+  gboolean async;
+  uint32_t spin_hits;
+  uint32_t spin_misses;
+  int64_t latency;      // average, in usec
+  int64_t spin_budget;  // in usec
+
+  uint32_t mem_waits;
+  int64_t mem_wait_time;  // in usec
+  gint cancel_gen;
+} CodecWaitStats;
+
 typedef struct {
   VideoData video;
   AudioData audio;
@@ -133,6 +168,16 @@ typedef struct {
 
   CodecElement *codec;
   int32_t index;
+
+  int32_t skip_frame;
+
+  // deadline of every device request in msec, 0 waits forever
+  int32_t timeout_ms;
+
+  // enum CodecPriority, read at every request
+  int32_t priority;
+
+  CodecWaitStats wait;
 } CodecContext;
 
 enum CODEC_MEDIA_TYPE {
@@ -30,6 +30,20 @@
 
 #define GST_MARUDEC_PARAMS_QDATA g_quark_from_static_string("marudec-params")
 
+#define DEFAULT_MAX_BATCH 1
+#define DEFAULT_PRIORITY CODEC_PRIORITY_NORMAL
+
+enum
+{
+  PROP_0,
+  PROP_MAX_BATCH,
+  PROP_MEMORY_WAITS,
+  PROP_SPIN_HITS,
+  PROP_SPIN_MISSES,
+  PROP_WAIT_LATENCY,
+  PROP_PRIORITY
+};
+
 typedef struct _GstMaruAudDecClass
 {
   GstAudioDecoderClass parent_class;
@@ -57,6 +71,11 @@ static GstFlowReturn gst_maruauddec_handle_frame (GstAudioDecoder *decoder,
 static gboolean gst_maruauddec_negotiate (GstMaruAudDec *maruauddec,
     gboolean force);
 
+static void gst_maruauddec_set_property (GObject *object,
+    guint prop_id, const GValue *value, GParamSpec *pspec);
+static void gst_maruauddec_get_property (GObject *object,
+    guint prop_id, GValue *value, GParamSpec *pspec);
+
 static void
 gst_maruauddec_base_init (GstMaruAudDecClass *klass)
 {
@@ -120,6 +139,43 @@ gst_maruauddec_class_init (GstMaruAudDecClass *klass)
   parent_class = g_type_class_peek_parent (klass);
 
   gobject_class->finalize = gst_maruauddec_finalize;
+  gobject_class->set_property = gst_maruauddec_set_property;
+  gobject_class->get_property = gst_maruauddec_get_property;
+
+  g_object_class_install_property (gobject_class, PROP_MAX_BATCH,
+      g_param_spec_uint ("max-batch", "Max Batch",
+      "Number of packets sent to the device in one request, "
+      "1 sends each packet as it comes", 1, MAX_AUDIO_DECODE_BATCH,
+      DEFAULT_MAX_BATCH, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_MEMORY_WAITS,
+      g_param_spec_uint ("memory-waits", "Memory waits",
+      "How many times the decoder waited for device memory",
+      0, G_MAXUINT, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_SPIN_HITS,
+      g_param_spec_uint ("spin-hits", "Spin hits",
+      "How many replies came while the decoder spun for them, "
+      "with GST_MARU_CODEC_WAIT=hybrid",
+      0, G_MAXUINT, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_SPIN_MISSES,
+      g_param_spec_uint ("spin-misses", "Spin misses",
+      "How many times the decoder spun in vain and blocked, "
+      "with GST_MARU_CODEC_WAIT=hybrid",
+      0, G_MAXUINT, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_WAIT_LATENCY,
+      g_param_spec_int64 ("wait-latency", "Wait latency",
+      "Average time in usec the decoder waited for a reply, "
+      "with GST_MARU_CODEC_WAIT=hybrid",
+      0, G_MAXINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_PRIORITY,
+      g_param_spec_enum ("priority", "Priority",
+      "Which streams the device serves first",
+      GST_MARU_TYPE_PRIORITY, DEFAULT_PRIORITY,
+      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
   gstauddecoder_class->start = GST_DEBUG_FUNCPTR (gst_maruauddec_start);
   gstauddecoder_class->stop = GST_DEBUG_FUNCPTR (gst_maruauddec_stop);
@@ -135,6 +191,10 @@ gst_maruauddec_init (GstMaruAudDec *maruauddec)
   maruauddec->context->audio.sample_fmt = SAMPLE_FMT_NONE;
   maruauddec->opened = FALSE;
 
+  maruauddec->pending =
+    g_ptr_array_new_with_free_func ((GDestroyNotify) gst_buffer_unref);
+  maruauddec->max_batch = DEFAULT_MAX_BATCH;
+
   // TODO: check why
   gst_audio_decoder_set_drainable (GST_AUDIO_DECODER (maruauddec), TRUE);
   gst_audio_decoder_set_needs_format (GST_AUDIO_DECODER (maruauddec), TRUE);
@@ -159,9 +219,62 @@ gst_maruauddec_finalize (GObject *object)
   g_free (maruauddec->dev);
   maruauddec->dev = NULL;
 
+  g_ptr_array_unref (maruauddec->pending);
+  maruauddec->pending = NULL;
+
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
 
+static void
+gst_maruauddec_set_property (GObject *object,
+    guint prop_id, const GValue *value, GParamSpec *pspec)
+{
+  GstMaruAudDec *maruauddec = (GstMaruAudDec *) object;
+
+  switch (prop_id) {
+    case PROP_MAX_BATCH:
+      maruauddec->max_batch = g_value_get_uint (value);
+      break;
+    case PROP_PRIORITY:
+      maruauddec->context->priority = g_value_get_enum (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_maruauddec_get_property (GObject *object,
+    guint prop_id, GValue *value, GParamSpec *pspec)
+{
+  GstMaruAudDec *maruauddec = (GstMaruAudDec *) object;
+
+  switch (prop_id) {
+    case PROP_MAX_BATCH:
+      g_value_set_uint (value, maruauddec->max_batch);
+      break;
+    case PROP_MEMORY_WAITS:
+      g_value_set_uint (value, maruauddec->context->wait.mem_waits);
+      break;
+    case PROP_SPIN_HITS:
+      g_value_set_uint (value, maruauddec->context->wait.spin_hits);
+      break;
+    case PROP_SPIN_MISSES:
+      g_value_set_uint (value, maruauddec->context->wait.spin_misses);
+      break;
+    case PROP_WAIT_LATENCY:
+      g_value_set_int64 (value, maruauddec->context->wait.latency);
+      break;
+    case PROP_PRIORITY:
+      g_value_set_enum (value, maruauddec->context->priority);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
 static gboolean
 gst_maruauddec_close (GstMaruAudDec *maruauddec, gboolean reset)
 {
@@ -169,6 +282,7 @@ gst_maruauddec_close (GstMaruAudDec *maruauddec, gboolean reset)
 
   gst_caps_replace (&maruauddec->last_caps, NULL);
   gst_buffer_replace (&maruauddec->outbuf, NULL);
+  g_ptr_array_set_size (maruauddec->pending, 0);
 
   gst_maru_avcodec_close (maruauddec->context, maruauddec->dev);
   maruauddec->opened = FALSE;
@@ -371,6 +485,95 @@ gst_maruauddec_frame (GstMaruAudDec *marudec,
   return len;
 }
 
+/* decode all pending packets in one request. the samples of every packet
+ * come back one after the other and finish their own frame. */
+static GstFlowReturn
+gst_maruauddec_decode_batch (GstMaruAudDec *marudec)
+{
+  GST_DEBUG (" >> ENTER ");
+  GstMapInfo mapinfo[MAX_AUDIO_DECODE_BATCH];
+  uint8_t *in_bufs[MAX_AUDIO_DECODE_BATCH];
+  int in_sizes[MAX_AUDIO_DECODE_BATCH];
+  int sample_sizes[MAX_AUDIO_DECODE_BATCH];
+  GstClockTime timestamps[MAX_AUDIO_DECODE_BATCH];
+  GstBuffer *inbuf, *outbuf;
+  GstFlowReturn ret = GST_FLOW_OK;
+  guint8 *samples, *data;
+  gint i, nb_packets, len, max_size;
+
+  nb_packets = marudec->pending->len;
+  if (!nb_packets) {
+    return GST_FLOW_OK;
+  }
+
+  for (i = 0; i < nb_packets; i++) {
+    inbuf = g_ptr_array_index (marudec->pending, i);
+    gst_buffer_map (inbuf, &mapinfo[i], GST_MAP_READ);
+    in_bufs[i] = mapinfo[i].data;
+    in_sizes[i] = mapinfo[i].size;
+    timestamps[i] = GST_BUFFER_TIMESTAMP (inbuf);
+  }
+
+  max_size = FF_MAX_AUDIO_FRAME_SIZE * nb_packets;
+  samples = g_malloc (max_size);
+
+  len = interface->decode_audio_batch (marudec->context, samples, max_size,
+      in_bufs, in_sizes, nb_packets, sample_sizes, marudec->dev);
+
+  for (i = 0; i < nb_packets; i++) {
+    gst_buffer_unmap (g_ptr_array_index (marudec->pending, i), &mapinfo[i]);
+  }
+  g_ptr_array_set_size (marudec->pending, 0);
+
+  if (len < 0) {
+    GstMaruAudDecClass *oclass =
+      (GstMaruAudDecClass *) (G_OBJECT_GET_CLASS (marudec));
+    GST_WARNING_OBJECT (marudec,
+      "maru_%sdec: failed to decode %d packets", oclass->codec->name,
+      nb_packets);
+    g_free (samples);
+    return gst_audio_decoder_finish_frame (GST_AUDIO_DECODER (marudec),
+        NULL, nb_packets);
+  }
+
+  if (len > 0 && !gst_maruauddec_negotiate (marudec, FALSE)) {
+    g_free (samples);
+    return gst_audio_decoder_finish_frame (GST_AUDIO_DECODER (marudec),
+        NULL, nb_packets);
+  }
+
+  GST_DEBUG_OBJECT (marudec, "%d packets decoded into %d bytes",
+      nb_packets, len);
+
+  data = samples;
+  for (i = 0; i < nb_packets && ret == GST_FLOW_OK; i++) {
+    outbuf = NULL;
+    if (sample_sizes[i] > 0) {
+      outbuf = gst_audio_decoder_allocate_output_buffer (GST_AUDIO_DECODER (marudec),
+          sample_sizes[i]);
+      if (outbuf == NULL) {
+        GST_ELEMENT_ERROR (marudec, STREAM, DECODE, (NULL), ("outbuf is NULL."));
+        g_free (samples);
+        return GST_FLOW_ERROR;
+      }
+      gst_buffer_fill (outbuf, 0, data, sample_sizes[i]);
+      data += sample_sizes[i];
+
+      GST_BUFFER_TIMESTAMP (outbuf) = timestamps[i];
+      GST_BUFFER_DURATION (outbuf) = gst_util_uint64_scale (sample_sizes[i],
+          GST_SECOND, marudec->info.finfo->depth * marudec->info.channels *
+          marudec->context->audio.sample_rate);
+    }
+
+    // a packet without samples still finishes its frame
+    ret = gst_audio_decoder_finish_frame (GST_AUDIO_DECODER (marudec),
+        outbuf, 1);
+  }
+  g_free (samples);
+
+  return ret;
+}
+
 static void
 gst_maruauddec_drain (GstMaruAudDec *maruauddec)
 {
@@ -378,6 +581,8 @@ gst_maruauddec_drain (GstMaruAudDec *maruauddec)
 
   gint have_data, len;
 
+  gst_maruauddec_decode_batch (maruauddec);
+
   do {
     GstFlowReturn ret;
 
@@ -481,6 +686,15 @@ GstFlowReturn gst_maruauddec_handle_frame(GstAudioDecoder *decoder, GstBuffer *i
     gst_maruauddec_drain (marudec);
     return GST_FLOW_OK;
   }
+
+  if (marudec->max_batch > 1 && interface->decode_audio_batch) {
+    g_ptr_array_add (marudec->pending, gst_buffer_ref (inbuf));
+    if (marudec->pending->len < marudec->max_batch) {
+      return GST_FLOW_OK;
+    }
+    return gst_maruauddec_decode_batch (marudec);
+  }
+
   inbuf = gst_buffer_ref (inbuf);
 
   if (!gst_buffer_map (inbuf, &mapinfo, GST_MAP_READ)) {
@@ -526,6 +740,7 @@ void gst_maruauddec_flush(GstAudioDecoder *decoder, gboolean hard)
   GstMaruAudDec *maruauddec = (GstMaruAudDec *) decoder;
 
   GST_DEBUG_OBJECT (maruauddec, "flush decoded buffers");
+  g_ptr_array_set_size (maruauddec->pending, 0);
   interface->flush_buffers (maruauddec->context, maruauddec->dev);
 }
 
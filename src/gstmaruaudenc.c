@@ -28,7 +28,13 @@
 enum
 {
   PROP_0,
-  PROP_BIT_RATE
+  PROP_BIT_RATE,
+  PROP_FRAMES_PER_REQUEST,
+  PROP_MEMORY_WAITS,
+  PROP_SPIN_HITS,
+  PROP_SPIN_MISSES,
+  PROP_WAIT_LATENCY,
+  PROP_PRIORITY
 };
 
 typedef struct _GstMaruAudEnc
@@ -47,6 +53,10 @@ typedef struct _GstMaruAudEnc
   CodecDevice *dev;
   gboolean opened;
 
+  /* codec frames sent to the device at once */
+  guint frames_per_request;
+  guint8 *working_buf;
+
 } GstMaruAudEnc;
 
 typedef struct _GstMaruAudEncClass
@@ -78,6 +88,8 @@ static void gst_maruaudenc_get_property(GObject *object, guint prop_id,
     GValue *value, GParamSpec *pspec);
 
 #define DEFAULT_AUDIO_BITRATE   128000
+#define DEFAULT_FRAMES_PER_REQUEST 1
+#define DEFAULT_PRIORITY           CODEC_PRIORITY_NORMAL
 
 #define MARU_DEFAULT_COMPLIANCE 0
 
@@ -153,6 +165,42 @@ gst_maruaudenc_class_init (GstMaruAudEncClass *klass)
           "Target Audio Bitrate", 0, G_MAXINT, DEFAULT_AUDIO_BITRATE,
           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (G_OBJECT_CLASS (klass),
+      PROP_FRAMES_PER_REQUEST,
+      g_param_spec_uint ("frames-per-request", "Frames per request",
+          "Number of codec frames encoded in one device request",
+          1, MAX_AUDIO_ENCODE_BATCH, DEFAULT_FRAMES_PER_REQUEST,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (G_OBJECT_CLASS (klass), PROP_MEMORY_WAITS,
+      g_param_spec_uint ("memory-waits", "Memory waits",
+          "How many times the encoder waited for device memory",
+          0, G_MAXUINT, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (G_OBJECT_CLASS (klass), PROP_SPIN_HITS,
+      g_param_spec_uint ("spin-hits", "Spin hits",
+          "How many replies came while the encoder spun for them, "
+          "with GST_MARU_CODEC_WAIT=hybrid",
+          0, G_MAXUINT, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (G_OBJECT_CLASS (klass), PROP_SPIN_MISSES,
+      g_param_spec_uint ("spin-misses", "Spin misses",
+          "How many times the encoder spun in vain and blocked, "
+          "with GST_MARU_CODEC_WAIT=hybrid",
+          0, G_MAXUINT, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (G_OBJECT_CLASS (klass), PROP_WAIT_LATENCY,
+      g_param_spec_int64 ("wait-latency", "Wait latency",
+          "Average time in usec the encoder waited for a reply, "
+          "with GST_MARU_CODEC_WAIT=hybrid",
+          0, G_MAXINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (G_OBJECT_CLASS (klass), PROP_PRIORITY,
+      g_param_spec_enum ("priority", "Priority",
+          "Which streams the device serves first",
+          GST_MARU_TYPE_PRIORITY, DEFAULT_PRIORITY,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
   gobject_class->finalize = gst_maruaudenc_finalize;
 
   gstaudioencoder_class->start = GST_DEBUG_FUNCPTR (gst_maruaudenc_start);
@@ -175,6 +223,7 @@ gst_maruaudenc_init (GstMaruAudEnc *maruaudenc)
   maruaudenc->dev = g_malloc0 (sizeof(CodecDevice));
 
   maruaudenc->compliance = MARU_DEFAULT_COMPLIANCE;
+  maruaudenc->frames_per_request = DEFAULT_FRAMES_PER_REQUEST;
 
   gst_audio_encoder_set_drainable (GST_AUDIO_ENCODER (maruaudenc), TRUE);
 }
@@ -196,6 +245,9 @@ gst_maruaudenc_finalize (GObject *object)
   g_free (maruaudenc->dev);
   maruaudenc->dev = NULL;
 
+  g_free (maruaudenc->working_buf);
+  maruaudenc->working_buf = NULL;
+
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
 
@@ -355,7 +407,13 @@ if (!gst_audio_encoder_set_output_format (GST_AUDIO_ENCODER (maruaudenc),
         frame_size);
     gst_audio_encoder_set_frame_samples_max (GST_AUDIO_ENCODER (maruaudenc),
         frame_size);
-    gst_audio_encoder_set_frame_max (GST_AUDIO_ENCODER (maruaudenc), 1);
+    // the base class hands over up to this many frames at once.
+    if (interface->encode_audio_batch) {
+      gst_audio_encoder_set_frame_max (GST_AUDIO_ENCODER (maruaudenc),
+          maruaudenc->frames_per_request);
+    } else {
+      gst_audio_encoder_set_frame_max (GST_AUDIO_ENCODER (maruaudenc), 1);
+    }
   } else {
     gst_audio_encoder_set_frame_samples_min (GST_AUDIO_ENCODER (maruaudenc),
         0);
@@ -405,6 +463,67 @@ gst_maruaudenc_encode_audio (GstMaruAudEnc *maruaudenc, guint8 *audio_in,
   return ret;
 }
 
+/* encode several whole codec frames in one request and finish each
+ * packet with the samples of one frame. a partial frame at the end, as
+ * the base class hands over when draining, is encoded on its own. */
+static GstFlowReturn
+gst_maruaudenc_encode_frames (GstMaruAudEnc *maruaudenc, guint8 *audio_in,
+  guint in_size)
+{
+  GstAudioEncoder *enc = GST_AUDIO_ENCODER (maruaudenc);
+  GstAudioInfo *info = gst_audio_encoder_get_audio_info (enc);
+  gint frame_size = maruaudenc->context->audio.frame_size;
+  gint frame_bytes = frame_size * GST_AUDIO_INFO_BPF (info);
+  gint packet_sizes[MAX_AUDIO_ENCODE_BATCH];
+  gint nb_frames, nb_packets, i;
+  guint rest;
+  GstFlowReturn ret = GST_FLOW_OK;
+  GstBuffer *outbuf;
+  guint8 *data;
+
+  nb_frames = in_size / frame_bytes;
+  rest = in_size - nb_frames * frame_bytes;
+
+  GST_LOG_OBJECT (maruaudenc, "encoding %d frames of %d bytes",
+    nb_frames, frame_bytes);
+
+  if (!maruaudenc->working_buf) {
+    maruaudenc->working_buf = g_malloc (FF_MAX_AUDIO_FRAME_SIZE);
+  }
+  nb_packets = interface->encode_audio_batch (maruaudenc->context,
+        maruaudenc->working_buf, FF_MAX_AUDIO_FRAME_SIZE, audio_in,
+        frame_bytes, nb_frames, packet_sizes, maruaudenc->dev);
+
+  if (nb_packets < 0) {
+    GST_ERROR_OBJECT (enc, "Failed to encode %d frames: %d",
+      nb_frames, nb_packets);
+    return GST_FLOW_OK;
+  }
+
+  data = maruaudenc->working_buf;
+  for (i = 0; i < nb_packets && ret == GST_FLOW_OK; i++) {
+    outbuf = gst_audio_encoder_allocate_output_buffer (enc, packet_sizes[i]);
+    gst_buffer_fill (outbuf, 0, data, packet_sizes[i]);
+    data += packet_sizes[i];
+
+    ret = gst_audio_encoder_finish_frame (enc, outbuf, frame_size);
+  }
+
+  // the codec kept the rest of the frames back for now.
+  if (ret == GST_FLOW_OK && nb_packets < nb_frames) {
+    ret = gst_audio_encoder_finish_frame (enc, NULL,
+        (nb_frames - nb_packets) * frame_size);
+  }
+
+  if (ret == GST_FLOW_OK && rest > 0) {
+    GST_LOG_OBJECT (maruaudenc, "encoding the last %u bytes", rest);
+    ret = gst_maruaudenc_encode_audio (maruaudenc,
+        audio_in + nb_frames * frame_bytes, rest);
+  }
+
+  return ret;
+}
+
 static void
 gst_maruaudenc_drain (GstMaruAudEnc *maruaudenc)
 {
@@ -466,7 +585,14 @@ gst_maruaudenc_handle_frame (GstAudioEncoder *encoder, GstBuffer *inbuf)
 
   in_data = map.data;
   size = map.size;
-  ret = gst_maruaudenc_encode_audio (maruaudenc, in_data, size);
+  if (interface->encode_audio_batch && maruaudenc->frames_per_request > 1 &&
+      maruaudenc->context->audio.frame_size > 1 &&
+      size >= maruaudenc->context->audio.frame_size *
+        GST_AUDIO_INFO_BPF (gst_audio_encoder_get_audio_info (encoder)) * 2) {
+    ret = gst_maruaudenc_encode_frames (maruaudenc, in_data, size);
+  } else {
+    ret = gst_maruaudenc_encode_audio (maruaudenc, in_data, size);
+  }
   gst_buffer_unmap (inbuf, &map);
   gst_buffer_unref (inbuf);
 
@@ -488,6 +614,12 @@ gst_maruaudenc_set_property (GObject *object,
 
   maruaudenc = (GstMaruAudEnc *) (object);
 
+  if (prop_id == PROP_PRIORITY) {
+    // read at every request, so it can change while encoding
+    maruaudenc->context->priority = g_value_get_enum (value);
+    return;
+  }
+
   if (maruaudenc->opened) {
     GST_WARNING_OBJECT (maruaudenc,
       "Can't change properties one decoder is setup !");
@@ -498,6 +630,9 @@ gst_maruaudenc_set_property (GObject *object,
     case PROP_BIT_RATE:
       maruaudenc->bitrate = g_value_get_int (value);
       break;
+    case PROP_FRAMES_PER_REQUEST:
+      maruaudenc->frames_per_request = g_value_get_uint (value);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -516,6 +651,24 @@ gst_maruaudenc_get_property (GObject *object,
     case PROP_BIT_RATE:
       g_value_set_int (value, maruaudenc->bitrate);
       break;
+    case PROP_FRAMES_PER_REQUEST:
+      g_value_set_uint (value, maruaudenc->frames_per_request);
+      break;
+    case PROP_MEMORY_WAITS:
+      g_value_set_uint (value, maruaudenc->context->wait.mem_waits);
+      break;
+    case PROP_SPIN_HITS:
+      g_value_set_uint (value, maruaudenc->context->wait.spin_hits);
+      break;
+    case PROP_SPIN_MISSES:
+      g_value_set_uint (value, maruaudenc->context->wait.spin_misses);
+      break;
+    case PROP_WAIT_LATENCY:
+      g_value_set_int64 (value, maruaudenc->context->wait.latency);
+      break;
+    case PROP_PRIORITY:
+      g_value_set_enum (value, maruaudenc->context->priority);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -0,0 +1,484 @@
+/*
+ * Gstreamer codec plugin for Tizen Emulator.
+ *
+ * Copyright (C) 2013 Samsung Electronics Co., Ltd. All rights reserved.
+ *
+ * Contact:
+ * KiTae Kim <kt920.kim@samsung.com>
+ * SeokYeon Hwang <syeon.hwang@samsung.com>
+ * YeongKyoon Lee <yeongkyoon.lee@samsung.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Contributors:
+ * - S-Core Co., Ltd
+ *
+ */
+
+/*
+ * the codec device as served by gst-maru-codec-broker.
+ *
+ * the fd given out by open is the first connection to the broker and
+ * stands for the device. requests are sent over further connections,
+ * one per request in flight, so that a slow request of one stream does
+ * not hold up the others. those connections attach to the device file
+ * of the first one, so every fd opened here is a device file of its own
+ * in the broker.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "gstmaru.h"
+#include "gstmarudevice.h"
+#include "gstmarubroker.h"
+
+gboolean
+gst_maru_broker_ioctl_size (unsigned long request,
+                          guint *in_size, guint *out_size)
+{
+  switch (_IOC_NR (request)) {
+  case IOCTL_CMD_GET_VERSION:
+  case IOCTL_CMD_GET_ELEMENTS_SIZE:
+  case IOCTL_CMD_GET_CONTEXT_INDEX:
+    *in_size = 0;
+    *out_size = sizeof(uint32_t);
+    break;
+  case IOCTL_CMD_GET_ELEMENTS:
+    // as much as GET_ELEMENTS_SIZE told
+    *in_size = 0;
+    *out_size = CODEC_BROKER_MAX_PAYLOAD;
+    break;
+  case IOCTL_CMD_SECURE_BUFFER:
+  case IOCTL_CMD_TRY_SECURE_BUFFER:
+  case IOCTL_CMD_INVOKE_API_AND_GET_DATA:
+    *in_size = *out_size = sizeof(IOCTL_Data);
+    break;
+  case IOCTL_CMD_CANCEL_REQUESTS:
+    *in_size = sizeof(IOCTL_Data);
+    *out_size = 0;
+    break;
+  case IOCTL_CMD_RELEASE_BUFFER:
+    *in_size = sizeof(uint32_t);
+    *out_size = 0;
+    break;
+  case IOCTL_CMD_GET_PROFILE_STATUS:
+    *in_size = 0;
+    *out_size = sizeof(uint8_t);
+    break;
+  case IOCTL_CMD_INVOKE_API_TIMED:
+    *in_size = *out_size = sizeof(IOCTL_TimedData);
+    break;
+  case IOCTL_CMD_GET_CAPABILITIES:
+    *in_size = 0;
+    *out_size = sizeof(IOCTL_Capabilities);
+    break;
+  default:
+    // eventfds and rings belong to one process and are not brokered
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static int
+write_all (int sock, const void *data, size_t size)
+{
+  ssize_t ret;
+
+  while (size > 0) {
+    ret = send (sock, data, size, MSG_NOSIGNAL);
+    if (ret < 0 && errno == EINTR) {
+      continue;
+    }
+    if (ret <= 0) {
+      return -1;
+    }
+    data = (const uint8_t *)data + ret;
+    size -= ret;
+  }
+
+  return 0;
+}
+
+static int
+read_all (int sock, void *data, size_t size)
+{
+  ssize_t ret;
+
+  while (size > 0) {
+    ret = recv (sock, data, size, MSG_WAITALL);
+    if (ret < 0 && errno == EINTR) {
+      continue;
+    }
+    if (ret <= 0) {
+      return -1;
+    }
+    data = (uint8_t *)data + ret;
+    size -= ret;
+  }
+
+  return 0;
+}
+
+int
+gst_maru_broker_send (int sock, CodecBrokerMessage *msg,
+                          const void *payload, int pass_fd)
+{
+  char control[CMSG_SPACE(sizeof(int))];
+  struct iovec iov = { msg, sizeof(*msg) };
+  struct msghdr header = { 0, };
+  struct cmsghdr *cmsg;
+  ssize_t ret;
+
+  header.msg_iov = &iov;
+  header.msg_iovlen = 1;
+  if (pass_fd >= 0) {
+    memset (control, 0, sizeof(control));
+    header.msg_control = control;
+    header.msg_controllen = sizeof(control);
+    cmsg = CMSG_FIRSTHDR (&header);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN (sizeof(int));
+    memcpy (CMSG_DATA (cmsg), &pass_fd, sizeof(int));
+  }
+
+  do {
+    ret = sendmsg (sock, &header, MSG_NOSIGNAL);
+  } while (ret < 0 && errno == EINTR);
+  if (ret < 0) {
+    return -1;
+  }
+  if (ret < (ssize_t) sizeof(*msg) &&
+      write_all (sock, (uint8_t *)msg + ret, sizeof(*msg) - ret) < 0) {
+    return -1;
+  }
+
+  return write_all (sock, payload, msg->size);
+}
+
+int
+gst_maru_broker_recv (int sock, CodecBrokerMessage *msg,
+                          void *payload, guint max_size, int *passed_fd)
+{
+  char control[CMSG_SPACE(sizeof(int))];
+  struct iovec iov = { msg, sizeof(*msg) };
+  struct msghdr header = { 0, };
+  struct cmsghdr *cmsg;
+  ssize_t ret;
+
+  if (passed_fd) {
+    *passed_fd = -1;
+  }
+
+  header.msg_iov = &iov;
+  header.msg_iovlen = 1;
+  header.msg_control = control;
+  header.msg_controllen = sizeof(control);
+
+  do {
+    ret = recvmsg (sock, &header, MSG_WAITALL | MSG_CMSG_CLOEXEC);
+  } while (ret < 0 && errno == EINTR);
+  if (ret <= 0) {
+    return -1;
+  }
+
+  for (cmsg = CMSG_FIRSTHDR (&header); cmsg;
+      cmsg = CMSG_NXTHDR (&header, cmsg)) {
+    if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+      int fd;
+
+      memcpy (&fd, CMSG_DATA (cmsg), sizeof(int));
+      if (passed_fd) {
+        *passed_fd = fd;
+      } else {
+        close (fd);
+      }
+    }
+  }
+
+  if ((ret < (ssize_t) sizeof(*msg) &&
+      read_all (sock, (uint8_t *)msg + ret, sizeof(*msg) - ret) < 0) ||
+      msg->size > max_size || read_all (sock, payload, msg->size) < 0) {
+    if (passed_fd && *passed_fd >= 0) {
+      close (*passed_fd);
+      *passed_fd = -1;
+    }
+    errno = EPROTO;
+    return -1;
+  }
+
+  return 0;
+}
+
+//
+// device ops
+//
+
+typedef struct {
+  int fd;
+  uint32_t id;
+  // the table holds one, and every call in flight one more
+  gint refs;
+  GMutex lock;
+  // connections without a request in flight
+  GQueue idle;
+} BrokerFile;
+
+static GMutex broker_lock;
+static GHashTable *broker_files;
+
+static int
+broker_connect (void)
+{
+  const gchar *path = g_getenv ("GST_MARU_BROKER_SOCKET");
+  struct sockaddr_un addr = { 0, };
+  int sock;
+
+  if (!path) {
+    path = CODEC_BROKER_SOCKET;
+  }
+
+  sock = socket (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (sock < 0) {
+    return -1;
+  }
+
+  addr.sun_family = AF_UNIX;
+  g_strlcpy (addr.sun_path, path, sizeof(addr.sun_path));
+  if (connect (sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+    GST_ERROR ("failed to connect to the codec broker at %s", path);
+    close (sock);
+    return -1;
+  }
+
+  return sock;
+}
+
+// sends a command on sock itself and waits for its reply
+static int
+broker_command (int sock, uint32_t cmd, const void *payload, guint size)
+{
+  CodecBrokerMessage msg = { 0, };
+
+  msg.cmd = cmd;
+  msg.size = size;
+  if (gst_maru_broker_send (sock, &msg, payload, -1) < 0 ||
+      gst_maru_broker_recv (sock, &msg, NULL, 0, NULL) < 0) {
+    errno = EPIPE;
+    return -1;
+  }
+
+  if (msg.ret < 0) {
+    errno = msg.err;
+  }
+  return msg.ret;
+}
+
+// the file stays valid until file_unref, even if it is closed meanwhile
+static BrokerFile *
+lookup_file (int fd)
+{
+  BrokerFile *file = NULL;
+
+  g_mutex_lock (&broker_lock);
+  if (broker_files) {
+    file = g_hash_table_lookup (broker_files, GINT_TO_POINTER (fd));
+  }
+  if (file) {
+    g_atomic_int_inc (&file->refs);
+  }
+  g_mutex_unlock (&broker_lock);
+
+  return file;
+}
+
+static void
+file_unref (BrokerFile *file)
+{
+  gpointer sock;
+
+  if (!g_atomic_int_dec_and_test (&file->refs)) {
+    return;
+  }
+
+  while ((sock = g_queue_pop_head (&file->idle))) {
+    close (GPOINTER_TO_INT (sock) - 1);
+  }
+  g_mutex_clear (&file->lock);
+  g_free (file);
+}
+
+// sends a request over an idle connection and waits for its reply
+static int
+broker_call (int fd, CodecBrokerMessage *msg, const void *payload,
+    void *reply, guint reply_size, int *passed_fd)
+{
+  BrokerFile *file = lookup_file (fd);
+  int sock;
+
+  if (!file) {
+    errno = EBADF;
+    return -1;
+  }
+
+  g_mutex_lock (&file->lock);
+  sock = GPOINTER_TO_INT (g_queue_pop_head (&file->idle)) - 1;
+  g_mutex_unlock (&file->lock);
+  if (sock < 0) {
+    if ((sock = broker_connect ()) < 0) {
+      file_unref (file);
+      return -1;
+    }
+    if (broker_command (sock, CODEC_BROKER_ATTACH,
+        &file->id, sizeof(file->id)) < 0) {
+      GST_ERROR ("failed to attach connection %d to the codec broker", sock);
+      close (sock);
+      file_unref (file);
+      return -1;
+    }
+  }
+
+  if (gst_maru_broker_send (sock, msg, payload, -1) < 0 ||
+      gst_maru_broker_recv (sock, msg, reply, reply_size, passed_fd) < 0) {
+    GST_ERROR ("lost connection %d to the codec broker", sock);
+    close (sock);
+    file_unref (file);
+    errno = EPIPE;
+    return -1;
+  }
+
+  g_mutex_lock (&file->lock);
+  g_queue_push_head (&file->idle, GINT_TO_POINTER (sock + 1));
+  g_mutex_unlock (&file->lock);
+  file_unref (file);
+
+  if (msg->ret < 0) {
+    errno = msg->err;
+  }
+  return msg->ret;
+}
+
+static int
+broker_open (void)
+{
+  BrokerFile *file;
+  int fd, id;
+
+  fd = broker_connect ();
+  if (fd < 0) {
+    return -1;
+  }
+
+  id = broker_command (fd, CODEC_BROKER_OPEN, NULL, 0);
+  if (id < 0) {
+    GST_ERROR ("the codec broker failed to open the device");
+    close (fd);
+    return -1;
+  }
+
+  file = g_new0 (BrokerFile, 1);
+  file->fd = fd;
+  file->id = id;
+  file->refs = 1;
+  g_mutex_init (&file->lock);
+  g_queue_init (&file->idle);
+
+  g_mutex_lock (&broker_lock);
+  if (!broker_files) {
+    broker_files = g_hash_table_new (g_direct_hash, g_direct_equal);
+  }
+  g_hash_table_insert (broker_files, GINT_TO_POINTER (fd), file);
+  g_mutex_unlock (&broker_lock);
+
+  return fd;
+}
+
+static int
+broker_close (int fd)
+{
+  BrokerFile *file;
+
+  g_mutex_lock (&broker_lock);
+  file = broker_files ?
+    g_hash_table_lookup (broker_files, GINT_TO_POINTER (fd)) : NULL;
+  if (file) {
+    g_hash_table_remove (broker_files, GINT_TO_POINTER (fd));
+  }
+  g_mutex_unlock (&broker_lock);
+  if (!file) {
+    errno = EBADF;
+    return -1;
+  }
+
+  // calls in flight still use it, the last one frees it
+  file_unref (file);
+
+  return close (fd);
+}
+
+static int
+broker_ioctl (int fd, unsigned long request, void *data)
+{
+  CodecBrokerMessage msg = { 0, };
+  guint in_size, out_size;
+
+  if (!gst_maru_broker_ioctl_size (request, &in_size, &out_size)) {
+    errno = ENOTTY;
+    return -1;
+  }
+
+  msg.cmd = CODEC_BROKER_IOCTL;
+  msg.request = request;
+  msg.size = in_size;
+
+  return broker_call (fd, &msg, data, data, out_size, NULL);
+}
+
+static gpointer
+broker_mmap (int fd, size_t size)
+{
+  CodecBrokerMessage msg = { 0, };
+  gpointer mem;
+  int mem_fd;
+
+  msg.cmd = CODEC_BROKER_MAP;
+  if (broker_call (fd, &msg, NULL, NULL, 0, &mem_fd) < 0) {
+    return MAP_FAILED;
+  }
+  if (mem_fd < 0) {
+    errno = EPROTO;
+    return MAP_FAILED;
+  }
+
+  mem = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, mem_fd, 0);
+  close (mem_fd);
+
+  return mem;
+}
+
+CodecDeviceOps *device_ops_broker = &(CodecDeviceOps) {
+  .open = broker_open,
+  .close = broker_close,
+  .ioctl = broker_ioctl,
+  .mmap = broker_mmap,
+  .munmap = munmap,
+};
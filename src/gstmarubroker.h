@@ -0,0 +1,80 @@
+/*
+ * Gstreamer codec plugin for Tizen Emulator.
+ *
+ * Copyright (C) 2013 Samsung Electronics Co., Ltd. All rights reserved.
+ *
+ * Contact:
+ * KiTae Kim <kt920.kim@samsung.com>
+ * SeokYeon Hwang <syeon.hwang@samsung.com>
+ * YeongKyoon Lee <yeongkyoon.lee@samsung.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Contributors:
+ * - S-Core Co., Ltd
+ *
+ */
+
+#ifndef __GST_MARU_BROKER_H__
+#define __GST_MARU_BROKER_H__
+
+#include "gstmaru.h"
+#include "gstmaruinterface3.h"
+
+/*
+ * protocol between the plugin and gst-maru-codec-broker.
+ *
+ * every message is a CodecBrokerMessage followed by size bytes of
+ * payload. a request gets exactly one reply on the same connection, so a
+ * process opens one connection per request in flight. the reply of
+ * CODEC_BROKER_MAP carries a fd that maps the memory of the device, a
+ * memfd and never the device itself.
+ *
+ * CODEC_BROKER_OPEN opens a device file and replies its id in ret. every
+ * further connection of that file sends the id with CODEC_BROKER_ATTACH
+ * before its first request.
+ *
+ * the socket lives in a directory only the owner and group of the broker
+ * can enter.
+ */
+#define CODEC_BROKER_DIR          "/run/gst-maru-codec-broker"
+#define CODEC_BROKER_SOCKET       CODEC_BROKER_DIR "/socket"
+#define CODEC_BROKER_MAX_PAYLOAD  (256 * 1024)
+
+enum CODEC_BROKER_CMD {
+  CODEC_BROKER_IOCTL,
+  CODEC_BROKER_MAP,
+  CODEC_BROKER_OPEN,
+  CODEC_BROKER_ATTACH,
+};
+
+typedef struct {
+  uint32_t  cmd;
+  uint32_t  request;
+  int32_t   ret;
+  int32_t   err;
+  uint32_t  size;
+} __attribute__((packed)) CodecBrokerMessage;
+
+gboolean gst_maru_broker_ioctl_size (unsigned long request,
+                          guint *in_size, guint *out_size);
+
+int gst_maru_broker_send (int sock, CodecBrokerMessage *msg,
+                          const void *payload, int pass_fd);
+int gst_maru_broker_recv (int sock, CodecBrokerMessage *msg,
+                          void *payload, guint max_size, int *passed_fd);
+
+#endif
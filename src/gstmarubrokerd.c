@@ -0,0 +1,749 @@
+/*
+ * Gstreamer codec plugin for Tizen Emulator.
+ *
+ * Copyright (C) 2013 Samsung Electronics Co., Ltd. All rights reserved.
+ *
+ * Contact:
+ * KiTae Kim <kt920.kim@samsung.com>
+ * SeokYeon Hwang <syeon.hwang@samsung.com>
+ * YeongKyoon Lee <yeongkyoon.lee@samsung.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Contributors:
+ * - S-Core Co., Ltd
+ *
+ */
+
+/*
+ * gst-maru-codec-broker owns the codec device on behalf of every media
+ * process. the plugin reaches it with GST_MARU_CODEC_DEVICE=broker.
+ *
+ * the device memory is mapped once here. the processes map a memfd the
+ * broker hands them, never the device fd: with the kernel driver it is a
+ * copy of the device memory that requests and replies are staged
+ * through, the loopback memory is a memfd already. every device file a process opens gets one of its own here, and the
+ * contexts and memory it leaves behind are released when its last
+ * connection goes away. a device file only reaches the contexts and
+ * memory it got itself. requests of all processes reach the device in
+ * order of arrival, at most --requests at a time, and a device file may
+ * hold at most --memory bytes of device memory at once.
+ *
+ * only processes of the user or group of the broker may connect.
+ *
+ *   gst-maru-codec-broker [-s socket] [-j requests] [-m bytes] [-l]
+ *
+ * --loopback serves the loopback device instead of the kernel driver, so
+ * the broker can be tried on a host without the emulator.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "gstmaru.h"
+#include "gstmaruinterface.h"
+#include "gstmaruinterface3.h"
+#include "gstmarudevice.h"
+#include "gstmarubroker.h"
+
+GST_DEBUG_CATEGORY (maru_debug);
+
+static int
+kernel_open (void)
+{
+  return open (CODEC_DEV, O_RDWR | O_CLOEXEC);
+}
+
+static gpointer
+kernel_mmap (int fd, size_t size)
+{
+  return mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+}
+
+static int
+kernel_ioctl (int fd, unsigned long request, void *data)
+{
+  return ioctl (fd, request, data);
+}
+
+static CodecDeviceOps *device_ops_kernel = &(CodecDeviceOps) {
+  .open = kernel_open,
+  .close = close,
+  .ioctl = kernel_ioctl,
+  .mmap = kernel_mmap,
+  .munmap = munmap,
+};
+
+typedef struct {
+  uint32_t id;
+  pid_t pid;
+  int fd;
+  int refs;
+  // offset -> size of the device memory the process holds
+  GHashTable *buffers;
+  guint64 mem_used;
+  // contexts the process did not close yet
+  GHashTable *contexts;
+} BrokerClient;
+
+typedef struct {
+  int sock;
+  pid_t pid;
+  BrokerClient *client;
+} BrokerConnection;
+
+static struct {
+  CodecDeviceOps *ops;
+  int fd;
+  gpointer mem;
+  uint32_t mem_size;
+  int mem_fd;
+  // what the processes map when it is not the device memory itself
+  gpointer staging;
+
+  GMutex lock;
+  GCond changed;
+  // id -> client
+  GHashTable *clients;
+  uint32_t next_client;
+
+  // requests are let through in order of their tickets
+  guint max_requests;
+  guint running;
+  guint64 next_ticket;
+  guint64 serving;
+
+  guint64 mem_budget;
+} broker;
+
+//
+// clients
+//
+
+static BrokerClient *
+client_open (pid_t pid)
+{
+  BrokerClient *client;
+  int fd = broker.ops->open ();
+
+  if (fd < 0) {
+    GST_ERROR ("failed to open the device for process %d", pid);
+    return NULL;
+  }
+
+  client = g_new0 (BrokerClient, 1);
+  client->pid = pid;
+  client->fd = fd;
+  client->refs = 1;
+  client->buffers = g_hash_table_new (g_direct_hash, g_direct_equal);
+  client->contexts = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+  g_mutex_lock (&broker.lock);
+  // ids stay below G_MAXINT32, they are replied in ret
+  do {
+    client->id = broker.next_client++ & G_MAXINT32;
+  } while (client->id == 0 ||
+      g_hash_table_contains (broker.clients, GUINT_TO_POINTER (client->id)));
+  g_hash_table_insert (broker.clients, GUINT_TO_POINTER (client->id), client);
+  g_mutex_unlock (&broker.lock);
+
+  GST_INFO ("process %d opened device file %u, device fd %d",
+    pid, client->id, fd);
+
+  return client;
+}
+
+// a further connection of a device file. it has to come from the process
+// that opened the file.
+static BrokerClient *
+client_attach (uint32_t id, pid_t pid)
+{
+  BrokerClient *client;
+
+  g_mutex_lock (&broker.lock);
+  client = g_hash_table_lookup (broker.clients, GUINT_TO_POINTER (id));
+  if (client && client->pid == pid) {
+    client->refs++;
+  } else {
+    client = NULL;
+  }
+  g_mutex_unlock (&broker.lock);
+
+  return client;
+}
+
+static gboolean
+client_owns (BrokerClient *client, GHashTable *table, gpointer key)
+{
+  gboolean ret;
+
+  g_mutex_lock (&broker.lock);
+  ret = g_hash_table_contains (table, key);
+  g_mutex_unlock (&broker.lock);
+
+  return ret;
+}
+
+// closes what a process left open, e.g. after it crashed
+static void
+client_cleanup (BrokerClient *client)
+{
+  GHashTableIter iter;
+  gpointer key, value;
+
+  g_hash_table_iter_init (&iter, client->contexts);
+  while (g_hash_table_iter_next (&iter, &key, &value)) {
+    IOCTL_Data data = { 0, };
+
+    GST_WARNING ("close context %d of device file %u",
+      GPOINTER_TO_INT (key), client->id);
+    data.api_index = CODEC_DEINIT;
+    data.ctx_index = GPOINTER_TO_INT (key);
+    data.buffer_size = -1;
+    broker.ops->ioctl (client->fd,
+      IOCTL_RW(IOCTL_CMD_INVOKE_API_AND_GET_DATA), &data);
+  }
+
+  g_hash_table_iter_init (&iter, client->buffers);
+  while (g_hash_table_iter_next (&iter, &key, &value)) {
+    uint32_t offset = GPOINTER_TO_UINT (key);
+
+    GST_WARNING ("release device memory 0x%x of device file %u",
+      offset, client->id);
+    broker.ops->ioctl (client->fd, IOCTL_RW(IOCTL_CMD_RELEASE_BUFFER), &offset);
+  }
+
+  broker.ops->close (client->fd);
+}
+
+static void
+client_put (BrokerClient *client)
+{
+  g_mutex_lock (&broker.lock);
+  if (--client->refs > 0) {
+    g_mutex_unlock (&broker.lock);
+    return;
+  }
+  g_hash_table_remove (broker.clients, GUINT_TO_POINTER (client->id));
+  g_mutex_unlock (&broker.lock);
+
+  GST_INFO ("process %d closed device file %u", client->pid, client->id);
+  client_cleanup (client);
+
+  g_hash_table_destroy (client->buffers);
+  g_hash_table_destroy (client->contexts);
+  g_free (client);
+}
+
+//
+// scheduling
+//
+
+static void
+request_begin (void)
+{
+  guint64 ticket;
+
+  g_mutex_lock (&broker.lock);
+  ticket = broker.next_ticket++;
+  while (ticket != broker.serving || broker.running >= broker.max_requests) {
+    g_cond_wait (&broker.changed, &broker.lock);
+  }
+  broker.serving++;
+  broker.running++;
+  g_cond_broadcast (&broker.changed);
+  g_mutex_unlock (&broker.lock);
+}
+
+static void
+request_end (void)
+{
+  g_mutex_lock (&broker.lock);
+  broker.running--;
+  g_cond_broadcast (&broker.changed);
+  g_mutex_unlock (&broker.lock);
+}
+
+//
+// memory budget
+//
+// a request larger than the budget is let through when the process
+// holds nothing, so that it cannot wait forever.
+
+static gboolean
+budget_reserve (BrokerClient *client, guint64 size, gboolean blocking)
+{
+  gboolean ret = TRUE;
+
+  g_mutex_lock (&broker.lock);
+  while (broker.mem_budget && client->mem_used > 0 &&
+      client->mem_used + size > broker.mem_budget) {
+    if (!blocking) {
+      ret = FALSE;
+      break;
+    }
+    g_cond_wait (&broker.changed, &broker.lock);
+  }
+  if (ret) {
+    client->mem_used += size;
+  }
+  g_mutex_unlock (&broker.lock);
+
+  return ret;
+}
+
+static void
+budget_release (BrokerClient *client, guint64 size)
+{
+  g_mutex_lock (&broker.lock);
+  client->mem_used -= MIN (size, client->mem_used);
+  g_cond_broadcast (&broker.changed);
+  g_mutex_unlock (&broker.lock);
+}
+
+static void
+buffer_add (BrokerClient *client, uint32_t offset, uint32_t size)
+{
+  g_mutex_lock (&broker.lock);
+  g_hash_table_insert (client->buffers,
+    GUINT_TO_POINTER (offset), GUINT_TO_POINTER (size));
+  g_mutex_unlock (&broker.lock);
+}
+
+static uint32_t
+buffer_remove (BrokerClient *client, uint32_t offset)
+{
+  gpointer size = NULL;
+
+  g_mutex_lock (&broker.lock);
+  if (g_hash_table_lookup_extended (client->buffers,
+      GUINT_TO_POINTER (offset), NULL, &size)) {
+    g_hash_table_remove (client->buffers, GUINT_TO_POINTER (offset));
+  }
+  g_mutex_unlock (&broker.lock);
+
+  return GPOINTER_TO_UINT (size);
+}
+
+//
+// staging
+//
+// a request is copied from the memory of the processes into the device
+// memory before the call, and the reply back after it. only buffers the
+// device file holds go in.
+
+static uint32_t
+buffer_size (BrokerClient *client, uint32_t offset)
+{
+  gpointer size;
+
+  g_mutex_lock (&broker.lock);
+  size = g_hash_table_lookup (client->buffers, GUINT_TO_POINTER (offset));
+  g_mutex_unlock (&broker.lock);
+
+  return GPOINTER_TO_UINT (size);
+}
+
+static void
+stage (uint32_t offset, guint64 size, gboolean to_device)
+{
+  uint8_t *device = broker.mem;
+  uint8_t *staging = broker.staging;
+
+  if (!staging || offset >= broker.mem_size) {
+    return;
+  }
+  size = MIN (size, broker.mem_size - offset);
+  if (to_device) {
+    memcpy (device + offset, staging + offset, size);
+  } else {
+    memcpy (staging + offset, device + offset, size);
+  }
+}
+
+//
+// requests
+//
+
+static void
+serve_ioctl (BrokerClient *client, CodecBrokerMessage *msg, uint8_t *payload)
+{
+  IOCTL_Data *data = (IOCTL_Data *)payload;
+  guint in_size, out_size;
+  uint32_t offset, size;
+  int32_t reply_size;
+  int ret = -1, err = 0;
+
+  if (!gst_maru_broker_ioctl_size (msg->request, &in_size, &out_size) ||
+      msg->size != in_size) {
+    msg->ret = -1;
+    msg->err = ENOTTY;
+    msg->size = 0;
+    return;
+  }
+
+  switch (_IOC_NR (msg->request)) {
+  case IOCTL_CMD_GET_ELEMENTS:
+  {
+    uint32_t elements_size = 0;
+
+    ret = broker.ops->ioctl (client->fd,
+      IOCTL_RW(IOCTL_CMD_GET_ELEMENTS_SIZE), &elements_size);
+    if (ret == 0 && elements_size > CODEC_BROKER_MAX_PAYLOAD) {
+      errno = E2BIG;
+      ret = -1;
+    }
+    if (ret == 0) {
+      ret = broker.ops->ioctl (client->fd, msg->request, payload);
+    }
+    out_size = elements_size;
+    break;
+  }
+  case IOCTL_CMD_SECURE_BUFFER:
+  case IOCTL_CMD_TRY_SECURE_BUFFER:
+    size = data->buffer_size;
+    if (!budget_reserve (client, size,
+        _IOC_NR (msg->request) == IOCTL_CMD_SECURE_BUFFER)) {
+      errno = EBUSY;
+      break;
+    }
+    ret = broker.ops->ioctl (client->fd, msg->request, payload);
+    if (ret == 0) {
+      buffer_add (client, data->mem_offset, size);
+    } else {
+      err = errno;
+      budget_release (client, size);
+      errno = err;
+    }
+    break;
+  case IOCTL_CMD_RELEASE_BUFFER:
+    offset = *(uint32_t *)payload;
+    if (!client_owns (client, client->buffers, GUINT_TO_POINTER (offset))) {
+      errno = EPERM;
+      break;
+    }
+    ret = broker.ops->ioctl (client->fd, msg->request, payload);
+    if (ret == 0) {
+      budget_release (client, buffer_remove (client, offset));
+    }
+    break;
+  case IOCTL_CMD_INVOKE_API_TIMED:
+    data = &((IOCTL_TimedData *)payload)->data;
+    // fall through
+  case IOCTL_CMD_INVOKE_API_AND_GET_DATA:
+    offset = data->mem_offset;
+    reply_size = data->buffer_size;
+    // the mosaic copies a canvas of another context, so only closing one
+    // is reserved to its owner
+    if (data->api_index == CODEC_DEINIT && !client_owns (client,
+        client->contexts, GINT_TO_POINTER (data->ctx_index))) {
+      errno = EPERM;
+      break;
+    }
+
+    stage (offset, buffer_size (client, offset), TRUE);
+    request_begin ();
+    ret = broker.ops->ioctl (client->fd, msg->request, payload);
+    err = errno;
+    request_end ();
+    errno = err;
+
+    if (ret == 0) {
+      // the header of a reply, and its data from OFFSET_PICTURE_BUFFER
+      stage (data->mem_offset, MAX (buffer_size (client, offset),
+        (uint32_t) MAX (reply_size, 0) + OFFSET_PICTURE_BUFFER), FALSE);
+    }
+    if (ret == 0 && (data->mem_offset != offset || reply_size > 0)) {
+      // the reply is held in place of the request, or in memory the
+      // device secured for it. either way the process releases it.
+      buffer_add (client, data->mem_offset, buffer_remove (client, offset));
+    }
+    if (data->api_index == CODEC_DEINIT) {
+      g_mutex_lock (&broker.lock);
+      g_hash_table_remove (client->contexts, GINT_TO_POINTER (data->ctx_index));
+      g_mutex_unlock (&broker.lock);
+    }
+    break;
+  case IOCTL_CMD_GET_CONTEXT_INDEX:
+    ret = broker.ops->ioctl (client->fd, msg->request, payload);
+    if (ret == 0) {
+      g_mutex_lock (&broker.lock);
+      g_hash_table_add (client->contexts, GINT_TO_POINTER (*(int32_t *)payload));
+      g_mutex_unlock (&broker.lock);
+    }
+    break;
+  case IOCTL_CMD_CANCEL_REQUESTS:
+    if (!client_owns (client, client->contexts,
+        GINT_TO_POINTER (data->ctx_index))) {
+      errno = EPERM;
+      break;
+    }
+    ret = broker.ops->ioctl (client->fd, msg->request, payload);
+    break;
+  case IOCTL_CMD_GET_CAPABILITIES:
+    ret = broker.ops->ioctl (client->fd, msg->request, payload);
+    if (ret == 0) {
+      // completions are signalled to the broker, not to the process
+      ((IOCTL_Capabilities *)payload)->flags &=
+        ~(CODEC_CAP_ASYNC | CODEC_CAP_RINGS);
+    }
+    break;
+  default:
+    ret = broker.ops->ioctl (client->fd, msg->request, payload);
+    break;
+  }
+
+  msg->ret = ret;
+  msg->err = ret < 0 ? errno : 0;
+  msg->size = ret < 0 ? 0 : out_size;
+}
+
+// the default socket goes into a directory of the broker that only its
+// owner and group can enter
+static gboolean
+prepare_socket_dir (const gchar *dir)
+{
+  struct stat st;
+
+  if (mkdir (dir, 0750) < 0 && errno != EEXIST) {
+    return FALSE;
+  }
+  if (lstat (dir, &st) < 0 || !S_ISDIR (st.st_mode) ||
+      st.st_uid != geteuid ()) {
+    errno = EPERM;
+    return FALSE;
+  }
+
+  return chmod (dir, 0750) == 0;
+}
+
+// processes of the user or group of the broker, and root
+static gboolean
+peer_allowed (struct ucred *cred)
+{
+  return cred->uid == 0 || cred->uid == geteuid () || cred->gid == getegid ();
+}
+
+static gpointer
+serve_connection (gpointer user_data)
+{
+  BrokerConnection *conn = user_data;
+  uint8_t *payload = g_malloc (CODEC_BROKER_MAX_PAYLOAD);
+  CodecBrokerMessage msg;
+  int pass_fd;
+
+  while (gst_maru_broker_recv (conn->sock, &msg, payload,
+      CODEC_BROKER_MAX_PAYLOAD, NULL) == 0) {
+    pass_fd = -1;
+    switch (msg.cmd) {
+    case CODEC_BROKER_MAP:
+      pass_fd = broker.mem_fd;
+      msg.ret = 0;
+      msg.err = 0;
+      msg.size = 0;
+      break;
+    case CODEC_BROKER_OPEN:
+    case CODEC_BROKER_ATTACH:
+      // once per connection
+      if (conn->client) {
+        msg.err = EINVAL;
+      } else if (msg.cmd == CODEC_BROKER_OPEN) {
+        conn->client = client_open (conn->pid);
+        msg.err = ENODEV;
+      } else if (msg.size == sizeof(uint32_t)) {
+        conn->client = client_attach (*(uint32_t *)payload, conn->pid);
+        msg.err = EPERM;
+      } else {
+        msg.err = EINVAL;
+      }
+      if (conn->client && msg.err != EINVAL) {
+        msg.ret = conn->client->id;
+        msg.err = 0;
+      } else {
+        msg.ret = -1;
+      }
+      msg.size = 0;
+      break;
+    case CODEC_BROKER_IOCTL:
+      if (!conn->client) {
+        msg.ret = -1;
+        msg.err = EBADF;
+        msg.size = 0;
+        break;
+      }
+      serve_ioctl (conn->client, &msg, payload);
+      break;
+    default:
+      msg.ret = -1;
+      msg.err = EINVAL;
+      msg.size = 0;
+      break;
+    }
+
+    if (gst_maru_broker_send (conn->sock, &msg, payload, pass_fd) < 0) {
+      break;
+    }
+  }
+
+  close (conn->sock);
+  if (conn->client) {
+    client_put (conn->client);
+  }
+  g_free (conn);
+  g_free (payload);
+
+  return NULL;
+}
+
+int
+main (int argc, char *argv[])
+{
+  gchar *path = NULL;
+  const gchar *socket_path;
+  gboolean loopback = FALSE;
+  gint max_requests = 4;
+  gint64 mem_budget = 0;
+  GOptionEntry entries[] = {
+    { "socket", 's', 0, G_OPTION_ARG_FILENAME, &path,
+      "Listen on PATH (" CODEC_BROKER_SOCKET ")", "PATH" },
+    { "requests", 'j', 0, G_OPTION_ARG_INT, &max_requests,
+      "Device requests in flight at most (4)", "N" },
+    { "memory", 'm', 0, G_OPTION_ARG_INT64, &mem_budget,
+      "Device memory a process may hold, 0 for no limit (0)", "BYTES" },
+    { "loopback", 'l', 0, G_OPTION_ARG_NONE, &loopback,
+      "Serve the loopback device", NULL },
+    { NULL }
+  };
+  GOptionContext *options;
+  GError *error = NULL;
+  IOCTL_Capabilities caps = { 0, };
+  struct sockaddr_un addr = { 0, };
+  int sock;
+
+  options = g_option_context_new ("- share the codec device of the emulator");
+  g_option_context_add_main_entries (options, entries, NULL);
+  g_option_context_add_group (options, gst_init_get_option_group ());
+  if (!g_option_context_parse (options, &argc, &argv, &error)) {
+    g_printerr ("%s\n", error->message);
+    return 1;
+  }
+  g_option_context_free (options);
+
+  GST_DEBUG_CATEGORY_INIT (maru_debug,
+      "tizen-emul", 0, "Tizen Emulator Codec Broker");
+
+  broker.ops = loopback ? device_ops_loopback : device_ops_kernel;
+  broker.max_requests = MAX (max_requests, 1);
+  broker.mem_budget = MAX (mem_budget, 0);
+  broker.clients = g_hash_table_new (g_direct_hash, g_direct_equal);
+  socket_path = path ? path : CODEC_BROKER_SOCKET;
+
+  broker.fd = broker.ops->open ();
+  if (broker.fd < 0) {
+    perror ("[gst-maru-broker] failed to open codec device");
+    return 1;
+  }
+
+  broker.mem_size = CODEC_DEVICE_MEM_SIZE;
+  if (broker.ops->ioctl (broker.fd,
+      IOCTL_CAPS(IOCTL_CMD_GET_CAPABILITIES), &caps) == 0 && caps.mem_size) {
+    broker.mem_size = caps.mem_size;
+  }
+
+  // keeps the memory mapped while no process is connected
+  broker.mem = broker.ops->mmap (broker.fd, broker.mem_size);
+  if (broker.mem == MAP_FAILED) {
+    perror ("[gst-maru-broker] memory mapping failure");
+    return 1;
+  }
+  if (loopback) {
+    broker.mem_fd = gst_maru_loopback_memory_fd ();
+  } else {
+    // the device fd would let a process issue any request of its own
+    broker.mem_fd = memfd_create ("maru-broker", MFD_CLOEXEC);
+    if (broker.mem_fd >= 0 && ftruncate (broker.mem_fd, broker.mem_size) == 0) {
+      broker.staging = mmap (NULL, broker.mem_size, PROT_READ | PROT_WRITE,
+        MAP_SHARED, broker.mem_fd, 0);
+    }
+    if (!broker.staging || broker.staging == MAP_FAILED) {
+      broker.staging = NULL;
+      close (broker.mem_fd);
+      broker.mem_fd = -1;
+    }
+  }
+  if (broker.mem_fd < 0) {
+    perror ("[gst-maru-broker] failed to share the memory");
+    return 1;
+  }
+
+  if (!path && !prepare_socket_dir (CODEC_BROKER_DIR)) {
+    perror ("[gst-maru-broker] failed to prepare " CODEC_BROKER_DIR);
+    return 1;
+  }
+
+  sock = socket (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  addr.sun_family = AF_UNIX;
+  g_strlcpy (addr.sun_path, socket_path, sizeof(addr.sun_path));
+  unlink (socket_path);
+  if (sock < 0 || bind (sock, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+      listen (sock, 16) < 0) {
+    perror ("[gst-maru-broker] failed to listen");
+    return 1;
+  }
+  chmod (socket_path, 0660);
+  signal (SIGPIPE, SIG_IGN);
+
+  GST_INFO ("listen on %s, %u requests at a time, %" G_GUINT64_FORMAT
+    " bytes per process", socket_path, broker.max_requests, broker.mem_budget);
+
+  for (;;) {
+    BrokerConnection *conn;
+    struct ucred cred = { 0, };
+    socklen_t len = sizeof(cred);
+    int conn_sock;
+
+    conn_sock = accept4 (sock, NULL, NULL, SOCK_CLOEXEC);
+    if (conn_sock < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) {
+        continue;
+      }
+      perror ("[gst-maru-broker] failed to accept");
+      break;
+    }
+
+    if (getsockopt (conn_sock, SOL_SOCKET, SO_PEERCRED, &cred, &len) < 0 ||
+        !peer_allowed (&cred)) {
+      GST_WARNING ("refused a connection of process %d", cred.pid);
+      close (conn_sock);
+      continue;
+    }
+
+    conn = g_new0 (BrokerConnection, 1);
+    conn->sock = conn_sock;
+    conn->pid = cred.pid;
+    g_thread_unref (g_thread_new ("broker-conn", serve_connection, conn));
+  }
+
+  return 1;
+}
@@ -28,33 +28,107 @@
  *
  */
 
+#include <errno.h>
 #include <fcntl.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <sys/eventfd.h>
 #include <sys/ioctl.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 
 #include "gstmaruinterface.h"
 #include "gstmarudevice.h"
+#include "gstmarutrace.h"
+#include "gstmaruexecutor.h"
 
 static GMutex gst_avcodec_mutex;
 
-#define CODEC_DEVICE_MEM_SIZE 32 * 1024 * 1024
-
 gpointer device_mem = MAP_FAILED;
 int device_fd = -1;
 int opened_cnt = 0;
 
+static int
+kernel_open (void)
+{
+  return open (CODEC_DEV, O_RDWR);
+}
+
+static gpointer
+kernel_mmap (int fd, size_t size)
+{
+  return mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+}
+
+static int
+kernel_ioctl (int fd, unsigned long request, void *data)
+{
+  return ioctl (fd, request, data);
+}
+
+static CodecDeviceOps *device_ops_kernel = &(CodecDeviceOps) {
+  .open = kernel_open,
+  .close = close,
+  .ioctl = kernel_ioctl,
+  .mmap = kernel_mmap,
+  .munmap = munmap,
+};
+
+CodecDeviceOps *device_ops = NULL;
+
+// open one fd per context instead of sharing device_fd, so that the
+// driver does not serialize the requests of different contexts.
+// device memory is still mapped once through device_fd.
+static gboolean fd_per_context = FALSE;
+
+// wait for short requests by spinning on the completion ring
+static gboolean hybrid_wait = FALSE;
+
+// submit requests asynchronously and sleep until the completion thread
+// reaps their replies
+static gboolean async_wait = FALSE;
+
+static void completion_watch (int fd);
+static void completion_unwatch (int fd);
+
+void
+gst_maru_codec_device_select (void)
+{
+  const gchar *name = g_getenv ("GST_MARU_CODEC_DEVICE");
+  const gchar *fd_mode = g_getenv ("GST_MARU_CODEC_FD");
+  const gchar *wait_mode = g_getenv ("GST_MARU_CODEC_WAIT");
+
+  if (name && !strcmp (name, "loopback")) {
+    GST_INFO ("use loopback codec device");
+    device_ops = device_ops_loopback;
+  } else if (name && !strcmp (name, "broker")) {
+    GST_INFO ("use codec device through the broker");
+    device_ops = device_ops_broker;
+  } else {
+    device_ops = device_ops_kernel;
+  }
+
+  fd_per_context = fd_mode && !strcmp (fd_mode, "context");
+  GST_INFO ("%s device fd", fd_per_context ? "per context" : "shared");
+
+  hybrid_wait = wait_mode && !strcmp (wait_mode, "hybrid");
+  async_wait = wait_mode && !strcmp (wait_mode, "async");
+  GST_INFO ("%s wait for requests",
+    hybrid_wait ? "hybrid" : async_wait ? "async" : "blocking");
+
+  gst_maru_trace_init ();
+  gst_maru_executor_init ();
+}
+
 int
 gst_maru_codec_device_open (CodecDevice *dev, int media_type)
 {
   g_mutex_lock (&gst_avcodec_mutex);
   if (device_fd == -1) {
-    if ((device_fd = open(CODEC_DEV, O_RDWR)) < 0) {
+    if ((device_fd = device_ops->open ()) < 0) {
       GST_ERROR ("failed to open codec device.");
       g_mutex_unlock (&gst_avcodec_mutex);
       return -1;
@@ -67,27 +141,48 @@ gst_maru_codec_device_open (CodecDevice *dev, int media_type)
   // g_mutex_unlock (&gst_avcodec_mutex);
 
   // FIXME
-  dev->buf_size = CODEC_DEVICE_MEM_SIZE;
+  dev->buf_size = device_caps.mem_size;
   GST_DEBUG ("mmap_size: %d", dev->buf_size);
 
   // g_mutex_lock (&gst_avcodec_mutex);
   if (device_mem == MAP_FAILED) {
-    device_mem =
-      mmap (NULL, CODEC_DEVICE_MEM_SIZE, PROT_READ | PROT_WRITE,
-          MAP_SHARED, device_fd, 0);
+    device_mem = device_ops->mmap (device_fd, device_caps.mem_size);
     if (device_mem == MAP_FAILED) {
       GST_ERROR ("failed to map device memory of codec");
-      close (device_fd);
+      device_ops->close (device_fd);
       dev->fd = device_fd = -1;
       g_mutex_unlock (&gst_avcodec_mutex);
       return -1;
     }
     GST_INFO ("succeeded to map device memory: %p", device_mem);
+
+    // the rings keep a slot of device memory for good, and only the
+    // hybrid wait uses them.
+    if (hybrid_wait && interface->setup_rings) {
+      interface->setup_rings (dev);
+    }
+    if (async_wait) {
+      completion_watch (device_fd);
+    }
   } else {
     GST_DEBUG ("mapping device memory is already done");
   }
   dev->buf = device_mem;
 
+  if (fd_per_context) {
+    int fd = device_ops->open ();
+
+    if (fd < 0) {
+      GST_WARNING ("failed to open a fd for the context, share %d", device_fd);
+    } else {
+      GST_DEBUG ("context fd: %d", fd);
+      dev->fd = fd;
+      if (async_wait) {
+        completion_watch (fd);
+      }
+    }
+  }
+
   opened_cnt++;
   GST_DEBUG ("open count: %d", opened_cnt);
   g_mutex_unlock (&gst_avcodec_mutex);
@@ -107,21 +202,35 @@ gst_maru_codec_device_close (CodecDevice *dev)
   }
 
   g_mutex_lock (&gst_avcodec_mutex);
+  if (fd != device_fd) {
+    GST_DEBUG ("close context fd: %d", fd);
+    completion_unwatch (fd);
+    if (device_ops->close (fd) != 0) {
+      GST_ERROR ("failed to close %s fd: %d", CODEC_DEV, fd);
+    }
+    dev->fd = -1;
+  }
+
   if (opened_cnt > 0) {
     opened_cnt--;
   }
   GST_DEBUG ("open count: %d", opened_cnt);
 
   if (opened_cnt == 0) {
+    if (interface->release_rings) {
+      interface->release_rings (dev);
+    }
+
     GST_INFO ("release device memory %p", device_mem);
-    if (munmap(device_mem, CODEC_DEVICE_MEM_SIZE) != 0) {
+    if (device_ops->munmap (device_mem, device_caps.mem_size) != 0) {
       GST_ERROR ("failed to release device memory of %s", CODEC_DEV);
     }
     device_mem = MAP_FAILED;
 
     GST_INFO ("close %s", CODEC_DEV);
-    if (close(fd) != 0) {
-      GST_ERROR ("failed to close %s fd: %d", CODEC_DEV, fd);
+    completion_unwatch (device_fd);
+    if (device_ops->close (device_fd) != 0) {
+      GST_ERROR ("failed to close %s fd: %d", CODEC_DEV, device_fd);
     }
     dev->fd = device_fd = -1;
   }
@@ -143,6 +252,10 @@ gst_maru_avcodec_open (CodecContext *ctx,
     return -1;
   }
 
+  memset (&ctx->wait, 0, sizeof(ctx->wait));
+  ctx->wait.hybrid = hybrid_wait;
+  ctx->wait.async = async_wait && interface->submit_request;
+
   g_mutex_lock (&gst_avcodec_mutex);
   ret = interface->init (ctx, codec, dev);
   g_mutex_unlock (&gst_avcodec_mutex);
@@ -166,6 +279,15 @@ gst_maru_avcodec_close (CodecContext *ctx, CodecDevice *dev)
   }
 
   GST_DEBUG ("close %d of context", ctx->index);
+  if (ctx->wait.mem_waits) {
+    GST_INFO ("context %d: waited %u times for device memory, %lld us",
+      ctx->index, ctx->wait.mem_waits, (long long) ctx->wait.mem_wait_time);
+  }
+  if (ctx->wait.hybrid) {
+    GST_INFO ("context %d: %u replies while spinning, %u blocked, "
+      "latency %lld us", ctx->index, ctx->wait.spin_hits,
+      ctx->wait.spin_misses, (long long) ctx->wait.latency);
+  }
 
   g_mutex_lock (&gst_avcodec_mutex);
   interface->deinit (ctx, dev);
@@ -175,3 +297,274 @@ gst_maru_avcodec_close (CodecContext *ctx, CodecDevice *dev)
 
   return ret;
 }
+
+/*
+ * completions of requests submitted with interface->submit_request are
+ * signalled on an eventfd registered with the device. this source reaps
+ * them from a main context, so one thread can keep many contexts busy.
+ */
+typedef struct {
+  GSource source;
+  GPollFD pollfd;
+  CodecDevice dev;
+} CompletionSource;
+
+static gboolean
+completion_source_prepare (GSource *source, gint *timeout)
+{
+  *timeout = -1;
+  return FALSE;
+}
+
+static gboolean
+completion_source_check (GSource *source)
+{
+  CompletionSource *csource = (CompletionSource *) source;
+
+  return (csource->pollfd.revents & G_IO_IN) != 0;
+}
+
+static gboolean
+completion_source_dispatch (GSource *source, GSourceFunc callback,
+    gpointer user_data)
+{
+  CompletionSource *csource = (CompletionSource *) source;
+  CodecCompletionFunc func = (CodecCompletionFunc) callback;
+  CodecCompletion completion;
+  uint64_t count;
+  int ret;
+
+  // reset the counter before reaping, a completion queued in between
+  // makes the eventfd readable again.
+  if (read (csource->pollfd.fd, &count, sizeof (count)) < 0
+      && errno != EAGAIN) {
+    GST_ERROR ("failed to read eventfd %d", csource->pollfd.fd);
+    return G_SOURCE_REMOVE;
+  }
+
+  while ((ret = interface->reap_completion (&csource->dev, &completion)) > 0) {
+    if (func) {
+      func (&completion, user_data);
+    }
+  }
+
+  if (ret < 0) {
+    GST_ERROR ("failed to reap completions of %d", csource->dev.fd);
+    return G_SOURCE_REMOVE;
+  }
+
+  return G_SOURCE_CONTINUE;
+}
+
+static void
+completion_source_finalize (GSource *source)
+{
+  CompletionSource *csource = (CompletionSource *) source;
+
+  interface->register_completion_fd (&csource->dev, -1);
+  close (csource->pollfd.fd);
+}
+
+static GSourceFuncs completion_source_funcs = {
+  completion_source_prepare,
+  completion_source_check,
+  completion_source_dispatch,
+  completion_source_finalize,
+};
+
+GSource *
+gst_maru_codec_device_completion_source_new (CodecDevice *dev,
+    CodecCompletionFunc func, gpointer user_data)
+{
+  GSource *source;
+  CompletionSource *csource;
+  int event_fd;
+
+  if (!interface->register_completion_fd || !interface->submit_request
+      || !interface->reap_completion) {
+    GST_WARNING ("device does not complete requests asynchronously");
+    return NULL;
+  }
+
+  event_fd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (event_fd < 0) {
+    GST_ERROR ("failed to create eventfd");
+    return NULL;
+  }
+
+  if (interface->register_completion_fd (dev, event_fd) < 0) {
+    close (event_fd);
+    return NULL;
+  }
+
+  source = g_source_new (&completion_source_funcs, sizeof (CompletionSource));
+  csource = (CompletionSource *) source;
+  csource->dev = *dev;
+  csource->pollfd.fd = event_fd;
+  csource->pollfd.events = G_IO_IN | G_IO_ERR;
+  g_source_add_poll (source, &csource->pollfd);
+  g_source_set_callback (source, (GSourceFunc) func, user_data, NULL);
+
+  return source;
+}
+
+/*
+ * GST_MARU_CODEC_WAIT=async
+ *
+ * every open fd gets a completion source on the context of one thread.
+ * a request is submitted by its own thread, which then sleeps until the
+ * completion thread hands it the reply. replies are matched by the tag
+ * in api_index, those that arrive before their waiter are kept for it.
+ */
+typedef struct {
+  CodecCompletion completion;
+  gboolean done;
+  GCond cond;
+} CompletionWaiter;
+
+static struct {
+  GMutex lock;
+  GMainContext *context;
+  GThread *thread;
+  GHashTable *sources;  // fd -> GSource
+  GHashTable *waiters;  // api_index -> CompletionWaiter
+  GHashTable *early;    // api_index -> CodecCompletion
+} completions;
+
+static void
+complete_request (CodecCompletion *completion, gpointer user_data)
+{
+  gpointer key = GUINT_TO_POINTER (completion->api_index);
+  CompletionWaiter *waiter;
+
+  g_mutex_lock (&completions.lock);
+  waiter = g_hash_table_lookup (completions.waiters, key);
+  if (waiter) {
+    g_hash_table_remove (completions.waiters, key);
+    waiter->completion = *completion;
+    waiter->done = TRUE;
+    g_cond_signal (&waiter->cond);
+  } else {
+    g_hash_table_insert (completions.early, key,
+      g_memdup (completion, sizeof (*completion)));
+  }
+  g_mutex_unlock (&completions.lock);
+}
+
+static gpointer
+completion_thread (gpointer data)
+{
+  GMainLoop *loop = g_main_loop_new (completions.context, FALSE);
+
+  g_main_context_push_thread_default (completions.context);
+  g_main_loop_run (loop);
+
+  return NULL;
+}
+
+// called with gst_avcodec_mutex
+static void
+completion_watch (int fd)
+{
+  CodecDevice dev = { fd, device_mem, device_caps.mem_size };
+  GSource *source;
+
+  if (!completions.context) {
+    completions.context = g_main_context_new ();
+    completions.sources = g_hash_table_new (g_direct_hash, g_direct_equal);
+    completions.waiters = g_hash_table_new (g_direct_hash, g_direct_equal);
+    completions.early =
+      g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, g_free);
+    completions.thread =
+      g_thread_new ("maru-completion", completion_thread, NULL);
+  }
+
+  source = gst_maru_codec_device_completion_source_new (&dev,
+    complete_request, NULL);
+  if (!source) {
+    GST_WARNING ("no completions of %d, its requests block", fd);
+    return;
+  }
+  g_source_attach (source, completions.context);
+  g_hash_table_insert (completions.sources, GINT_TO_POINTER (fd), source);
+}
+
+typedef struct {
+  GSource *source;
+  gboolean done;
+  GCond cond;
+} CompletionUnwatch;
+
+static gboolean
+completion_unwatch_func (gpointer data)
+{
+  CompletionUnwatch *unwatch = data;
+
+  g_source_destroy (unwatch->source);
+
+  g_mutex_lock (&completions.lock);
+  unwatch->done = TRUE;
+  g_cond_signal (&unwatch->cond);
+  g_mutex_unlock (&completions.lock);
+
+  return G_SOURCE_REMOVE;
+}
+
+// the source is destroyed on the completion thread, so it is not reaping
+// the fd once this returns. called with gst_avcodec_mutex.
+static void
+completion_unwatch (int fd)
+{
+  CompletionUnwatch unwatch = { 0, };
+
+  if (!completions.sources) {
+    return;
+  }
+  unwatch.source =
+    g_hash_table_lookup (completions.sources, GINT_TO_POINTER (fd));
+  if (!unwatch.source) {
+    return;
+  }
+  g_hash_table_remove (completions.sources, GINT_TO_POINTER (fd));
+
+  g_cond_init (&unwatch.cond);
+  g_main_context_invoke (completions.context, completion_unwatch_func,
+    &unwatch);
+  g_mutex_lock (&completions.lock);
+  while (!unwatch.done) {
+    g_cond_wait (&unwatch.cond, &completions.lock);
+  }
+  g_mutex_unlock (&completions.lock);
+  g_cond_clear (&unwatch.cond);
+
+  // unregisters and closes the eventfd
+  g_source_unref (unwatch.source);
+}
+
+void
+gst_maru_codec_device_wait_completion (uint32_t api_index,
+    CodecCompletion *completion)
+{
+  gpointer key = GUINT_TO_POINTER (api_index);
+  CompletionWaiter waiter = { { 0, }, };
+  CodecCompletion *early;
+
+  g_mutex_lock (&completions.lock);
+  early = g_hash_table_lookup (completions.early, key);
+  if (early) {
+    *completion = *early;
+    g_hash_table_remove (completions.early, key);
+    g_mutex_unlock (&completions.lock);
+    return;
+  }
+
+  g_cond_init (&waiter.cond);
+  g_hash_table_insert (completions.waiters, key, &waiter);
+  while (!waiter.done) {
+    g_cond_wait (&waiter.cond, &completions.lock);
+  }
+  g_mutex_unlock (&completions.lock);
+  g_cond_clear (&waiter.cond);
+
+  *completion = waiter.completion;
+}
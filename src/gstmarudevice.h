@@ -32,10 +32,59 @@
 #define __GST_MARU_DEVICE_H__
 
 #include "gstmaru.h"
+#include "gstmaruinterface.h"
+
+/* size of the device memory unless the host reports another one */
+#define CODEC_DEVICE_MEM_SIZE (32 * 1024 * 1024)
 
 extern int device_fd;
 extern gpointer device_mem;
 
+/* how the codec device is reached. the kernel driver is used unless
+ * GST_MARU_CODEC_DEVICE=loopback selects the in-process stand-in, which
+ * answers every request with a null codec, or GST_MARU_CODEC_DEVICE=broker
+ * selects gst-maru-codec-broker, which owns the device for all processes. GST_MARU_CODEC_FD=context
+ * gives every context a fd of its own next to the shared device_fd.
+ * GST_MARU_CODEC_WAIT=hybrid spins for replies before blocking, and
+ * GST_MARU_CODEC_WAIT=async submits the requests and sleeps until one
+ * thread reaps the completions of all contexts.
+ * GST_MARU_TRACE=file records the requests for gst-maru-codec-replay.
+ * GST_MARU_CODEC_WORKERS=n runs the requests of all elements on n shared
+ * workers. */
+typedef struct {
+  int
+  (*open) (void);
+  int
+  (*close) (int fd);
+  int
+  (*ioctl) (int fd, unsigned long request, void *data);
+  gpointer
+  (*mmap) (int fd, size_t size);
+  int
+  (*munmap) (gpointer mem, size_t size);
+} CodecDeviceOps;
+
+extern CodecDeviceOps *device_ops;
+extern CodecDeviceOps *device_ops_loopback;
+extern CodecDeviceOps *device_ops_broker;
+
+/* a new fd that maps the memory of the loopback device, -1 while it is
+ * not mapped */
+int gst_maru_loopback_memory_fd (void);
+
+void gst_maru_codec_device_select (void);
+
+typedef void (*CodecCompletionFunc) (CodecCompletion *completion,
+                                    gpointer user_data);
+
+GSource *gst_maru_codec_device_completion_source_new (CodecDevice *dev,
+                          CodecCompletionFunc func, gpointer user_data);
+
+/* blocks until the completion of the request submitted with api_index is
+ * reaped, only with GST_MARU_CODEC_WAIT=async */
+void gst_maru_codec_device_wait_completion (uint32_t api_index,
+                          CodecCompletion *completion);
+
 int gst_maru_codec_device_open (CodecDevice *dev, int media_type);
 int gst_maru_codec_device_close (CodecDevice *dev);
 
@@ -0,0 +1,263 @@
+/*
+ * Gstreamer codec plugin for Tizen Emulator.
+ *
+ * Copyright (C) 2013 Samsung Electronics Co., Ltd. All rights reserved.
+ *
+ * Contact:
+ * KiTae Kim <kt920.kim@samsung.com>
+ * SeokYeon Hwang <syeon.hwang@samsung.com>
+ * YeongKyoon Lee <yeongkyoon.lee@samsung.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Contributors:
+ * - S-Core Co., Ltd
+ *
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+
+#include "gstmaru.h"
+#include "gstmaruexecutor.h"
+
+#define MAX_WORKERS         64
+#define PRIORITY_YIELD_MS   20
+
+// index of the deque or the counter of a priority, realtime first
+#define PRIORITY_LEVEL(ctx) \
+  (CLAMP ((ctx)->priority, CODEC_PRIORITY_REALTIME, CODEC_PRIORITY_BACKGROUND) \
+   - CODEC_PRIORITY_REALTIME)
+#define NORMAL_LEVEL        (CODEC_PRIORITY_NORMAL - CODEC_PRIORITY_REALTIME)
+
+typedef struct {
+  CodecExecutorFunc func;
+  gpointer data;
+  CodecContext *ctx;
+  gint cancel_gen;
+
+  int ret;
+  int err;
+  // only the caller of the job waits for it
+  GCond done_cond;
+  gboolean done;
+} ExecutorJob;
+
+gboolean codec_executing = FALSE;
+
+static struct {
+  GMutex lock;
+  GCond work;
+  // a request of the calling threads finished
+  GCond done;
+  guint n_workers;
+  GQueue deques[MAX_WORKERS][CODEC_PRIORITY_LEVELS];
+
+  // requests in flight on the calling threads, per priority. changed
+  // without the lock, so that normal requests take it only to wake
+  // others.
+  gint in_flight[CODEC_PRIORITY_LEVELS];
+  // requests waiting for those of a higher priority
+  gint yielding;
+  // requests of a priority other than normal, waiting or in flight. while
+  // there are none, normal requests do not wait for their turn.
+  gint prioritized;
+} executor;
+
+// called with executor.lock held
+static ExecutorJob *
+executor_take (guint worker)
+{
+  ExecutorJob *job;
+  guint i, victim, level;
+
+  for (level = 0; level < CODEC_PRIORITY_LEVELS; level++) {
+    job = g_queue_pop_head (&executor.deques[worker][level]);
+    if (job) {
+      return job;
+    }
+
+    for (i = 1; i < executor.n_workers; i++) {
+      victim = (worker + i) % executor.n_workers;
+      job = g_queue_pop_tail (&executor.deques[victim][level]);
+      if (job) {
+        GST_LOG ("worker %u took a request of context %d from worker %u",
+            worker, job->ctx->index, victim);
+        return job;
+      }
+    }
+  }
+
+  return NULL;
+}
+
+static void
+executor_call (ExecutorJob *job)
+{
+  if (g_atomic_int_get (&job->ctx->wait.cancel_gen) != job->cancel_gen) {
+    // cancelled while it waited for its turn
+    job->ret = -1;
+    job->err = ECANCELED;
+  } else {
+    errno = 0;
+    job->ret = job->func (job->data);
+    job->err = errno;
+  }
+}
+
+static gpointer
+executor_worker (gpointer data)
+{
+  guint worker = GPOINTER_TO_UINT (data);
+  ExecutorJob *job;
+
+  g_mutex_lock (&executor.lock);
+  for (;;) {
+    job = executor_take (worker);
+    if (!job) {
+      g_cond_wait (&executor.work, &executor.lock);
+      continue;
+    }
+    g_mutex_unlock (&executor.lock);
+
+    executor_call (job);
+
+    g_mutex_lock (&executor.lock);
+    job->done = TRUE;
+    g_cond_signal (&job->done_cond);
+  }
+
+  return NULL;
+}
+
+void
+gst_maru_executor_init (void)
+{
+  const gchar *workers = g_getenv ("GST_MARU_CODEC_WORKERS");
+  gchar *name;
+  guint i, level;
+
+  if (!workers || codec_executing) {
+    return;
+  }
+
+  executor.n_workers = CLAMP (atoi (workers), 0, MAX_WORKERS);
+  if (executor.n_workers == 0) {
+    return;
+  }
+
+  for (i = 0; i < executor.n_workers; i++) {
+    for (level = 0; level < CODEC_PRIORITY_LEVELS; level++) {
+      g_queue_init (&executor.deques[i][level]);
+    }
+  }
+  for (i = 0; i < executor.n_workers; i++) {
+    name = g_strdup_printf ("maru-worker-%u", i);
+    g_thread_unref (g_thread_new (name, executor_worker, GUINT_TO_POINTER (i)));
+    g_free (name);
+  }
+  codec_executing = TRUE;
+
+  GST_INFO ("run device requests on %u workers", executor.n_workers);
+}
+
+// called with executor.lock held
+static gboolean
+executor_higher_in_flight (guint level)
+{
+  guint i;
+
+  for (i = 0; i < level; i++) {
+    if (g_atomic_int_get (&executor.in_flight[i]) > 0) {
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+static void
+executor_finished (guint level)
+{
+  g_atomic_int_add (&executor.in_flight[level], -1);
+  if (g_atomic_int_get (&executor.yielding) > 0) {
+    g_mutex_lock (&executor.lock);
+    g_cond_broadcast (&executor.done);
+    g_mutex_unlock (&executor.lock);
+  }
+}
+
+int
+gst_maru_executor_run (CodecContext *ctx, CodecExecutorFunc func,
+                          gpointer data)
+{
+  ExecutorJob job = { func, data, ctx, 0, };
+  guint level = PRIORITY_LEVEL (ctx);
+  gint64 deadline;
+
+  job.cancel_gen = g_atomic_int_get (&ctx->wait.cancel_gen);
+
+  if (!codec_executing && level == NORMAL_LEVEL &&
+      !g_atomic_int_get (&executor.prioritized)) {
+    // still counted, a background request that comes meanwhile waits
+    g_atomic_int_inc (&executor.in_flight[NORMAL_LEVEL]);
+    executor_call (&job);
+    executor_finished (NORMAL_LEVEL);
+    errno = job.err;
+    return job.ret;
+  }
+
+  if (!codec_executing && level != NORMAL_LEVEL) {
+    g_atomic_int_inc (&executor.prioritized);
+  }
+
+  g_mutex_lock (&executor.lock);
+  if (codec_executing) {
+    g_cond_init (&job.done_cond);
+    g_queue_push_tail (&executor.deques[(guint) ctx->index % executor.n_workers][level],
+        &job);
+    g_cond_signal (&executor.work);
+    while (!job.done) {
+      g_cond_wait (&job.done_cond, &executor.lock);
+    }
+    g_mutex_unlock (&executor.lock);
+    g_cond_clear (&job.done_cond);
+  } else {
+    // let the requests of a higher priority through first, but not
+    // for so long that this one starves
+    deadline = g_get_monotonic_time () + PRIORITY_YIELD_MS * G_TIME_SPAN_MILLISECOND;
+    g_atomic_int_inc (&executor.yielding);
+    while (executor_higher_in_flight (level)) {
+      if (!g_cond_wait_until (&executor.done, &executor.lock, deadline)) {
+        break;
+      }
+    }
+    g_atomic_int_add (&executor.yielding, -1);
+    g_atomic_int_inc (&executor.in_flight[level]);
+    g_mutex_unlock (&executor.lock);
+
+    executor_call (&job);
+
+    executor_finished (level);
+  }
+
+  if (!codec_executing && level != NORMAL_LEVEL) {
+    g_atomic_int_add (&executor.prioritized, -1);
+  }
+
+  errno = job.err;
+  return job.ret;
+}
@@ -0,0 +1,64 @@
+/*
+ * Gstreamer codec plugin for Tizen Emulator.
+ *
+ * Copyright (C) 2013 Samsung Electronics Co., Ltd. All rights reserved.
+ *
+ * Contact:
+ * KiTae Kim <kt920.kim@samsung.com>
+ * SeokYeon Hwang <syeon.hwang@samsung.com>
+ * YeongKyoon Lee <yeongkyoon.lee@samsung.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Contributors:
+ * - S-Core Co., Ltd
+ *
+ */
+
+#ifndef __GST_MARU_EXECUTOR_H__
+#define __GST_MARU_EXECUTOR_H__
+
+#include "gstmaru.h"
+
+/*
+ * process-wide executor of device requests, started when
+ * GST_MARU_CODEC_WORKERS gives a number of worker threads. the requests
+ * of every element are run by these workers, so the requests in flight
+ * stay bounded however many streams are running.
+ *
+ * each worker has a deque per priority. a request goes to the back of the
+ * deque of the worker its context belongs to, and a worker with nothing
+ * to do steals from the back of the others. a worker takes any request
+ * of a higher priority before its own.
+ *
+ * without workers the requests run on the calling threads, and a request
+ * waits up to PRIORITY_YIELD_MS while requests of a higher priority are
+ * in flight. as long as no request of another priority than normal is
+ * around, normal requests run straight away and only count themselves,
+ * so that a background request still waits for them.
+ */
+typedef int (*CodecExecutorFunc) (gpointer data);
+
+extern gboolean codec_executing;
+
+void gst_maru_executor_init (void);
+
+/* runs func for a request of ctx and waits for it, on a worker if there
+ * are any. errno is the one of func. */
+int gst_maru_executor_run (CodecContext *ctx, CodecExecutorFunc func,
+                          gpointer data);
+
+#endif
@@ -0,0 +1,186 @@
+/*
+ * Gstreamer codec plugin for Tizen Emulator.
+ *
+ * Copyright (C) 2013 Samsung Electronics Co., Ltd. All rights reserved.
+ *
+ * Contact:
+ * KiTae Kim <kt920.kim@samsung.com>
+ * SeokYeon Hwang <syeon.hwang@samsung.com>
+ * YeongKyoon Lee <yeongkyoon.lee@samsung.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Contributors:
+ * - S-Core Co., Ltd
+ *
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "gstmarufdmem.h"
+#include <gst/allocators/gstdmabuf.h>
+
+#define UDMABUF_DEVICE "/dev/udmabuf"
+
+// linux/udmabuf.h, not in the kernel headers of every target
+#ifndef UDMABUF_CREATE
+struct udmabuf_create {
+  uint32_t memfd;
+  uint32_t flags;
+  uint64_t offset;
+  uint64_t size;
+};
+
+#define UDMABUF_FLAGS_CLOEXEC   0x01
+#define UDMABUF_CREATE          _IOW('u', 0x42, struct udmabuf_create)
+#endif
+
+typedef struct
+{
+  GstFdAllocator parent;
+
+  int udmabuf_fd;
+  GstAllocator *dmabuf_allocator;
+} GstMaruFdAllocator;
+
+typedef struct
+{
+  GstFdAllocatorClass parent_class;
+} GstMaruFdAllocatorClass;
+
+G_DEFINE_TYPE (GstMaruFdAllocator, gst_maru_fd_allocator, GST_TYPE_FD_ALLOCATOR);
+
+/* a dmabuf over the memfd, -1 if udmabuf refuses it */
+static int
+gst_maru_fd_allocator_export (GstMaruFdAllocator *self, int memfd, gsize size)
+{
+  struct udmabuf_create create = {
+    .memfd = memfd,
+    .flags = UDMABUF_FLAGS_CLOEXEC,
+    .offset = 0,
+    .size = size,
+  };
+
+  // udmabuf wants the size of the memfd to stay
+  if (fcntl (memfd, F_ADD_SEALS, F_SEAL_SHRINK) < 0) {
+    return -1;
+  }
+
+  return ioctl (self->udmabuf_fd, UDMABUF_CREATE, &create);
+}
+
+static GstMemory *
+gst_maru_fd_allocator_alloc (GstAllocator *allocator, gsize size,
+    GstAllocationParams *params)
+{
+  GstMaruFdAllocator *self = (GstMaruFdAllocator *) allocator;
+  GstMemory *mem;
+  gsize maxsize;
+  int memfd, dmabuf_fd = -1;
+
+  maxsize = size + params->prefix + params->padding;
+  if (self->udmabuf_fd >= 0) {
+    // udmabuf takes whole pages only
+    maxsize = GST_ROUND_UP_N (maxsize, getpagesize ());
+  }
+
+  memfd = memfd_create ("maru-frame", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (memfd < 0) {
+    GST_ERROR ("failed to create a memfd, %s", g_strerror (errno));
+    return NULL;
+  }
+  if (ftruncate (memfd, maxsize) < 0) {
+    GST_ERROR ("failed to size a memfd to %" G_GSIZE_FORMAT ", %s",
+        maxsize, g_strerror (errno));
+    close (memfd);
+    return NULL;
+  }
+
+  if (self->udmabuf_fd >= 0) {
+    dmabuf_fd = gst_maru_fd_allocator_export (self, memfd, maxsize);
+    if (dmabuf_fd < 0) {
+      GST_WARNING ("udmabuf refused a memfd, %s. exporting memfds",
+          g_strerror (errno));
+      close (self->udmabuf_fd);
+      self->udmabuf_fd = -1;
+    }
+  }
+
+  if (dmabuf_fd >= 0) {
+    // the dmabuf keeps the pages of the memfd
+    close (memfd);
+    mem = gst_dmabuf_allocator_alloc (self->dmabuf_allocator, dmabuf_fd,
+        maxsize);
+  } else {
+    mem = gst_fd_allocator_alloc (allocator, memfd, maxsize,
+        GST_FD_MEMORY_FLAG_NONE);
+  }
+
+  if (mem && (params->prefix || params->padding)) {
+    gst_memory_resize (mem, params->prefix, size);
+  }
+
+  return mem;
+}
+
+static void
+gst_maru_fd_allocator_finalize (GObject *object)
+{
+  GstMaruFdAllocator *self = (GstMaruFdAllocator *) object;
+
+  if (self->udmabuf_fd >= 0) {
+    close (self->udmabuf_fd);
+  }
+  gst_object_unref (self->dmabuf_allocator);
+
+  G_OBJECT_CLASS (gst_maru_fd_allocator_parent_class)->finalize (object);
+}
+
+static void
+gst_maru_fd_allocator_class_init (GstMaruFdAllocatorClass *klass)
+{
+  GObjectClass *gobject_class = (GObjectClass *) klass;
+  GstAllocatorClass *allocator_class = (GstAllocatorClass *) klass;
+
+  gobject_class->finalize = gst_maru_fd_allocator_finalize;
+  allocator_class->alloc = gst_maru_fd_allocator_alloc;
+}
+
+static void
+gst_maru_fd_allocator_init (GstMaruFdAllocator *self)
+{
+  self->udmabuf_fd = open (UDMABUF_DEVICE, O_RDWR | O_CLOEXEC);
+  if (self->udmabuf_fd < 0) {
+    GST_DEBUG ("no %s, exporting memfds", UDMABUF_DEVICE);
+  }
+  self->dmabuf_allocator = gst_dmabuf_allocator_new ();
+}
+
+GstAllocator *
+gst_maru_fd_allocator_new (void)
+{
+  GstAllocator *allocator;
+
+  allocator = g_object_new (gst_maru_fd_allocator_get_type (), NULL);
+  gst_object_ref_sink (allocator);
+
+  return allocator;
+}
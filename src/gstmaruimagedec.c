@@ -0,0 +1,565 @@
+/* GStreamer
+ * Copyright (C) <1999> Erik Walthinsen <omega@cse.ogi.edu>
+ * Copyright (C) 2013 Samsung Electronics Co., Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "gstmarudevice.h"
+#include "gstmaruutils.h"
+#include "gstmaruinterface.h"
+
+/* maru_imagedec decodes independent JPEG images, several of them in one
+ * device request on a single context, e.g. for thumbnails. the size of
+ * an image is read from its frame header, so the host can scale it down
+ * to max-width x max-height while decoding.
+ */
+
+enum
+{
+  ARG_0,
+  ARG_BATCH_SIZE,
+  ARG_MAX_WIDTH,
+  ARG_MAX_HEIGHT,
+  ARG_PRIORITY
+};
+
+typedef struct {
+  GstVideoCodecFrame *frame;
+  gint width, height;
+} ImageJob;
+
+typedef struct _GstMaruImageDec
+{
+  GstVideoDecoder parent;
+
+  GstVideoCodecState *input_state;
+
+  CodecContext *context;
+  CodecDevice *dev;
+  gboolean opened;
+
+  /* images waiting for a batched decode */
+  GQueue *jobs;
+  gint out_width, out_height;
+
+  /* properties */
+  guint batch_size;
+  gint max_width, max_height;
+} GstMaruImageDec;
+
+typedef struct _GstMaruImageDecClass
+{
+  GstVideoDecoderClass parent_class;
+} GstMaruImageDecClass;
+
+#define DEFAULT_BATCH_SIZE      8
+#define DEFAULT_PRIORITY        CODEC_PRIORITY_NORMAL
+
+G_DEFINE_TYPE (GstMaruImageDec, gst_maruimagedec, GST_TYPE_VIDEO_DECODER);
+
+/* the jpeg decoder of the host */
+static CodecElement *image_codec = NULL;
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("image/jpeg"));
+
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS (GST_VIDEO_CAPS_MAKE ("I420")));
+
+static void gst_maruimagedec_finalize (GObject *object);
+static void gst_maruimagedec_set_property (GObject * object,
+    guint prop_id, const GValue * value, GParamSpec * pspec);
+static void gst_maruimagedec_get_property (GObject * object,
+    guint prop_id, GValue * value, GParamSpec * pspec);
+static gboolean gst_maruimagedec_stop (GstVideoDecoder * decoder);
+static gboolean gst_maruimagedec_set_format (GstVideoDecoder * decoder,
+    GstVideoCodecState * state);
+static GstFlowReturn gst_maruimagedec_handle_frame (GstVideoDecoder * decoder,
+    GstVideoCodecFrame * frame);
+static GstFlowReturn gst_maruimagedec_finish (GstVideoDecoder * decoder);
+static gboolean gst_maruimagedec_flush (GstVideoDecoder * decoder);
+
+static void
+gst_maruimagedec_class_init (GstMaruImageDecClass *klass)
+{
+  GST_DEBUG (" >> ENTER");
+  GObjectClass *gobject_class = (GObjectClass *) klass;
+  GstElementClass *element_class = (GstElementClass *) klass;
+  GstVideoDecoderClass *viddec_class = (GstVideoDecoderClass *) klass;
+
+  gobject_class->set_property = gst_maruimagedec_set_property;
+  gobject_class->get_property = gst_maruimagedec_get_property;
+  gobject_class->finalize = gst_maruimagedec_finalize;
+
+  g_object_class_install_property (gobject_class, ARG_BATCH_SIZE,
+      g_param_spec_uint ("batch-size", "Batch Size",
+      "Number of images sent to the device in one request",
+      1, CODEC_IMAGE_BATCH_MAX, DEFAULT_BATCH_SIZE,
+      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, ARG_MAX_WIDTH,
+      g_param_spec_int ("max-width", "Maximum width",
+      "Scale larger images down to this width, keeping the aspect ratio "
+      "(0 = full size)", 0, G_MAXINT, 0,
+      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, ARG_MAX_HEIGHT,
+      g_param_spec_int ("max-height", "Maximum height",
+      "Scale larger images down to this height, keeping the aspect ratio "
+      "(0 = full size)", 0, G_MAXINT, 0,
+      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, ARG_PRIORITY,
+      g_param_spec_enum ("priority", "Priority",
+      "Which streams the device serves first",
+      GST_MARU_TYPE_PRIORITY, DEFAULT_PRIORITY,
+      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  gst_element_class_set_metadata (element_class,
+      "Maru JPEG image decoder",
+      "Codec/Decoder/Image",
+      "Decodes batches of JPEG images on the codec device",
+      "Sooyoung Ha <yoosah.ha@samsung.com>");
+
+  gst_element_class_add_static_pad_template (element_class, &sink_template);
+  gst_element_class_add_static_pad_template (element_class, &src_template);
+
+  viddec_class->stop = gst_maruimagedec_stop;
+  viddec_class->set_format = gst_maruimagedec_set_format;
+  viddec_class->handle_frame = gst_maruimagedec_handle_frame;
+  viddec_class->finish = gst_maruimagedec_finish;
+  viddec_class->flush = gst_maruimagedec_flush;
+}
+
+static void
+gst_maruimagedec_init (GstMaruImageDec *maruimgdec)
+{
+  GST_DEBUG (" >> ENTER");
+  // instead of AVCodecContext
+  maruimgdec->context = g_malloc0 (sizeof(CodecContext));
+  maruimgdec->context->video.pix_fmt = PIX_FMT_NONE;
+  maruimgdec->context->audio.sample_fmt = SAMPLE_FMT_NONE;
+  maruimgdec->dev = g_malloc0 (sizeof(CodecDevice));
+
+  maruimgdec->jobs = g_queue_new ();
+  maruimgdec->batch_size = DEFAULT_BATCH_SIZE;
+
+  gst_video_decoder_set_packetized (GST_VIDEO_DECODER (maruimgdec), TRUE);
+}
+
+static void
+gst_maruimagedec_clear_jobs (GstMaruImageDec *maruimgdec)
+{
+  ImageJob *job;
+
+  while ((job = g_queue_pop_head (maruimgdec->jobs))) {
+    gst_video_codec_frame_unref (job->frame);
+    g_free (job);
+  }
+}
+
+static void
+gst_maruimagedec_finalize (GObject *object)
+{
+  GST_DEBUG (" >> ENTER");
+  GstMaruImageDec *maruimgdec = (GstMaruImageDec *) object;
+
+  gst_maruimagedec_clear_jobs (maruimgdec);
+  g_queue_free (maruimgdec->jobs);
+
+  g_free (maruimgdec->context);
+  g_free (maruimgdec->dev);
+
+  G_OBJECT_CLASS (gst_maruimagedec_parent_class)->finalize (object);
+}
+
+static gboolean
+gst_maruimagedec_stop (GstVideoDecoder * decoder)
+{
+  GST_DEBUG (" >> ENTER");
+  GstMaruImageDec *maruimgdec = (GstMaruImageDec *) decoder;
+
+  gst_maruimagedec_clear_jobs (maruimgdec);
+
+  if (maruimgdec->opened) {
+    gst_maru_avcodec_close (maruimgdec->context, maruimgdec->dev);
+    maruimgdec->opened = FALSE;
+  }
+
+  if (maruimgdec->input_state) {
+    gst_video_codec_state_unref (maruimgdec->input_state);
+    maruimgdec->input_state = NULL;
+  }
+  maruimgdec->out_width = maruimgdec->out_height = 0;
+
+  return TRUE;
+}
+
+static gboolean
+gst_maruimagedec_set_format (GstVideoDecoder * decoder,
+    GstVideoCodecState * state)
+{
+  GST_DEBUG (" >> ENTER");
+  GstMaruImageDec *maruimgdec = (GstMaruImageDec *) decoder;
+
+  if (maruimgdec->input_state) {
+    gst_video_codec_state_unref (maruimgdec->input_state);
+  }
+  maruimgdec->input_state = gst_video_codec_state_ref (state);
+
+  // the images are independent, one context serves all of them
+  if (maruimgdec->opened) {
+    return TRUE;
+  }
+
+  gst_maru_caps_with_codecname (image_codec->name, image_codec->media_type,
+      state->caps, maruimgdec->context);
+  if (!maruimgdec->context->video.fps_d || !maruimgdec->context->video.fps_n) {
+    maruimgdec->context->video.fps_n = 1;
+    maruimgdec->context->video.fps_d = 25;
+  }
+
+  if (gst_maru_avcodec_open (maruimgdec->context, image_codec,
+        maruimgdec->dev) < 0) {
+    GST_ERROR_OBJECT (maruimgdec, "failed to open maru_%sdec",
+        image_codec->name);
+    return FALSE;
+  }
+  maruimgdec->opened = TRUE;
+
+  return TRUE;
+}
+
+/* the size of the image from the first frame header (SOFn) */
+static gboolean
+gst_maruimagedec_parse_size (const guint8 *data, gsize size,
+    gint *width, gint *height)
+{
+  guint8 marker;
+  gsize i = 2;
+
+  if (size < 4 || data[0] != 0xff || data[1] != 0xd8) {
+    return FALSE;
+  }
+
+  while (i + 4 <= size) {
+    if (data[i] != 0xff) {
+      return FALSE;
+    }
+    marker = data[i + 1];
+    if (marker == 0xff) {
+      // fill byte
+      i++;
+      continue;
+    }
+    if (marker == 0x01 || (marker >= 0xd0 && marker <= 0xd8)) {
+      // markers without a length
+      i += 2;
+      continue;
+    }
+    if (marker >= 0xc0 && marker <= 0xcf &&
+        marker != 0xc4 && marker != 0xc8 && marker != 0xcc) {
+      if (i + 9 > size) {
+        return FALSE;
+      }
+      *height = GST_READ_UINT16_BE (data + i + 5);
+      *width = GST_READ_UINT16_BE (data + i + 7);
+      return *width > 0 && *height > 0;
+    }
+    if (marker == 0xd9 || marker == 0xda) {
+      // no frame header before the scan
+      return FALSE;
+    }
+    i += 2 + GST_READ_UINT16_BE (data + i + 2);
+  }
+
+  return FALSE;
+}
+
+/* fits width x height into max-width x max-height and into one request */
+static void
+gst_maruimagedec_output_size (GstMaruImageDec *maruimgdec,
+    gint *width, gint *height)
+{
+  gint w = *width, h = *height;
+
+  if (maruimgdec->max_width > 0 && w > maruimgdec->max_width) {
+    h = gst_util_uint64_scale_int (h, maruimgdec->max_width, w);
+    w = maruimgdec->max_width;
+  }
+  if (maruimgdec->max_height > 0 && h > maruimgdec->max_height) {
+    w = gst_util_uint64_scale_int (w, maruimgdec->max_height, h);
+    h = maruimgdec->max_height;
+  }
+  // the picture has to fit into one request
+  while ((guint64) w * h * 3 / 2 > CODEC_IMAGE_BATCH_MAX_SIZE) {
+    w = w * 7 / 8;
+    h = h * 7 / 8;
+  }
+
+  if (w != *width || h != *height) {
+    // even sizes for the chroma planes
+    *width = MAX (2, w & ~1);
+    *height = MAX (2, h & ~1);
+  }
+}
+
+static GstFlowReturn
+gst_maruimagedec_finish_image (GstMaruImageDec *maruimgdec, ImageJob *job,
+    GstBuffer *outbuf)
+{
+  GstVideoDecoder *decoder = GST_VIDEO_DECODER (maruimgdec);
+  GstVideoCodecState *output_state;
+
+  if (job->width != maruimgdec->out_width ||
+      job->height != maruimgdec->out_height) {
+    output_state = gst_video_decoder_set_output_state (decoder,
+        GST_VIDEO_FORMAT_I420, job->width, job->height, maruimgdec->input_state);
+    gst_video_codec_state_unref (output_state);
+    if (!gst_video_decoder_negotiate (decoder)) {
+      gst_buffer_unref (outbuf);
+      gst_video_decoder_drop_frame (decoder, job->frame);
+      return GST_FLOW_NOT_NEGOTIATED;
+    }
+    maruimgdec->out_width = job->width;
+    maruimgdec->out_height = job->height;
+  }
+
+  job->frame->output_buffer = outbuf;
+  return gst_video_decoder_finish_frame (decoder, job->frame);
+}
+
+/* sends all queued images to the device, in as few requests as they fit */
+static GstFlowReturn
+gst_maruimagedec_decode_batch (GstMaruImageDec *maruimgdec)
+{
+  GST_DEBUG (" >> ENTER");
+  GstVideoDecoder *decoder = GST_VIDEO_DECODER (maruimgdec);
+  ImageJob *jobs[CODEC_IMAGE_BATCH_MAX];
+  GstMapInfo mapinfo[CODEC_IMAGE_BATCH_MAX];
+  GstVideoFrame out_frames[CODEC_IMAGE_BATCH_MAX];
+  GstBuffer *outbufs[CODEC_IMAGE_BATCH_MAX];
+  uint8_t *in_bufs[CODEC_IMAGE_BATCH_MAX];
+  int in_sizes[CODEC_IMAGE_BATCH_MAX];
+  int lens[CODEC_IMAGE_BATCH_MAX];
+  GstFlowReturn ret = GST_FLOW_OK;
+  GstVideoInfo info;
+  gint i, nb_images, nb_decoded;
+
+  while (!g_queue_is_empty (maruimgdec->jobs)) {
+    nb_images = MIN (g_queue_get_length (maruimgdec->jobs),
+        CODEC_IMAGE_BATCH_MAX);
+
+    for (i = 0; i < nb_images; i++) {
+      jobs[i] = g_queue_peek_nth (maruimgdec->jobs, i);
+      gst_buffer_map (jobs[i]->frame->input_buffer, &mapinfo[i], GST_MAP_READ);
+      in_bufs[i] = mapinfo[i].data;
+      in_sizes[i] = mapinfo[i].size;
+
+      // the pictures are copied straight into the buffers pushed later
+      gst_video_info_set_format (&info, GST_VIDEO_FORMAT_I420,
+          jobs[i]->width, jobs[i]->height);
+      outbufs[i] = gst_buffer_new_allocate (NULL, GST_VIDEO_INFO_SIZE (&info),
+          NULL);
+      gst_video_frame_map (&out_frames[i], &info, outbufs[i], GST_MAP_WRITE);
+    }
+
+    nb_decoded = interface->decode_image_batch (maruimgdec->context, in_bufs,
+        in_sizes, nb_images, out_frames, lens, maruimgdec->dev);
+
+    for (i = 0; i < nb_images; i++) {
+      gst_video_frame_unmap (&out_frames[i]);
+      gst_buffer_unmap (jobs[i]->frame->input_buffer, &mapinfo[i]);
+    }
+
+    if (nb_decoded <= 0) {
+      GST_ELEMENT_ERROR (maruimgdec, STREAM, DECODE, (NULL),
+          ("failed to decode %d images", nb_images));
+      for (i = 0; i < nb_images; i++) {
+        lens[i] = -1;
+      }
+      nb_decoded = nb_images;
+      ret = GST_FLOW_ERROR;
+    }
+
+    for (i = 0; i < nb_images; i++) {
+      if (i >= nb_decoded) {
+        gst_buffer_unref (outbufs[i]);
+        continue;
+      }
+      g_queue_pop_head (maruimgdec->jobs);
+      if (lens[i] < 0) {
+        GST_WARNING_OBJECT (maruimgdec, "failed to decode image %u",
+            jobs[i]->frame->system_frame_number);
+        gst_buffer_unref (outbufs[i]);
+        gst_video_decoder_drop_frame (decoder, jobs[i]->frame);
+      } else if (ret == GST_FLOW_OK) {
+        ret = gst_maruimagedec_finish_image (maruimgdec, jobs[i], outbufs[i]);
+      } else {
+        gst_buffer_unref (outbufs[i]);
+        gst_video_decoder_release_frame (decoder, jobs[i]->frame);
+      }
+      g_free (jobs[i]);
+    }
+
+    if (ret != GST_FLOW_OK) {
+      gst_maruimagedec_clear_jobs (maruimgdec);
+      break;
+    }
+  }
+
+  return ret;
+}
+
+static GstFlowReturn
+gst_maruimagedec_handle_frame (GstVideoDecoder * decoder,
+    GstVideoCodecFrame * frame)
+{
+  GST_DEBUG (" >> ENTER");
+  GstMaruImageDec *maruimgdec = (GstMaruImageDec *) decoder;
+  GstMapInfo mapinfo;
+  ImageJob *job;
+  gint width = 0, height = 0;
+  gboolean parsed;
+
+  gst_buffer_map (frame->input_buffer, &mapinfo, GST_MAP_READ);
+  parsed = gst_maruimagedec_parse_size (mapinfo.data, mapinfo.size,
+      &width, &height);
+  gst_buffer_unmap (frame->input_buffer, &mapinfo);
+
+  if (!parsed) {
+    GST_WARNING_OBJECT (maruimgdec, "no frame header in image %u",
+        frame->system_frame_number);
+    return gst_video_decoder_drop_frame (decoder, frame);
+  }
+
+  gst_maruimagedec_output_size (maruimgdec, &width, &height);
+
+  job = g_new0 (ImageJob, 1);
+  job->frame = frame;
+  job->width = width;
+  job->height = height;
+  g_queue_push_tail (maruimgdec->jobs, job);
+
+  if (g_queue_get_length (maruimgdec->jobs) < maruimgdec->batch_size) {
+    return GST_FLOW_OK;
+  }
+
+  return gst_maruimagedec_decode_batch (maruimgdec);
+}
+
+static GstFlowReturn
+gst_maruimagedec_finish (GstVideoDecoder * decoder)
+{
+  GST_DEBUG (" >> ENTER");
+
+  return gst_maruimagedec_decode_batch ((GstMaruImageDec *) decoder);
+}
+
+static gboolean
+gst_maruimagedec_flush (GstVideoDecoder * decoder)
+{
+  GST_DEBUG (" >> ENTER");
+
+  gst_maruimagedec_clear_jobs ((GstMaruImageDec *) decoder);
+
+  return TRUE;
+}
+
+static void
+gst_maruimagedec_set_property (GObject *object,
+  guint prop_id, const GValue *value, GParamSpec *pspec)
+{
+  GST_DEBUG (" >> ENTER");
+  GstMaruImageDec *maruimgdec = (GstMaruImageDec *) object;
+
+  switch (prop_id) {
+    case ARG_BATCH_SIZE:
+      maruimgdec->batch_size = g_value_get_uint (value);
+      break;
+    case ARG_MAX_WIDTH:
+      maruimgdec->max_width = g_value_get_int (value);
+      break;
+    case ARG_MAX_HEIGHT:
+      maruimgdec->max_height = g_value_get_int (value);
+      break;
+    case ARG_PRIORITY:
+      maruimgdec->context->priority = g_value_get_enum (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_maruimagedec_get_property (GObject *object,
+  guint prop_id, GValue *value, GParamSpec *pspec)
+{
+  GST_DEBUG (" >> ENTER");
+  GstMaruImageDec *maruimgdec = (GstMaruImageDec *) object;
+
+  switch (prop_id) {
+    case ARG_BATCH_SIZE:
+      g_value_set_uint (value, maruimgdec->batch_size);
+      break;
+    case ARG_MAX_WIDTH:
+      g_value_set_int (value, maruimgdec->max_width);
+      break;
+    case ARG_MAX_HEIGHT:
+      g_value_set_int (value, maruimgdec->max_height);
+      break;
+    case ARG_PRIORITY:
+      g_value_set_enum (value, maruimgdec->context->priority);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+gboolean
+gst_maruimagedec_register (GstPlugin *plugin, GList *element)
+{
+  GList *elem;
+  CodecElement *codec;
+
+  if (!interface->decode_image_batch) {
+    GST_DEBUG ("the device can not decode image batches, maru_imagedec is not registered");
+    return TRUE;
+  }
+
+  for (elem = element; elem; elem = elem->next) {
+    codec = (CodecElement *)elem->data;
+    if (codec->codec_type == CODEC_TYPE_DECODE &&
+        codec->media_type == AVMEDIA_TYPE_VIDEO && !strcmp (codec->name, "mjpeg")) {
+      image_codec = codec;
+      break;
+    }
+  }
+  if (!image_codec) {
+    GST_DEBUG ("the host has no jpeg decoder, maru_imagedec is not registered");
+    return TRUE;
+  }
+
+  return gst_element_register (plugin, "maru_imagedec", GST_RANK_NONE,
+      gst_maruimagedec_get_type ());
+}
@@ -45,8 +45,23 @@ enum CODEC_FUNC_TYPE {
   CODEC_DEINIT,
   CODEC_FLUSH_BUFFERS,
   CODEC_DECODE_VIDEO_AND_PICTURE_COPY, // version 3
+  CODEC_ENCODE_VIDEO_BATCH,
+  CODEC_DECODE_AUDIO_BATCH,
+  CODEC_ENCODE_AUDIO_BATCH,
+  CODEC_DECODE_VIDEO_AND_ENCODE,
+  CODEC_DECODE_VIDEO_TO_MOSAIC,
+  CODEC_MOSAIC_COPY,
+  CODEC_DECODE_IMAGE_BATCH,
+  CODEC_FUNC_TYPE_COUNT, // not an api, stays last
 };
 
+/* packets of one batched audio decode. per packet results have to fit in
+ * front of the samples, below OFFSET_PICTURE_BUFFER. */
+#define MAX_AUDIO_DECODE_BATCH 16
+
+/* codec frames of one batched audio encode */
+#define MAX_AUDIO_ENCODE_BATCH 16
+
 typedef struct
 {
   gint idx;
@@ -101,6 +116,14 @@ typedef struct _GstMaruVidDec
   int max_threads;
 
   GstCaps *last_caps;
+
+  /* properties */
+  gint skip_frame;
+  guint request_timeout;
+  gboolean checksum_only;
+  gboolean fd_memory;
+
+  GstAllocator *fd_allocator;
 } GstMaruVidDec;
 
 typedef struct _GstMaruDec
@@ -164,9 +187,80 @@ typedef struct _GstMaruAudDec
   int mem_offset;
   bool is_using_new_decode_api;
 
+  /* input packets waiting for a batched decode */
+  GPtrArray *pending;
+  guint max_batch;
+
 } GstMaruAudDec;
 
 
+/* result of one packet of a batched encode. the packet data are stored
+ * back to back in the output buffer, in the same order. */
+typedef struct
+{
+  int32_t len;
+  int32_t coded_frame;
+  int32_t key_frame;
+} VideoEncodePacket;
+
+/* most bytes of the frames of one CODEC_ENCODE_VIDEO_BATCH request, and
+ * of its reply. both go into one 4 MB block of device memory, where each
+ * frame takes up to CODEC_VIDEO_BATCH_FRAME_HEADER bytes more. */
+#define CODEC_VIDEO_BATCH_MAX_SIZE    (4 * 1024 * 1024 - 0x100)
+#define CODEC_VIDEO_BATCH_FRAME_HEADER  16
+
+/* most images in one CODEC_DECODE_IMAGE_BATCH request, and most bytes
+ * of their input or their pictures. the pictures follow the reply header
+ * in one 4 MB block of device memory. */
+#define CODEC_IMAGE_BATCH_MAX         32
+#define CODEC_IMAGE_BATCH_MAX_SIZE    (4 * 1024 * 1024 - 0x100)
+
+/* where a decoded picture goes on a canvas the host keeps for a context,
+ * scaled to the rectangle. every stream of a mosaic names the same
+ * canvas, and the canvas is copied out as one picture. */
+typedef struct
+{
+  int32_t canvas_width, canvas_height;
+  int32_t pix_fmt;
+  int32_t x, y;
+  int32_t width, height;
+} MosaicRegion;
+
+/* a request that was handed over with submit_request and has been
+ * processed by the device. the reply is stored at mem_offset. */
+typedef struct
+{
+  int32_t ctx_index;
+  int32_t api_index;
+  uint32_t mem_offset;
+  int32_t ret;
+} CodecCompletion;
+
+/* features of the host, reported by get_capabilities. the interface only
+ * keeps the entries whose feature is present, so the elements pick the
+ * fastest path by checking for them. */
+#define CODEC_CAP_DECODE_AND_COPY     (1 << 0)
+#define CODEC_CAP_VIDEO_ENCODE_BATCH  (1 << 1)
+#define CODEC_CAP_AUDIO_DECODE_BATCH  (1 << 2)
+#define CODEC_CAP_AUDIO_ENCODE_BATCH  (1 << 3)
+#define CODEC_CAP_ASYNC               (1 << 4)
+#define CODEC_CAP_RINGS               (1 << 5)
+#define CODEC_CAP_TIMED               (1 << 6)
+#define CODEC_CAP_TRY_SECURE          (1 << 7)
+#define CODEC_CAP_TRANSCODE           (1 << 8)
+#define CODEC_CAP_MOSAIC              (1 << 9)
+#define CODEC_CAP_IMAGE_BATCH         (1 << 10)
+
+typedef struct
+{
+  uint32_t flags;
+  uint32_t mem_size;
+} CodecCapabilities;
+
+extern CodecCapabilities device_caps;
+
+#define CHECK_CAPS(cap)               ((device_caps.flags & (cap)) == (cap))
+
 typedef struct {
   int
   (*init) (CodecContext *ctx, CodecElement *codec, CodecDevice *dev);
@@ -201,6 +295,59 @@ typedef struct {
   (*prepare_elements) (int fd);
   int
   (*get_profile_status) (int fd);
+  int
+  (*encode_video_batch) (CodecContext *ctx, uint8_t *out_buf,
+                    int out_size, uint8_t **in_bufs,
+                    int *in_sizes, int64_t *in_timestamps, int nb_frames,
+                    VideoEncodePacket *packets, CodecDevice *dev);
+  int
+  (*decode_audio_batch) (CodecContext *ctx, uint8_t *samples,
+                    int max_size, uint8_t **in_bufs, int *in_sizes,
+                    int nb_packets, int *sample_sizes, CodecDevice *dev);
+  int
+  (*encode_audio_batch) (CodecContext *ctx, uint8_t *out_buf,
+                    int max_size, uint8_t *in_buf, int frame_bytes,
+                    int nb_frames, int *packet_sizes, CodecDevice *dev);
+  int
+  (*register_completion_fd) (CodecDevice *dev, int event_fd);
+  int
+  (*submit_request) (CodecContext *ctx, int32_t api_index,
+                    uint32_t mem_offset, int32_t buffer_size,
+                    CodecDevice *dev);
+  int
+  (*reap_completion) (CodecDevice *dev, CodecCompletion *completion);
+  int
+  (*setup_rings) (CodecDevice *dev);
+  void
+  (*release_rings) (CodecDevice *dev);
+  void
+  (*cancel_requests) (CodecContext *ctx, CodecDevice *dev);
+  int
+  (*get_capabilities) (int fd, CodecCapabilities *caps);
+  int
+  (*decode_video_buffer) (GstMaruVidDec *marudec, GstBuffer *in_buf,
+                    gint idx, gint64 in_offset, GstBuffer **out_buf, int *have_data);
+  int
+  (*encode_video_buffer) (CodecContext *ctx, uint8_t *out_buf,
+                    int out_size, GstBuffer *in_buf,
+                    int64_t in_timestamp, int *coded_frame,
+                    int *is_keyframe, CodecDevice *dev);
+  int
+  (*transcode_video) (CodecContext *dec_ctx, CodecContext *enc_ctx,
+                    uint8_t *in_buf, int in_size, gint idx, gint64 in_offset,
+                    uint8_t *out_buf, int out_size, int *got_picture,
+                    int *coded_frame, int *is_keyframe, CodecDevice *dev);
+  int
+  (*decode_video_to_mosaic) (CodecContext *ctx, int32_t canvas_index,
+                    MosaicRegion *region, uint8_t *in_buf, int in_size,
+                    int *got_picture, CodecDevice *dev);
+  int
+  (*copy_mosaic) (CodecContext *canvas, uint8_t *out_buf, int size,
+                    CodecDevice *dev);
+  int
+  (*decode_image_batch) (CodecContext *ctx, uint8_t **in_bufs,
+                    int *in_sizes, int nb_images, GstVideoFrame *out_frames,
+                    int *lens, CodecDevice *dev);
 } Interface;
 
 extern Interface *interface;
@@ -28,65 +28,84 @@
  *
  */
 
+#include <errno.h>
+
 #include "gstmaru.h"
 #include "gstmaruinterface.h"
+#include "gstmaruinterface3.h"
 #include "gstmaruutils.h"
 #include "gstmarumem.h"
 #include "gstmarudevice.h"
+#include "gstmarupicture.h"
+#include "gstmarutrace.h"
+#include "gstmaruexecutor.h"
 
 Interface *interface = NULL;
 
-enum IOCTL_CMD {
-  IOCTL_CMD_GET_VERSION,
-  IOCTL_CMD_GET_ELEMENTS_SIZE,
-  IOCTL_CMD_GET_ELEMENTS,
-  IOCTL_CMD_GET_CONTEXT_INDEX,
-  IOCTL_CMD_SECURE_BUFFER,
-  IOCTL_CMD_TRY_SECURE_BUFFER,
-  IOCTL_CMD_RELEASE_BUFFER,
-  IOCTL_CMD_INVOKE_API_AND_GET_DATA,
-  IOCTL_CMD_GET_PROFILE_STATUS,
-};
-
-typedef struct {
-  uint32_t  api_index;
-  uint32_t  ctx_index;
-  uint32_t  mem_offset;
-  int32_t  buffer_size;
-} __attribute__((packed)) IOCTL_Data;
-
-#define BRILLCODEC_KEY         'B'
-#define IOCTL_RW(CMD)           (_IOWR(BRILLCODEC_KEY, CMD, IOCTL_Data))
-
 #define CODEC_META_DATA_SIZE    256
 #define GET_OFFSET(buffer)      ((uint32_t)buffer - (uint32_t)device_mem)
 #define SMALLDATA               0
 
-#define OFFSET_PICTURE_BUFFER   0x100
-
 static inline bool can_use_new_decode_api(void) {
-    if (CHECK_VERSION(3)) {
+    if (CHECK_CAPS(CODEC_CAP_DECODE_AND_COPY)) {
         return true;
     }
     return false;
 }
 
+static gboolean ring_invoke (CodecContext *ctx, IOCTL_Data *data, int *ret);
+static int async_invoke (int fd, CodecContext *ctx, IOCTL_Data *data);
+
 static int
-invoke_device_api(int fd, int32_t ctx_index, int32_t api_index,
+run_device_api(int fd, CodecContext *ctx, int32_t api_index,
                           uint32_t *mem_offset, int32_t buffer_size)
 {
   GST_DEBUG (" >> Enter");
   IOCTL_Data ioctl_data = { 0, };
   int ret = -1;
+  gint64 start = 0;
+  gpointer request = NULL;
+  uint32_t request_size = 0;
 
   ioctl_data.api_index = api_index;
-  ioctl_data.ctx_index = ctx_index;
+  ioctl_data.ctx_index = ctx->index;
   if (mem_offset) {
     ioctl_data.mem_offset = *mem_offset;
   }
   ioctl_data.buffer_size = buffer_size;
 
-  ret = ioctl(fd, IOCTL_RW(IOCTL_CMD_INVOKE_API_AND_GET_DATA), &ioctl_data);
+  if (codec_tracing) {
+    if (mem_offset) {
+      request = gst_maru_trace_request (ctx->index, *mem_offset, &request_size);
+    }
+    start = g_get_monotonic_time ();
+  }
+
+  if (ctx->timeout_ms > 0 && CHECK_CAPS(CODEC_CAP_TIMED)) {
+    // the device gives up on the request once the deadline passed.
+    IOCTL_TimedData timed_data = { ioctl_data, ctx->timeout_ms };
+
+    ret = device_ops->ioctl (fd, IOCTL_TIMED(IOCTL_CMD_INVOKE_API_TIMED), &timed_data);
+    ioctl_data = timed_data.data;
+  } else if (ctx->wait.async) {
+    ret = async_invoke (fd, ctx, &ioctl_data);
+  } else if (!ctx->wait.hybrid || !ring_invoke (ctx, &ioctl_data, &ret)) {
+    ret = device_ops->ioctl (fd, IOCTL_RW(IOCTL_CMD_INVOKE_API_AND_GET_DATA), &ioctl_data);
+  }
+
+  if (codec_tracing) {
+    int err = errno;
+
+    gst_maru_trace_invoke (ctx->index, api_index,
+      mem_offset ? *mem_offset : 0, ioctl_data.mem_offset, buffer_size,
+      ret, start, request, request_size);
+    errno = err;
+  }
+
+  if (ret < 0 && (errno == ECANCELED || errno == ETIMEDOUT)) {
+    GST_WARNING ("api %d of context %d %s", api_index, ctx->index,
+      errno == ECANCELED ? "cancelled" : "timed out");
+  }
 
   if (mem_offset) {
     *mem_offset = ioctl_data.mem_offset;
@@ -96,17 +115,149 @@ invoke_device_api(int fd, int32_t ctx_index, int32_t api_index,
   return ret;
 }
 
+typedef struct {
+  int fd;
+  CodecContext *ctx;
+  int32_t api_index;
+  uint32_t *mem_offset;
+  int32_t buffer_size;
+} InvokeRequest;
+
+static int
+run_invoke_request (gpointer data)
+{
+  InvokeRequest *request = data;
+
+  return run_device_api (request->fd, request->ctx, request->api_index,
+    request->mem_offset, request->buffer_size);
+}
+
+// the executor orders the request by the priority of its context and,
+// with workers, runs it on one of them. device memory is secured and
+// released on the calling thread, so a worker never waits for memory
+// only another request can free.
+static int
+invoke_device_api(int fd, CodecContext *ctx, int32_t api_index,
+                          uint32_t *mem_offset, int32_t buffer_size)
+{
+  InvokeRequest request = { fd, ctx, api_index, mem_offset, buffer_size };
+
+  return gst_maru_executor_run (ctx, run_invoke_request, &request);
+}
+
+//
+// device memory
+//
+// when the memory is exhausted, contexts queue up in order of arrival
+// and each one waits until a release lets the head of the queue through,
+// so a busy stream cannot starve the others. releases of other
+// processes are noticed by polling every DEVICE_MEM_POLL_MS.
+// init only tries once, it runs under the global codec lock.
+#define DEVICE_MEM_WAIT_MS      2000
+#define DEVICE_MEM_POLL_MS      10
+
+static GMutex mem_lock;
+static GCond mem_released;
+static GQueue mem_waiters = G_QUEUE_INIT;
+// length of mem_waiters, read without mem_lock
+static gint mem_waiting;
+static gboolean can_try_secure = TRUE;
+
+static int
+wait_device_mem (int fd, CodecContext *ctx, IOCTL_Data *data, gboolean wait)
+{
+  int ret = -1, err = EBUSY;
+  gint cancel_gen = g_atomic_int_get (&ctx->wait.cancel_gen);
+  gint64 start, now, deadline;
+
+  // while no one waits, the memory is asked for without the lock
+  if (!wait || g_atomic_int_get (&mem_waiting) == 0) {
+    ret = device_ops->ioctl (fd, IOCTL_RW(IOCTL_CMD_TRY_SECURE_BUFFER), data);
+    err = errno;
+    if (ret == 0 || err != EBUSY || !wait) {
+      if (ret < 0) {
+        errno = err;
+      }
+      return ret;
+    }
+  }
+
+  g_mutex_lock (&mem_lock);
+  GST_DEBUG ("context %d waits for device memory", ctx->index);
+  ctx->wait.mem_waits++;
+  now = start = g_get_monotonic_time ();
+  deadline = start + G_TIME_SPAN_MILLISECOND *
+    (ctx->timeout_ms > 0 ? ctx->timeout_ms : DEVICE_MEM_WAIT_MS);
+
+  g_queue_push_tail (&mem_waiters, ctx);
+  g_atomic_int_inc (&mem_waiting);
+  for (;;) {
+    if (g_queue_peek_head (&mem_waiters) == ctx) {
+      ret = device_ops->ioctl (fd, IOCTL_RW(IOCTL_CMD_TRY_SECURE_BUFFER), data);
+      err = errno;
+      if (ret == 0 || err != EBUSY) {
+        break;
+      }
+    }
+    if (g_atomic_int_get (&ctx->wait.cancel_gen) != cancel_gen) {
+      err = ECANCELED;
+      break;
+    }
+    now = g_get_monotonic_time ();
+    if (now >= deadline) {
+      err = ETIMEDOUT;
+      break;
+    }
+    g_cond_wait_until (&mem_released, &mem_lock,
+      MIN (deadline, now + DEVICE_MEM_POLL_MS * G_TIME_SPAN_MILLISECOND));
+  }
+  g_queue_remove (&mem_waiters, ctx);
+  g_atomic_int_add (&mem_waiting, -1);
+  // the next one in line may try now
+  g_cond_broadcast (&mem_released);
+
+  ctx->wait.mem_wait_time += g_get_monotonic_time () - start;
+  g_mutex_unlock (&mem_lock);
+
+  if (ret < 0) {
+    errno = err;
+  }
+  return ret;
+}
+
 static int
-secure_device_mem (int fd, guint ctx_id, guint buf_size, gpointer* buffer)
+secure_device_mem_full (int fd, CodecContext *ctx, guint buf_size,
+                        gpointer* buffer, gboolean wait)
 {
   GST_DEBUG (" >> Enter");
   int ret = 0;
   IOCTL_Data data;
+  gint64 start = 0;
 
-  data.ctx_index = ctx_id;
+  data.ctx_index = ctx->index;
   data.buffer_size = buf_size;
 
-  ret = ioctl (fd, IOCTL_RW(IOCTL_CMD_SECURE_BUFFER), &data);
+  if (codec_tracing) {
+    start = g_get_monotonic_time ();
+  }
+
+  if (!CHECK_CAPS(CODEC_CAP_TRY_SECURE)) {
+    can_try_secure = FALSE;
+  }
+  ret = can_try_secure ? wait_device_mem (fd, ctx, &data, wait) : -1;
+  if (ret < 0 && (errno == ENOTTY || errno == EINVAL || !can_try_secure)) {
+    // the device cannot be asked without blocking
+    can_try_secure = FALSE;
+    ret = device_ops->ioctl (fd, IOCTL_RW(IOCTL_CMD_SECURE_BUFFER), &data);
+  }
+  if (codec_tracing) {
+    gst_maru_trace_secure (ctx->index, ret == 0 ? data.mem_offset : 0,
+      buf_size, ret, start);
+  }
+  if (ret < 0) {
+    GST_WARNING ("context %d got no device memory of %u bytes",
+      ctx->index, buf_size);
+  }
 
   *buffer = (gpointer)((uint32_t)device_mem + data.mem_offset);
   GST_DEBUG ("device_mem %p, offset_size 0x%x", device_mem, data.mem_offset);
@@ -115,18 +266,37 @@ secure_device_mem (int fd, guint ctx_id, guint buf_size, gpointer* buffer)
   return ret;
 }
 
+static int
+secure_device_mem (int fd, CodecContext *ctx, guint buf_size, gpointer* buffer)
+{
+  return secure_device_mem_full (fd, ctx, buf_size, buffer, TRUE);
+}
+
 static void
 release_device_mem (int fd, gpointer start)
 {
   GST_DEBUG (" >> Enter");
   int ret;
   uint32_t offset = start - device_mem;
+  gint64 begin = 0;
 
   GST_DEBUG ("release device_mem start: %p, offset: 0x%x", start, offset);
-  ret = ioctl (fd, IOCTL_RW(IOCTL_CMD_RELEASE_BUFFER), &offset);
+  if (codec_tracing) {
+    begin = g_get_monotonic_time ();
+  }
+  ret = device_ops->ioctl (fd, IOCTL_RW(IOCTL_CMD_RELEASE_BUFFER), &offset);
+  if (codec_tracing) {
+    gst_maru_trace_release (offset, ret, begin);
+  }
   if (ret < 0) {
     GST_ERROR ("failed to release buffer\n");
   }
+
+  if (g_atomic_int_get (&mem_waiting) > 0) {
+    g_mutex_lock (&mem_lock);
+    g_cond_broadcast (&mem_released);
+    g_mutex_unlock (&mem_lock);
+  }
   GST_DEBUG (" >> Leave");
 }
 
@@ -135,7 +305,7 @@ get_context_index (int fd)
 {
   int ctx_index;
 
-  if (ioctl (fd, IOCTL_RW(IOCTL_CMD_GET_CONTEXT_INDEX), &ctx_index) < 0) {
+  if (device_ops->ioctl (fd, IOCTL_RW(IOCTL_CMD_GET_CONTEXT_INDEX), &ctx_index) < 0) {
     GST_ERROR ("failed to get a context index, %d", fd);
     return -1;
   }
@@ -184,7 +354,7 @@ init (CodecContext *ctx, CodecElement *codec, CodecDevice *dev)
   /* buffer size is 0. It means that this function is required to
    * use small size.
   */
-  if (secure_device_mem(dev->fd, ctx->index, 0, &buffer) < 0) {
+  if (secure_device_mem_full(dev->fd, ctx, 0, &buffer, FALSE) < 0) {
     GST_ERROR ("failed to get a memory block");
     return -1;
   }
@@ -192,9 +362,10 @@ init (CodecContext *ctx, CodecElement *codec, CodecDevice *dev)
   codec_init_data_to (ctx, codec, buffer);
 
   mem_offset = GET_OFFSET(buffer);
-  ret = invoke_device_api (dev->fd, ctx->index, CODEC_INIT, &mem_offset, SMALLDATA);
+  ret = invoke_device_api (dev->fd, ctx, CODEC_INIT, &mem_offset, SMALLDATA);
 
   if (ret < 0) {
+    release_device_mem(dev->fd, buffer);
     GST_ERROR ("invoke_device_api failed");
     return -1;
   }
@@ -218,7 +389,7 @@ static void
 deinit (CodecContext *ctx, CodecDevice *dev)
 {
   GST_INFO ("close context %d", ctx->index);
-  invoke_device_api (dev->fd, ctx->index, CODEC_DEINIT, NULL, -1);
+  invoke_device_api (dev->fd, ctx, CODEC_DEINIT, NULL, -1);
 }
 
 //
@@ -226,21 +397,22 @@ deinit (CodecContext *ctx, CodecDevice *dev)
 // VIDEO DECODE / ENCODE
 //
 
-struct video_decode_input {
-    int32_t inbuf_size;
-    int32_t idx;
-    int64_t in_offset;
-    uint8_t inbuf;          // for pointing inbuf address
-} __attribute__((packed));
-
-struct video_decode_output {
-    int32_t len;
-    int32_t got_picture;
-    uint8_t data;           // for pointing data address
-} __attribute__((packed));
+// the input is either inbuf or every memory of in_buffer in turn.
+// gst_buffer_extract maps the memories one by one, so input of several
+// memories is not merged before it is copied.
+static inline void
+copy_input (uint8_t *dest, uint8_t *inbuf, GstBuffer *in_buffer, int size)
+{
+  if (in_buffer) {
+    gst_buffer_extract (in_buffer, 0, dest, size);
+  } else {
+    memcpy(dest, inbuf, size);
+  }
+}
 
 static int
-decode_video (GstMaruVidDec *marudec, uint8_t *inbuf, int inbuf_size,
+decode_video_input (GstMaruVidDec *marudec, uint8_t *inbuf,
+                    GstBuffer *in_buffer, int inbuf_size,
                     gint idx, gint64 in_offset, GstBuffer **out_buf, int *have_data)
 {
   GST_DEBUG (" >> Enter");
@@ -251,7 +423,7 @@ decode_video (GstMaruVidDec *marudec, uint8_t *inbuf, int inbuf_size,
   uint32_t mem_offset;
   size_t size = sizeof(inbuf_size) + sizeof(idx) + sizeof(in_offset) + inbuf_size;
 
-  ret = secure_device_mem(dev->fd, ctx->index, size, &buffer);
+  ret = secure_device_mem(dev->fd, ctx, size, &buffer);
   if (ret < 0) {
     GST_ERROR ("failed to get available memory to write inbuf");
     return -1;
@@ -262,7 +434,7 @@ decode_video (GstMaruVidDec *marudec, uint8_t *inbuf, int inbuf_size,
   decode_input->inbuf_size = inbuf_size;
   decode_input->idx = idx;
   decode_input->in_offset = in_offset;
-  memcpy(&decode_input->inbuf, inbuf, inbuf_size);
+  copy_input(&decode_input->inbuf, inbuf, in_buffer, inbuf_size);
 
   mem_offset = GET_OFFSET(buffer);
 
@@ -275,13 +447,14 @@ decode_video (GstMaruVidDec *marudec, uint8_t *inbuf, int inbuf_size,
       GST_ERROR ("Can not enter here. Check about it !!!");
       picture_size = SMALLDATA;
     }
-    ret = invoke_device_api(dev->fd, ctx->index, CODEC_DECODE_VIDEO_AND_PICTURE_COPY, &mem_offset, picture_size);
+    ret = invoke_device_api(dev->fd, ctx, CODEC_DECODE_VIDEO_AND_PICTURE_COPY, &mem_offset, picture_size);
   } else {
     // in case of this, a decoded frame is not given from codec device.
-    ret = invoke_device_api(dev->fd, ctx->index, CODEC_DECODE_VIDEO, &mem_offset, SMALLDATA);
+    ret = invoke_device_api(dev->fd, ctx, CODEC_DECODE_VIDEO, &mem_offset, SMALLDATA);
   }
 
   if (ret < 0) {
+    release_device_mem(dev->fd, buffer);
     GST_ERROR ("invoke API failed");
     return -1;
   }
@@ -305,6 +478,22 @@ decode_video (GstMaruVidDec *marudec, uint8_t *inbuf, int inbuf_size,
   return len;
 }
 
+static int
+decode_video (GstMaruVidDec *marudec, uint8_t *inbuf, int inbuf_size,
+                    gint idx, gint64 in_offset, GstBuffer **out_buf, int *have_data)
+{
+  return decode_video_input (marudec, inbuf, NULL, inbuf_size,
+    idx, in_offset, out_buf, have_data);
+}
+
+static int
+decode_video_buffer (GstMaruVidDec *marudec, GstBuffer *in_buffer,
+                    gint idx, gint64 in_offset, GstBuffer **out_buf, int *have_data)
+{
+  return decode_video_input (marudec, NULL, in_buffer,
+    gst_buffer_get_size (in_buffer), idx, in_offset, out_buf, have_data);
+}
+
 GstFlowReturn
 alloc_and_copy (GstMaruVidDec *marudec, guint64 offset, guint size,
                   GstCaps *caps, GstBuffer **buf)
@@ -315,6 +504,10 @@ alloc_and_copy (GstMaruVidDec *marudec, guint64 offset, guint size,
   CodecContext *ctx;
   CodecDevice *dev;
   GstMapInfo mapinfo;
+  GstVideoFrame frame;
+  GstVideoInfo *out_info;
+  guint8 *picture;
+  GstFlowReturn flow = GST_FLOW_OK;
 
   ctx = marudec->context;
   dev = marudec->dev;
@@ -327,7 +520,7 @@ alloc_and_copy (GstMaruVidDec *marudec, guint64 offset, guint size,
 
     mem_offset = 0;
 
-    int ret = invoke_device_api(dev->fd, ctx->index, CODEC_PICTURE_COPY, &mem_offset, size);
+    int ret = invoke_device_api(dev->fd, ctx, CODEC_PICTURE_COPY, &mem_offset, size);
     if (ret < 0) {
       GST_DEBUG ("failed to get available buffer");
       return GST_FLOW_ERROR;
@@ -342,13 +535,36 @@ alloc_and_copy (GstMaruVidDec *marudec, guint64 offset, guint size,
 */
     // FIXME: we must aligned buffer offset.
     //buffer = g_malloc (size);
-    gst_buffer_map (*buf, &mapinfo, GST_MAP_READWRITE);
-
     if (marudec->is_using_new_decode_api) {
-      memcpy (mapinfo.data, device_mem + mem_offset + OFFSET_PICTURE_BUFFER, size);
+      picture = device_mem + mem_offset + OFFSET_PICTURE_BUFFER;
     } else {
-      memcpy (mapinfo.data, device_mem + mem_offset, size);
+      picture = device_mem + mem_offset;
+    }
+
+    out_info = &marudec->output_state->info;
+    if (GST_VIDEO_INFO_FORMAT (out_info) !=
+        gst_maru_pixfmt_to_videoformat (marudec->ctx_pix_fmt) ||
+        GST_VIDEO_INFO_WIDTH (out_info) != marudec->ctx_width ||
+        GST_VIDEO_INFO_HEIGHT (out_info) != marudec->ctx_height) {
+      // downstream wants another format or size, convert while copying.
+      if (!gst_video_frame_map (&frame, out_info, *buf, GST_MAP_WRITE)) {
+        GST_ERROR ("failed to map output frame");
+        release_device_mem(dev->fd, device_mem + mem_offset);
+        return GST_FLOW_ERROR;
+      }
+      if (!gst_maru_picture_copy (&frame, picture, marudec->ctx_pix_fmt,
+            marudec->ctx_width, marudec->ctx_height)) {
+        flow = GST_FLOW_NOT_NEGOTIATED;
+      }
+      gst_video_frame_unmap (&frame);
+      release_device_mem(dev->fd, device_mem + mem_offset);
+
+      GST_DEBUG (" >> leave");
+      return flow;
     }
+
+    gst_buffer_map (*buf, &mapinfo, GST_MAP_READWRITE);
+    memcpy (mapinfo.data, picture, size);
     release_device_mem(dev->fd, device_mem + mem_offset);
 
     GST_DEBUG ("secured last buffer!! Use heap buffer");
@@ -363,6 +579,7 @@ alloc_and_copy (GstMaruVidDec *marudec, guint64 offset, guint size,
       //GST_BUFFER_FREE_FUNC (*buf) = buffer_free;
     }
 
+
     GST_DEBUG ("device memory start: 0x%p, offset 0x%x", (void *) buffer, mem_offset);
   }
 */
@@ -373,6 +590,135 @@ alloc_and_copy (GstMaruVidDec *marudec, guint64 offset, guint size,
   return GST_FLOW_OK;
 }
 
+// crc-32c. a picture only has to be told apart from its reference,
+// which a cryptographic hash does at several times the cost. the
+// castagnoli polynomial is the one sse4.2 has an instruction for, other
+// cpus slice the picture by 8 bytes and get the same value.
+static uint32_t crc32c_table[8][256];
+static uint32_t (*crc32c_update) (uint32_t c, const guint8 *data, guint size);
+
+static uint32_t
+crc32c_slice8 (uint32_t c, const guint8 *data, guint size)
+{
+  uint32_t lo, hi;
+
+  for (; size && ((uintptr_t) data & 7); size--) {
+    c = crc32c_table[0][(c ^ *data++) & 0xff] ^ (c >> 8);
+  }
+  for (; size >= 8; size -= 8, data += 8) {
+    memcpy (&lo, data, 4);
+    memcpy (&hi, data + 4, 4);
+    lo = GUINT32_FROM_LE (lo) ^ c;
+    hi = GUINT32_FROM_LE (hi);
+    c = crc32c_table[7][lo & 0xff] ^ crc32c_table[6][(lo >> 8) & 0xff] ^
+      crc32c_table[5][(lo >> 16) & 0xff] ^ crc32c_table[4][lo >> 24] ^
+      crc32c_table[3][hi & 0xff] ^ crc32c_table[2][(hi >> 8) & 0xff] ^
+      crc32c_table[1][(hi >> 16) & 0xff] ^ crc32c_table[0][hi >> 24];
+  }
+  for (; size; size--) {
+    c = crc32c_table[0][(c ^ *data++) & 0xff] ^ (c >> 8);
+  }
+
+  return c;
+}
+
+#if defined(__i386__) || defined(__x86_64__)
+__attribute__((target("sse4.2")))
+static uint32_t
+crc32c_sse42 (uint32_t c, const guint8 *data, guint size)
+{
+  uint32_t v32;
+#if defined(__x86_64__)
+  uint64_t v64;
+
+  for (; size >= 8; size -= 8, data += 8) {
+    memcpy (&v64, data, 8);
+    c = __builtin_ia32_crc32di (c, v64);
+  }
+#endif
+  for (; size >= 4; size -= 4, data += 4) {
+    memcpy (&v32, data, 4);
+    c = __builtin_ia32_crc32si (c, v32);
+  }
+  for (; size; size--) {
+    c = __builtin_ia32_crc32qi (c, *data++);
+  }
+
+  return c;
+}
+#endif
+
+static gpointer
+crc32c_init (gpointer data)
+{
+  uint32_t i, j, c;
+
+  for (i = 0; i < 256; i++) {
+    c = i;
+    for (j = 0; j < 8; j++) {
+      c = c & 1 ? 0x82f63b78 ^ (c >> 1) : c >> 1;
+    }
+    crc32c_table[0][i] = c;
+  }
+  for (i = 0; i < 256; i++) {
+    for (j = 1; j < 8; j++) {
+      c = crc32c_table[j - 1][i];
+      crc32c_table[j][i] = (c >> 8) ^ crc32c_table[0][c & 0xff];
+    }
+  }
+
+  crc32c_update = crc32c_slice8;
+#if defined(__i386__) || defined(__x86_64__)
+  if (__builtin_cpu_supports ("sse4.2")) {
+    crc32c_update = crc32c_sse42;
+  }
+#endif
+
+  return NULL;
+}
+
+static uint32_t
+picture_crc32c (const guint8 *data, guint size)
+{
+  static GOnce init_once = G_ONCE_INIT;
+
+  g_once (&init_once, crc32c_init, NULL);
+
+  return crc32c_update (0xffffffff, data, size) ^ 0xffffffff;
+}
+
+// hashes the decoded picture where it lies in the device memory instead
+// of copying it out, for runs that only compare pictures to references.
+gchar *
+checksum_picture (GstMaruVidDec *marudec, guint size)
+{
+  GST_DEBUG (" >> enter");
+  CodecContext *ctx = marudec->context;
+  CodecDevice *dev = marudec->dev;
+  uint32_t mem_offset;
+  guint8 *picture;
+  gchar *checksum;
+
+  if (marudec->is_using_new_decode_api) {
+    mem_offset = marudec->mem_offset;
+    picture = device_mem + mem_offset + OFFSET_PICTURE_BUFFER;
+  } else {
+    mem_offset = 0;
+    int ret = invoke_device_api(dev->fd, ctx, CODEC_PICTURE_COPY, &mem_offset, size);
+    if (ret < 0) {
+      GST_DEBUG ("failed to get available buffer");
+      return NULL;
+    }
+    picture = device_mem + mem_offset;
+  }
+
+  checksum = g_strdup_printf ("%08x", picture_crc32c (picture, size));
+  release_device_mem(dev->fd, device_mem + mem_offset);
+
+  GST_DEBUG (" >> leave");
+  return checksum;
+}
+
 static GstFlowReturn
 buffer_alloc_and_copy (GstPad *pad, guint64 offset, guint size,
                   GstCaps *caps, GstBuffer **buf)
@@ -399,7 +745,7 @@ buffer_alloc_and_copy (GstPad *pad, guint64 offset, guint size,
 
     GST_DEBUG ("buffer_and_copy. ctx_id: %d", ctx->index);
 
-    int ret = invoke_device_api(dev->fd, ctx->index, CODEC_PICTURE_COPY, &mem_offset, size);
+    int ret = invoke_device_api(dev->fd, ctx, CODEC_PICTURE_COPY, &mem_offset, size);
     if (ret < 0) {
       GST_DEBUG ("failed to get available buffer");
       return GST_FLOW_ERROR;
@@ -434,7 +780,6 @@ buffer_alloc_and_copy (GstPad *pad, guint64 offset, guint size,
       //GST_BUFFER_FREE_FUNC (*buf) = buffer_free;
     }
 
-
     GST_DEBUG ("device memory start: 0x%p, offset 0x%x", (void *) buffer, mem_offset);
   }
 */
@@ -450,22 +795,9 @@ buffer_alloc_and_copy (GstPad *pad, guint64 offset, guint size,
   return GST_FLOW_OK;
 }
 
-struct video_encode_input {
-    int32_t inbuf_size;
-    int64_t in_timestamp;
-    uint8_t inbuf;          // for pointing inbuf address
-} __attribute__((packed));
-
-struct video_encode_output {
-    int32_t len;
-    int32_t coded_frame;
-    int32_t key_frame;
-    uint8_t data;           // for pointing data address
-} __attribute__((packed));
-
 static int
-encode_video (CodecContext *ctx, uint8_t *outbuf,
-                    int out_size, uint8_t *inbuf,
+encode_video_input (CodecContext *ctx, uint8_t *outbuf,
+                    int out_size, uint8_t *inbuf, GstBuffer *in_buffer,
                     int inbuf_size, int64_t in_timestamp,
                     int *coded_frame, int *is_keyframe,
                     CodecDevice *dev)
@@ -475,7 +807,7 @@ encode_video (CodecContext *ctx, uint8_t *outbuf,
   uint32_t mem_offset;
   size_t size = sizeof(inbuf_size) + sizeof(in_timestamp) + inbuf_size;
 
-  ret = secure_device_mem(dev->fd, ctx->index, size, &buffer);
+  ret = secure_device_mem(dev->fd, ctx, size, &buffer);
   if (ret < 0) {
     GST_ERROR ("failed to small size of buffer");
     return -1;
@@ -485,14 +817,15 @@ encode_video (CodecContext *ctx, uint8_t *outbuf,
   struct video_encode_input *encode_input = buffer + sizeof(int32_t);
   encode_input->inbuf_size = inbuf_size;
   encode_input->in_timestamp = in_timestamp;
-  memcpy(&encode_input->inbuf, inbuf, inbuf_size);
+  copy_input(&encode_input->inbuf, inbuf, in_buffer, inbuf_size);
   GST_DEBUG ("insize: %d, inpts: %lld", encode_input->inbuf_size,(long long) encode_input->in_timestamp);
 
   mem_offset = GET_OFFSET(buffer);
 
-  ret = invoke_device_api(dev->fd, ctx->index, CODEC_ENCODE_VIDEO, &mem_offset, SMALLDATA);
+  ret = invoke_device_api(dev->fd, ctx, CODEC_ENCODE_VIDEO, &mem_offset, SMALLDATA);
 
   if (ret < 0) {
+    release_device_mem(dev->fd, buffer);
     GST_ERROR ("Invoke API failed");
     return -1;
   }
@@ -510,177 +843,667 @@ encode_video (CodecContext *ctx, uint8_t *outbuf,
   return len;
 }
 
-//
-// Interface
-// AUDIO DECODE / ENCODE
-//
-
-struct audio_decode_input {
-    int32_t inbuf_size;
-    uint8_t inbuf;          // for pointing inbuf address
-} __attribute__((packed));
-
-struct audio_decode_output {
-    int32_t len;
-    int32_t got_frame;
-    uint8_t data;           // for pointing data address
-} __attribute__((packed));
-
-struct audio_encode_input {
-    int32_t inbuf_size;
-    uint8_t inbuf;          // for pointing inbuf address
-} __attribute__((packed));
+static int
+encode_video (CodecContext *ctx, uint8_t *outbuf,
+                    int out_size, uint8_t *inbuf,
+                    int inbuf_size, int64_t in_timestamp,
+                    int *coded_frame, int *is_keyframe,
+                    CodecDevice *dev)
+{
+  return encode_video_input (ctx, outbuf, out_size, inbuf, NULL, inbuf_size,
+    in_timestamp, coded_frame, is_keyframe, dev);
+}
 
-struct audio_encode_output {
-    int32_t len;
-    uint8_t data;           // for pointing data address
-} __attribute__((packed));
+static int
+encode_video_buffer (CodecContext *ctx, uint8_t *outbuf,
+                    int out_size, GstBuffer *in_buffer,
+                    int64_t in_timestamp, int *coded_frame,
+                    int *is_keyframe, CodecDevice *dev)
+{
+  return encode_video_input (ctx, outbuf, out_size, NULL, in_buffer,
+    gst_buffer_get_size (in_buffer), in_timestamp, coded_frame,
+    is_keyframe, dev);
+}
 
+// a packet is decoded and its picture encoded on the host, so only
+// packets cross into the guest:
+//   video_transcode_input -> video_transcode_output
 static int
-decode_audio (CodecContext *ctx, int16_t *samples,
-                    int *have_data, uint8_t *inbuf,
-                    int inbuf_size, CodecDevice *dev)
+transcode_video (CodecContext *dec_ctx, CodecContext *enc_ctx,
+                    uint8_t *inbuf, int inbuf_size, gint idx, gint64 in_offset,
+                    uint8_t *outbuf, int out_size, int *got_picture,
+                    int *coded_frame, int *is_keyframe, CodecDevice *dev)
 {
   int len = 0, ret = 0;
   gpointer buffer = NULL;
   uint32_t mem_offset;
-  size_t size = sizeof(inbuf_size) + inbuf_size;
+  size_t size = sizeof(struct video_transcode_input) - 1 + inbuf_size;
 
-  ret = secure_device_mem(dev->fd, ctx->index, size, &buffer);
+  ret = secure_device_mem(dev->fd, dec_ctx, size, &buffer);
   if (ret < 0) {
     GST_ERROR ("failed to get available memory to write inbuf");
     return -1;
   }
 
-  GST_DEBUG ("decode_audio. in_buffer size %d", inbuf_size);
-
   fill_size_header(buffer, size);
-  struct audio_decode_input *decode_input = buffer + sizeof(int32_t);
-  decode_input->inbuf_size = inbuf_size;
-  memcpy(&decode_input->inbuf, inbuf, inbuf_size);
+  struct video_transcode_input *transcode_input = buffer + sizeof(int32_t);
+  transcode_input->encoder_index = enc_ctx->index;
+  transcode_input->inbuf_size = inbuf_size;
+  transcode_input->idx = idx;
+  transcode_input->in_offset = in_offset;
+  memcpy(&transcode_input->inbuf, inbuf, inbuf_size);
 
   mem_offset = GET_OFFSET(buffer);
 
-  ret = invoke_device_api(dev->fd, ctx->index, CODEC_DECODE_AUDIO, &mem_offset, SMALLDATA);
+  ret = invoke_device_api(dev->fd, dec_ctx, CODEC_DECODE_VIDEO_AND_ENCODE, &mem_offset, SMALLDATA);
 
   if (ret < 0) {
+    release_device_mem(dev->fd, buffer);
+    GST_ERROR ("Invoke API failed");
     return -1;
   }
 
-  GST_DEBUG ("decode_audio. ctx_id: %d, buffer = 0x%x",
-    ctx->index, (unsigned int) (device_mem + mem_offset));
-
-  struct audio_decode_output *decode_output = device_mem + mem_offset;
-  len = decode_output->len;
-  *have_data = decode_output->got_frame;
-  memcpy(&ctx->audio, &decode_output->data, sizeof(AudioData));
-
-  memcpy (samples, device_mem + mem_offset + OFFSET_PICTURE_BUFFER, len);
-
-  GST_DEBUG ("decode_audio. sample_fmt %d sample_rate %d, channels %d, ch_layout %lld, len %d",
-          ctx->audio.sample_fmt, ctx->audio.sample_rate, ctx->audio.channels,
-          ctx->audio.channel_layout, len);
+  struct video_transcode_output *transcode_output = device_mem + mem_offset;
+  *got_picture = transcode_output->got_picture;
+  len = transcode_output->encoded.len;
+  if (transcode_output->len < 0) {
+    GST_ERROR ("failed to decode the packet, len %d", transcode_output->len);
+    len = -1;
+  } else if (len > out_size) {
+    GST_ERROR ("no room for a packet of %d bytes", len);
+    len = -1;
+  } else if (len > 0) {
+    *coded_frame = transcode_output->encoded.coded_frame;
+    *is_keyframe = transcode_output->encoded.key_frame;
+    memcpy(outbuf, &transcode_output->encoded.data, len);
+  }
+  GST_DEBUG ("transcode_video. got_picture %d, packet %d", *got_picture, len);
 
   release_device_mem(dev->fd, device_mem + mem_offset);
 
   return len;
 }
 
+// the streams of a mosaic are decoded into one canvas on the host, and
+// the canvas is copied out once for all of them:
+//   video_mosaic_input -> video_decode_output
 static int
-encode_audio (CodecContext *ctx, uint8_t *outbuf,
-                    int max_size, uint8_t *inbuf,
-                    int inbuf_size, int64_t timestamp,
-                    CodecDevice *dev)
+decode_video_to_mosaic (CodecContext *ctx, int32_t canvas_index,
+                    MosaicRegion *region, uint8_t *inbuf, int inbuf_size,
+                    int *got_picture, CodecDevice *dev)
 {
   int len = 0, ret = 0;
   gpointer buffer = NULL;
   uint32_t mem_offset;
-  size_t size = sizeof(inbuf_size) + inbuf_size;
+  size_t size = sizeof(struct video_mosaic_input) - 1 + inbuf_size;
 
-  ret = secure_device_mem(dev->fd, ctx->index, inbuf_size, &buffer);
+  ret = secure_device_mem(dev->fd, ctx, size, &buffer);
   if (ret < 0) {
     GST_ERROR ("failed to get available memory to write inbuf");
     return -1;
   }
 
   fill_size_header(buffer, size);
-  struct audio_encode_input *encode_input = buffer + sizeof(int32_t);
-  encode_input->inbuf_size = inbuf_size;
-  memcpy(&encode_input->inbuf, inbuf, inbuf_size);
+  struct video_mosaic_input *mosaic_input = buffer + sizeof(int32_t);
+  mosaic_input->canvas_index = canvas_index;
+  mosaic_input->region = *region;
+  mosaic_input->inbuf_size = inbuf_size;
+  mosaic_input->idx = -1;
+  mosaic_input->in_offset = 0;
+  memcpy(&mosaic_input->inbuf, inbuf, inbuf_size);
 
   mem_offset = GET_OFFSET(buffer);
 
-  ret = invoke_device_api(dev->fd, ctx->index, CODEC_ENCODE_AUDIO, &mem_offset, SMALLDATA);
+  ret = invoke_device_api(dev->fd, ctx, CODEC_DECODE_VIDEO_TO_MOSAIC, &mem_offset, SMALLDATA);
 
   if (ret < 0) {
+    release_device_mem(dev->fd, buffer);
+    GST_ERROR ("Invoke API failed");
     return -1;
   }
 
-  GST_DEBUG ("encode_audio. mem_offset = 0x%x", mem_offset);
-
-  struct audio_encode_output *encode_output = device_mem + mem_offset;
-  len = encode_output->len;
-  if (len > 0) {
-    memcpy (outbuf, &encode_output->data, len);
-  }
+  struct video_decode_output *decode_output = device_mem + mem_offset;
+  len = decode_output->len;
+  *got_picture = decode_output->got_picture;
+  memcpy(&ctx->video, &decode_output->data, sizeof(VideoData));
 
-  GST_DEBUG ("encode_audio. len: %d", len);
+  GST_DEBUG ("decode_video_to_mosaic. len %d, got_picture %d", len, *got_picture);
 
   release_device_mem(dev->fd, device_mem + mem_offset);
 
   return len;
 }
 
-//
-// Interface
-// MISC
-//
-
-static void
-flush_buffers (CodecContext *ctx, CodecDevice *dev)
-{
-  GST_DEBUG ("flush buffers of context: %d", ctx->index);
-  invoke_device_api (dev->fd, ctx->index, CODEC_FLUSH_BUFFERS, NULL, -1);
-}
-
 static int
-get_device_version (int fd)
+copy_mosaic (CodecContext *canvas, uint8_t *outbuf, int size, CodecDevice *dev)
 {
-  uint32_t device_version;
+  uint32_t mem_offset = 0;
   int ret;
 
-  ret = ioctl (fd, IOCTL_RW(IOCTL_CMD_GET_VERSION), &device_version);
+  ret = invoke_device_api(dev->fd, canvas, CODEC_MOSAIC_COPY, &mem_offset, size);
   if (ret < 0) {
-    return ret;
+    GST_ERROR ("failed to copy the canvas of context %d", canvas->index);
+    return -1;
   }
 
-  return device_version;
+  memcpy(outbuf, device_mem + mem_offset, size);
+  release_device_mem(dev->fd, device_mem + mem_offset);
+
+  return 0;
 }
 
-static GList *
-prepare_elements (int fd)
+// as many of the images as fit into one request are decoded. a first
+// image too large for a request is failed without sending it. returns the
+// number of images done, lens of an image that was not decoded is
+// negative.
+static int
+decode_image_batch (CodecContext *ctx, uint8_t **inbufs, int *inbuf_sizes,
+                    int nb_images, GstVideoFrame *out_frames, int *lens,
+                    CodecDevice *dev)
 {
-  uint32_t size = 0;
-  int ret, elem_cnt, i;
-  GList *elements = NULL;
-  CodecElement *elem;
-
-  ret = ioctl (fd, IOCTL_RW(IOCTL_CMD_GET_ELEMENTS_SIZE), &size);
-  if (ret < 0) {
-    GST_ERROR ("get_elements_size failed");
-    return NULL;
+  int i, nb, ret = 0;
+  int picture_sizes[CODEC_IMAGE_BATCH_MAX];
+  int pix_fmts[CODEC_IMAGE_BATCH_MAX];
+  int32_t pictures_size = 0;
+  size_t size = sizeof(struct image_batch_input), entry_size;
+  gpointer buffer = NULL;
+  uint32_t mem_offset;
+  uint8_t *p;
+
+  for (nb = 0; nb < nb_images && nb < CODEC_IMAGE_BATCH_MAX; nb++) {
+    pix_fmts[nb] = gst_maru_videoformat_to_pixfmt (
+        GST_VIDEO_FRAME_FORMAT (&out_frames[nb]));
+    picture_sizes[nb] = gst_maru_avpicture_size (pix_fmts[nb],
+        GST_VIDEO_FRAME_WIDTH (&out_frames[nb]),
+        GST_VIDEO_FRAME_HEIGHT (&out_frames[nb]));
+    entry_size = sizeof(struct image_batch_entry) - 1 + inbuf_sizes[nb];
+    if (picture_sizes[nb] < 0 ||
+        size + entry_size > CODEC_IMAGE_BATCH_MAX_SIZE ||
+        pictures_size + picture_sizes[nb] > CODEC_IMAGE_BATCH_MAX_SIZE) {
+      break;
+    }
+    size += entry_size;
+    pictures_size += picture_sizes[nb];
   }
 
-  elem = g_malloc(size);
+  if (nb == 0) {
+    GST_ERROR ("image of %d bytes to %dx%d does not fit into a request",
+      inbuf_sizes[0], GST_VIDEO_FRAME_WIDTH (&out_frames[0]),
+      GST_VIDEO_FRAME_HEIGHT (&out_frames[0]));
+    lens[0] = -1;
+    return 1;
+  }
 
-  ret = ioctl (fd, IOCTL_RW(IOCTL_CMD_GET_ELEMENTS), elem);
+  ret = secure_device_mem(dev->fd, ctx, size, &buffer);
   if (ret < 0) {
-    GST_ERROR ("get_elements failed");
-    g_free (elem);
-    return NULL;
+    GST_ERROR ("failed to get available memory to write inbuf");
+    return -1;
   }
 
-  elem_cnt = size / sizeof(CodecElement);
+  fill_size_header(buffer, size);
+  struct image_batch_input *batch_input = buffer + sizeof(int32_t);
+  batch_input->nb_images = nb;
+  p = (uint8_t *)(batch_input + 1);
+  for (i = 0; i < nb; i++) {
+    struct image_batch_entry *entry = (struct image_batch_entry *)p;
+    entry->width = GST_VIDEO_FRAME_WIDTH (&out_frames[i]);
+    entry->height = GST_VIDEO_FRAME_HEIGHT (&out_frames[i]);
+    entry->pix_fmt = pix_fmts[i];
+    entry->inbuf_size = inbuf_sizes[i];
+    memcpy(&entry->inbuf, inbufs[i], inbuf_sizes[i]);
+    p += sizeof(struct image_batch_entry) - 1 + inbuf_sizes[i];
+  }
+
+  mem_offset = GET_OFFSET(buffer);
+
+  ret = invoke_device_api(dev->fd, ctx, CODEC_DECODE_IMAGE_BATCH, &mem_offset, pictures_size);
+
+  if (ret < 0) {
+    release_device_mem(dev->fd, buffer);
+    GST_ERROR ("Invoke API failed");
+    return -1;
+  }
+
+  struct image_batch_output *batch_output = device_mem + mem_offset;
+  p = device_mem + mem_offset + OFFSET_PICTURE_BUFFER;
+  for (i = 0; i < nb; i++) {
+    lens[i] = i < batch_output->nb_images ? batch_output->lens[i] : -1;
+    if (lens[i] >= 0 && !gst_maru_picture_copy (&out_frames[i], p, pix_fmts[i],
+          GST_VIDEO_FRAME_WIDTH (&out_frames[i]),
+          GST_VIDEO_FRAME_HEIGHT (&out_frames[i]))) {
+      lens[i] = -1;
+    }
+    p += picture_sizes[i];
+  }
+  GST_DEBUG ("decode_image_batch. %d of %d images", nb, nb_images);
+
+  release_device_mem(dev->fd, device_mem + mem_offset);
+
+  return nb;
+}
+
+// several raw frames in one request:
+//   int32 nb_frames, video_encode_input * nb_frames
+// and all packets the host produced for them in one reply:
+//   int32 nb_packets, video_encode_output * nb_packets
+static int
+encode_video_batch (CodecContext *ctx, uint8_t *outbuf,
+                    int out_size, uint8_t **inbufs,
+                    int *inbuf_sizes, int64_t *in_timestamps, int nb_frames,
+                    VideoEncodePacket *packets, CodecDevice *dev)
+{
+  int ret = 0, i, nb_packets, out_len = 0;
+  gpointer buffer = NULL;
+  uint32_t mem_offset;
+  size_t size = sizeof(int32_t);
+  uint8_t *p, *end;
+
+  for (i = 0; i < nb_frames; i++) {
+    size += sizeof(struct video_encode_input) - 1 + inbuf_sizes[i];
+  }
+
+  ret = secure_device_mem(dev->fd, ctx, size, &buffer);
+  if (ret < 0) {
+    GST_ERROR ("failed to get available memory for %d frames", nb_frames);
+    return -1;
+  }
+
+  fill_size_header(buffer, size);
+  p = buffer + sizeof(int32_t);
+  *(int32_t *)p = nb_frames;
+  p += sizeof(int32_t);
+  for (i = 0; i < nb_frames; i++) {
+    struct video_encode_input *encode_input = (struct video_encode_input *)p;
+    encode_input->inbuf_size = inbuf_sizes[i];
+    encode_input->in_timestamp = in_timestamps[i];
+    memcpy(&encode_input->inbuf, inbufs[i], inbuf_sizes[i]);
+    p = &encode_input->inbuf + inbuf_sizes[i];
+  }
+
+  mem_offset = GET_OFFSET(buffer);
+
+  ret = invoke_device_api(dev->fd, ctx, CODEC_ENCODE_VIDEO_BATCH, &mem_offset, SMALLDATA);
+
+  if (ret < 0) {
+    release_device_mem(dev->fd, buffer);
+    GST_ERROR ("Invoke API failed");
+    return -1;
+  }
+
+  p = device_mem + mem_offset;
+  // the packets never run past the block of the reply
+  end = p + MIN (CODEC_VIDEO_BATCH_MAX_SIZE, device_caps.mem_size - mem_offset);
+  nb_packets = *(int32_t *)p;
+  p += sizeof(int32_t);
+  GST_DEBUG ("encode_video_batch. %d frames, %d packets", nb_frames, nb_packets);
+  if (nb_packets > nb_frames) {
+    GST_WARNING ("ignore %d packets more than frames", nb_packets - nb_frames);
+    nb_packets = nb_frames;
+  }
+
+  for (i = 0; i < nb_packets; i++) {
+    struct video_encode_output *encode_output = (struct video_encode_output *)p;
+    int len;
+
+    if (&encode_output->data > end) {
+      GST_ERROR ("packet %d lies past the reply", i);
+      nb_packets = i;
+      break;
+    }
+    len = MAX (encode_output->len, 0);
+    if (len > end - &encode_output->data || out_len + len > out_size) {
+      GST_ERROR ("no room for packet %d of %d bytes", i, len);
+      nb_packets = i;
+      break;
+    }
+    packets[i].len = len;
+    packets[i].coded_frame = encode_output->coded_frame;
+    packets[i].key_frame = encode_output->key_frame;
+    memcpy(outbuf + out_len, &encode_output->data, len);
+    out_len += len;
+    p = &encode_output->data + len;
+  }
+
+  release_device_mem(dev->fd, device_mem + mem_offset);
+
+  return nb_packets;
+}
+
+//
+// Interface
+// AUDIO DECODE / ENCODE
+//
+
+static int
+decode_audio (CodecContext *ctx, int16_t *samples,
+                    int *have_data, uint8_t *inbuf,
+                    int inbuf_size, CodecDevice *dev)
+{
+  int len = 0, ret = 0;
+  gpointer buffer = NULL;
+  uint32_t mem_offset;
+  size_t size = sizeof(inbuf_size) + inbuf_size;
+
+  ret = secure_device_mem(dev->fd, ctx, size, &buffer);
+  if (ret < 0) {
+    GST_ERROR ("failed to get available memory to write inbuf");
+    return -1;
+  }
+
+  GST_DEBUG ("decode_audio. in_buffer size %d", inbuf_size);
+
+  fill_size_header(buffer, size);
+  struct audio_decode_input *decode_input = buffer + sizeof(int32_t);
+  decode_input->inbuf_size = inbuf_size;
+  memcpy(&decode_input->inbuf, inbuf, inbuf_size);
+
+  mem_offset = GET_OFFSET(buffer);
+
+  ret = invoke_device_api(dev->fd, ctx, CODEC_DECODE_AUDIO, &mem_offset, SMALLDATA);
+
+  if (ret < 0) {
+    release_device_mem(dev->fd, buffer);
+    return -1;
+  }
+
+  GST_DEBUG ("decode_audio. ctx_id: %d, buffer = 0x%x",
+    ctx->index, (unsigned int) (device_mem + mem_offset));
+
+  struct audio_decode_output *decode_output = device_mem + mem_offset;
+  len = decode_output->len;
+  *have_data = decode_output->got_frame;
+  memcpy(&ctx->audio, &decode_output->data, sizeof(AudioData));
+
+  memcpy (samples, device_mem + mem_offset + OFFSET_PICTURE_BUFFER, len);
+
+  GST_DEBUG ("decode_audio. sample_fmt %d sample_rate %d, channels %d, ch_layout %lld, len %d",
+          ctx->audio.sample_fmt, ctx->audio.sample_rate, ctx->audio.channels,
+          ctx->audio.channel_layout, len);
+
+  release_device_mem(dev->fd, device_mem + mem_offset);
+
+  return len;
+}
+
+// several compressed packets in one request:
+//   int32 nb_packets, audio_decode_input * nb_packets
+// the reply holds the format and the size of the samples of every packet,
+// the samples themselves follow each other from OFFSET_PICTURE_BUFFER.
+static int
+decode_audio_batch (CodecContext *ctx, uint8_t *samples,
+                    int max_size, uint8_t **inbufs, int *inbuf_sizes,
+                    int nb_packets, int *sample_sizes, CodecDevice *dev)
+{
+  int ret = 0, i, len = 0;
+  gpointer buffer = NULL;
+  uint32_t mem_offset;
+  size_t size = sizeof(int32_t);
+  uint8_t *p;
+
+  for (i = 0; i < nb_packets; i++) {
+    size += sizeof(struct audio_decode_input) - 1 + inbuf_sizes[i];
+  }
+
+  ret = secure_device_mem(dev->fd, ctx, size, &buffer);
+  if (ret < 0) {
+    GST_ERROR ("failed to get available memory for %d packets", nb_packets);
+    return -1;
+  }
+
+  fill_size_header(buffer, size);
+  p = buffer + sizeof(int32_t);
+  *(int32_t *)p = nb_packets;
+  p += sizeof(int32_t);
+  for (i = 0; i < nb_packets; i++) {
+    struct audio_decode_input *decode_input = (struct audio_decode_input *)p;
+    decode_input->inbuf_size = inbuf_sizes[i];
+    memcpy(&decode_input->inbuf, inbufs[i], inbuf_sizes[i]);
+    p = &decode_input->inbuf + inbuf_sizes[i];
+  }
+
+  mem_offset = GET_OFFSET(buffer);
+
+  ret = invoke_device_api(dev->fd, ctx, CODEC_DECODE_AUDIO_BATCH, &mem_offset, SMALLDATA);
+
+  if (ret < 0) {
+    release_device_mem(dev->fd, buffer);
+    return -1;
+  }
+
+  struct audio_decode_batch_output *decode_output = device_mem + mem_offset;
+  if (decode_output->nb_packets != nb_packets) {
+    GST_WARNING ("%d packets sent, %d decoded", nb_packets,
+      decode_output->nb_packets);
+  }
+  memcpy(&ctx->audio, &decode_output->audio, sizeof(AudioData));
+
+  // packets the host did not decode or there is no room for have none
+  memset(sample_sizes, 0, nb_packets * sizeof(int));
+  for (i = 0; i < nb_packets && i < decode_output->nb_packets; i++) {
+    if (decode_output->len[i] <= 0) {
+      continue;
+    }
+    if (len + decode_output->len[i] > max_size) {
+      GST_ERROR ("no room for samples of packet %d", i);
+      break;
+    }
+    sample_sizes[i] = decode_output->len[i];
+    len += sample_sizes[i];
+  }
+
+  memcpy (samples, device_mem + mem_offset + OFFSET_PICTURE_BUFFER, len);
+
+  GST_DEBUG ("decode_audio_batch. %d packets, sample_rate %d, channels %d, len %d",
+          nb_packets, ctx->audio.sample_rate, ctx->audio.channels, len);
+
+  release_device_mem(dev->fd, device_mem + mem_offset);
+
+  return len;
+}
+
+static int
+encode_audio (CodecContext *ctx, uint8_t *outbuf,
+                    int max_size, uint8_t *inbuf,
+                    int inbuf_size, int64_t timestamp,
+                    CodecDevice *dev)
+{
+  int len = 0, ret = 0;
+  gpointer buffer = NULL;
+  uint32_t mem_offset;
+  size_t size = sizeof(inbuf_size) + inbuf_size;
+
+  ret = secure_device_mem(dev->fd, ctx, inbuf_size, &buffer);
+  if (ret < 0) {
+    GST_ERROR ("failed to get available memory to write inbuf");
+    return -1;
+  }
+
+  fill_size_header(buffer, size);
+  struct audio_encode_input *encode_input = buffer + sizeof(int32_t);
+  encode_input->inbuf_size = inbuf_size;
+  memcpy(&encode_input->inbuf, inbuf, inbuf_size);
+
+  mem_offset = GET_OFFSET(buffer);
+
+  ret = invoke_device_api(dev->fd, ctx, CODEC_ENCODE_AUDIO, &mem_offset, SMALLDATA);
+
+  if (ret < 0) {
+    release_device_mem(dev->fd, buffer);
+    return -1;
+  }
+
+  GST_DEBUG ("encode_audio. mem_offset = 0x%x", mem_offset);
+
+  struct audio_encode_output *encode_output = device_mem + mem_offset;
+  len = encode_output->len;
+  if (len > 0) {
+    memcpy (outbuf, &encode_output->data, len);
+  }
+
+  GST_DEBUG ("encode_audio. len: %d", len);
+
+  release_device_mem(dev->fd, device_mem + mem_offset);
+
+  return len;
+}
+
+// several codec frames in one request:
+//   int32 nb_frames, audio_encode_input * nb_frames
+// and the packets of them in one reply:
+//   int32 nb_packets, audio_encode_output * nb_packets
+static int
+encode_audio_batch (CodecContext *ctx, uint8_t *outbuf,
+                    int max_size, uint8_t *inbuf, int frame_bytes,
+                    int nb_frames, int *packet_sizes, CodecDevice *dev)
+{
+  int ret = 0, i, nb_packets, out_len = 0;
+  gpointer buffer = NULL;
+  uint32_t mem_offset;
+  size_t size = sizeof(int32_t) +
+    (sizeof(struct audio_encode_input) - 1 + frame_bytes) * nb_frames;
+  uint8_t *p;
+
+  ret = secure_device_mem(dev->fd, ctx, size, &buffer);
+  if (ret < 0) {
+    GST_ERROR ("failed to get available memory for %d frames", nb_frames);
+    return -1;
+  }
+
+  fill_size_header(buffer, size);
+  p = buffer + sizeof(int32_t);
+  *(int32_t *)p = nb_frames;
+  p += sizeof(int32_t);
+  for (i = 0; i < nb_frames; i++) {
+    struct audio_encode_input *encode_input = (struct audio_encode_input *)p;
+    encode_input->inbuf_size = frame_bytes;
+    memcpy(&encode_input->inbuf, inbuf + i * frame_bytes, frame_bytes);
+    p = &encode_input->inbuf + frame_bytes;
+  }
+
+  mem_offset = GET_OFFSET(buffer);
+
+  ret = invoke_device_api(dev->fd, ctx, CODEC_ENCODE_AUDIO_BATCH, &mem_offset, SMALLDATA);
+
+  if (ret < 0) {
+    release_device_mem(dev->fd, buffer);
+    return -1;
+  }
+
+  p = device_mem + mem_offset;
+  nb_packets = MIN (*(int32_t *)p, nb_frames);
+  p += sizeof(int32_t);
+
+  for (i = 0; i < nb_packets; i++) {
+    struct audio_encode_output *encode_output = (struct audio_encode_output *)p;
+    int len = MAX (encode_output->len, 0);
+
+    if (out_len + len > max_size) {
+      GST_ERROR ("no room for packet %d of %d bytes", i, len);
+      nb_packets = i;
+      break;
+    }
+    packet_sizes[i] = len;
+    memcpy(outbuf + out_len, &encode_output->data, len);
+    out_len += len;
+    p = &encode_output->data + len;
+  }
+
+  GST_DEBUG ("encode_audio_batch. %d frames, %d packets, %d bytes",
+    nb_frames, nb_packets, out_len);
+
+  release_device_mem(dev->fd, device_mem + mem_offset);
+
+  return nb_packets;
+}
+
+//
+// Interface
+// MISC
+//
+
+static void
+flush_buffers (CodecContext *ctx, CodecDevice *dev)
+{
+  GST_DEBUG ("flush buffers of context: %d", ctx->index);
+  invoke_device_api (dev->fd, ctx, CODEC_FLUSH_BUFFERS, NULL, -1);
+}
+
+// may be called from any thread. requests of the context in flight fail
+// with ECANCELED and their callers release the device memory.
+static void
+cancel_requests (CodecContext *ctx, CodecDevice *dev)
+{
+  IOCTL_Data ioctl_data = { 0, };
+
+  GST_DEBUG ("cancel requests of context: %d", ctx->index);
+
+  // a wait for device memory ends too
+  g_atomic_int_inc (&ctx->wait.cancel_gen);
+  g_mutex_lock (&mem_lock);
+  g_cond_broadcast (&mem_released);
+  g_mutex_unlock (&mem_lock);
+
+  ioctl_data.ctx_index = ctx->index;
+  if (device_ops->ioctl (dev->fd, IOCTL_RW(IOCTL_CMD_CANCEL_REQUESTS), &ioctl_data) < 0) {
+    GST_WARNING ("failed to cancel requests of context %d", ctx->index);
+  }
+}
+
+static int
+get_device_version (int fd)
+{
+  uint32_t device_version;
+  int ret;
+
+  ret = device_ops->ioctl (fd, IOCTL_RW(IOCTL_CMD_GET_VERSION), &device_version);
+  if (ret < 0) {
+    return ret;
+  }
+
+  return device_version;
+}
+
+static int
+get_capabilities (int fd, CodecCapabilities *caps)
+{
+  IOCTL_Capabilities data = { 0, };
+  int ret;
+
+  ret = device_ops->ioctl (fd, IOCTL_CAPS(IOCTL_CMD_GET_CAPABILITIES), &data);
+  if (ret < 0) {
+    return ret;
+  }
+
+  caps->flags = data.flags;
+  caps->mem_size = data.mem_size;
+
+  return 0;
+}
+
+static GList *
+prepare_elements (int fd)
+{
+  uint32_t size = 0;
+  int ret, elem_cnt, i;
+  GList *elements = NULL;
+  CodecElement *elem;
+
+  ret = device_ops->ioctl (fd, IOCTL_RW(IOCTL_CMD_GET_ELEMENTS_SIZE), &size);
+  if (ret < 0) {
+    GST_ERROR ("get_elements_size failed");
+    return NULL;
+  }
+
+  elem = g_malloc(size);
+
+  ret = device_ops->ioctl (fd, IOCTL_RW(IOCTL_CMD_GET_ELEMENTS), elem);
+  if (ret < 0) {
+    GST_ERROR ("get_elements failed");
+    g_free (elem);
+    return NULL;
+  }
+
+  elem_cnt = size / sizeof(CodecElement);
   for (i = 0; i < elem_cnt; i++) {
     elements = g_list_append (elements, &elem[i]);
   }
@@ -694,7 +1517,7 @@ get_profile_status (int fd)
   uint8_t profile_status;
   int ret;
 
-  ret = ioctl (fd, IOCTL_RW(IOCTL_CMD_GET_PROFILE_STATUS), &profile_status);
+  ret = device_ops->ioctl (fd, IOCTL_RW(IOCTL_CMD_GET_PROFILE_STATUS), &profile_status);
   if (ret < 0) {
     return ret;
   }
@@ -702,6 +1525,383 @@ get_profile_status (int fd)
   return profile_status;
 }
 
+//
+// asynchronous request
+//
+// the request data must already be in device memory at mem_offset.
+// submit_request returns as soon as the device queued it and the reply
+// is picked up later with reap_completion.
+//
+// requests go through the rings in device memory when the device has
+// them, so that neither side needs a syscall while the device is busy.
+// the ioctls remain as a fallback when the sq is full.
+
+static struct codec_rings *rings;
+static int rings_fd = -1;
+static GMutex sq_lock;
+static GMutex cq_lock;
+static gint ioctl_pending;
+static guint ring_requests;
+static guint ring_doorbells;
+static guint ring_seq;
+
+// completions picked up by someone else: waited ones of other contexts,
+// and the ones of asynchronous requests a waiter passed over. those of
+// requests whose waiter gave up are never taken, so the oldest go once
+// there are more than could be in flight.
+static GQueue cq_stash = G_QUEUE_INIT;
+#define CQ_STASH_MAX            (2 * CODEC_RING_ENTRIES)
+
+// bound of the spin of the hybrid wait and weight of the latency average
+#define WAIT_SPIN_MAX_US        100
+#define WAIT_LATENCY_SHIFT      3
+
+static int
+setup_rings (CodecDevice *dev)
+{
+  IOCTL_Data data = { 0, };
+
+  if (device_ops->ioctl (dev->fd, IOCTL_RW(IOCTL_CMD_SETUP_RINGS), &data) < 0) {
+    GST_INFO ("no request rings on %d, use ioctl", dev->fd);
+    return -1;
+  }
+
+  if (data.buffer_size < sizeof(struct codec_rings)) {
+    GST_ERROR ("request rings of %d bytes are too small", data.buffer_size);
+    return -1;
+  }
+
+  rings = device_mem + data.mem_offset;
+  rings_fd = dev->fd;
+  ring_requests = 0;
+  ring_doorbells = 0;
+  GST_INFO ("request rings at 0x%x", data.mem_offset);
+
+  return 0;
+}
+
+static void
+release_rings (CodecDevice *dev)
+{
+  if (!rings) {
+    return;
+  }
+
+  GST_INFO ("%u requests through rings, %u doorbells",
+    ring_requests, ring_doorbells);
+  g_mutex_lock (&cq_lock);
+  g_queue_foreach (&cq_stash, (GFunc) g_free, NULL);
+  g_queue_clear (&cq_stash);
+  g_mutex_unlock (&cq_lock);
+  rings = NULL;
+  rings_fd = -1;
+}
+
+static int
+register_completion_fd (CodecDevice *dev, int event_fd)
+{
+  int32_t fd = event_fd;
+
+  if (device_ops->ioctl (dev->fd, IOCTL_EVENTFD(IOCTL_CMD_REGISTER_EVENTFD), &fd) < 0) {
+    GST_ERROR ("failed to register eventfd %d to %d", event_fd, dev->fd);
+    return -1;
+  }
+
+  // completions from the rings are signalled by the fd they belong to.
+  if (rings && rings_fd != dev->fd &&
+      device_ops->ioctl (rings_fd, IOCTL_EVENTFD(IOCTL_CMD_REGISTER_EVENTFD), &fd) < 0) {
+    GST_ERROR ("failed to register eventfd %d to %d", event_fd, rings_fd);
+    return -1;
+  }
+
+  return 0;
+}
+
+static gboolean
+ring_submit (IOCTL_Data *data)
+{
+  struct codec_sq_ring *sq = &rings->sq;
+  uint32_t tail;
+  gboolean wakeup;
+
+  g_mutex_lock (&sq_lock);
+  tail = sq->tail;
+  if (tail - __atomic_load_n (&sq->head, __ATOMIC_ACQUIRE) >= CODEC_RING_ENTRIES) {
+    g_mutex_unlock (&sq_lock);
+    return FALSE;
+  }
+
+  sq->entries[tail % CODEC_RING_ENTRIES] = *data;
+  __atomic_store_n (&sq->tail, tail + 1, __ATOMIC_SEQ_CST);
+
+  // the device sets the flag before it checks the tail for the last time,
+  // so either it sees this entry or we see the flag.
+  wakeup = __atomic_load_n (&sq->flags, __ATOMIC_SEQ_CST) & CODEC_RING_NEED_WAKEUP;
+  ring_requests++;
+  if (wakeup) {
+    ring_doorbells++;
+  }
+  g_mutex_unlock (&sq_lock);
+
+  if (wakeup && device_ops->ioctl (rings_fd, IOCTL_NONE(IOCTL_CMD_RING_DOORBELL), NULL) < 0) {
+    GST_ERROR ("failed to ring the doorbell of %d", rings_fd);
+  }
+
+  return TRUE;
+}
+
+static void
+copy_completion (CodecCompletion *completion, IOCTL_Completion *entry)
+{
+  completion->ctx_index = entry->ctx_index;
+  completion->api_index = entry->api_index;
+  completion->mem_offset = entry->mem_offset;
+  completion->ret = entry->ret;
+}
+
+// takes the first completion that matches, the ones passed over are
+// kept in the stash for their owners. called with cq_lock.
+static gboolean
+ring_take (gboolean waited, int32_t ctx_index, uint32_t api_index,
+           CodecCompletion *completion)
+{
+  struct codec_cq_ring *cq = &rings->cq;
+  IOCTL_Completion *entry;
+  GList *l;
+  uint32_t head;
+
+  for (l = cq_stash.head; l; l = l->next) {
+    entry = l->data;
+    if (waited ? (entry->ctx_index == ctx_index && entry->api_index == api_index)
+        : !(entry->api_index & CODEC_RING_WAITED)) {
+      copy_completion (completion, entry);
+      g_queue_delete_link (&cq_stash, l);
+      g_free (entry);
+      return TRUE;
+    }
+  }
+
+  while ((head = cq->head) != __atomic_load_n (&cq->tail, __ATOMIC_SEQ_CST)) {
+    IOCTL_Completion *next = &cq->entries[head % CODEC_RING_ENTRIES];
+    gboolean match = waited ?
+      (next->ctx_index == ctx_index && next->api_index == api_index) :
+      !(next->api_index & CODEC_RING_WAITED);
+
+    if (match) {
+      copy_completion (completion, next);
+    } else {
+      if (cq_stash.length >= CQ_STASH_MAX) {
+        entry = g_queue_pop_head (&cq_stash);
+        GST_WARNING ("drop the completion of api %d of context %d",
+          entry->api_index & CODEC_RING_API_MASK, entry->ctx_index);
+        g_free (entry);
+      }
+      g_queue_push_tail (&cq_stash, g_memdup (next, sizeof(*next)));
+    }
+    __atomic_store_n (&cq->head, head + 1, __ATOMIC_SEQ_CST);
+    if (match) {
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+static gboolean
+ring_reap (CodecCompletion *completion)
+{
+  gboolean ret;
+
+  g_mutex_lock (&cq_lock);
+  ret = ring_take (FALSE, 0, 0, completion);
+  g_mutex_unlock (&cq_lock);
+
+  return ret;
+}
+
+static inline void
+cpu_relax (void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+  __builtin_ia32_pause ();
+#endif
+}
+
+//
+// hybrid wait
+//
+// the request goes through the sq and the reply is looked for in the cq
+// for as long as replies of this context usually take, then the thread
+// blocks in the device until the cq moves. beyond WAIT_SPIN_MAX_US of
+// average latency the spin is left out, sleeping costs less then.
+static gboolean
+ring_invoke (CodecContext *ctx, IOCTL_Data *data, int *ret)
+{
+  CodecWaitStats *wait = &ctx->wait;
+  CodecCompletion completion;
+  IOCTL_Data cq_state = { 0, };
+  uint32_t api_index = data->api_index;
+  gint64 start, deadline, latency;
+  gboolean done = FALSE;
+
+  if (!rings) {
+    return FALSE;
+  }
+
+  // tag the request, the completion comes back with the same tag
+  data->api_index = (api_index & CODEC_RING_API_MASK) | CODEC_RING_WAITED |
+    ((g_atomic_int_add (&ring_seq, 1) & CODEC_RING_SEQ_MASK)
+      << CODEC_RING_SEQ_SHIFT);
+  if (!ring_submit (data)) {
+    data->api_index = api_index;
+    return FALSE;
+  }
+  api_index = data->api_index;
+
+  start = g_get_monotonic_time ();
+  deadline = start + (wait->latency ? wait->spin_budget : WAIT_SPIN_MAX_US);
+  do {
+    g_mutex_lock (&cq_lock);
+    done = ring_take (TRUE, ctx->index, api_index, &completion);
+    g_mutex_unlock (&cq_lock);
+    if (done) {
+      wait->spin_hits++;
+      break;
+    }
+    cpu_relax ();
+  } while (g_get_monotonic_time () < deadline);
+
+  if (!done) {
+    wait->spin_misses++;
+  }
+
+  while (!done) {
+    g_mutex_lock (&cq_lock);
+    cq_state.mem_offset = __atomic_load_n (&rings->cq.tail, __ATOMIC_SEQ_CST);
+    done = ring_take (TRUE, ctx->index, api_index, &completion);
+    g_mutex_unlock (&cq_lock);
+    if (done) {
+      break;
+    }
+
+    if (device_ops->ioctl (rings_fd, IOCTL_RW(IOCTL_CMD_WAIT_COMPLETION), &cq_state) < 0
+        && errno != EINTR) {
+      GST_ERROR ("failed to wait for api %d of context %d",
+        data->api_index & CODEC_RING_API_MASK, ctx->index);
+      *ret = -1;
+      return TRUE;
+    }
+  }
+
+  latency = g_get_monotonic_time () - start;
+  if (wait->latency) {
+    wait->latency += (latency - wait->latency) >> WAIT_LATENCY_SHIFT;
+  } else {
+    wait->latency = latency;
+  }
+  wait->spin_budget =
+    wait->latency <= WAIT_SPIN_MAX_US ? wait->latency + wait->latency / 2 : 0;
+
+  data->mem_offset = completion.mem_offset;
+  *ret = completion.ret;
+
+  return TRUE;
+}
+
+static int
+submit_request (CodecContext *ctx, int32_t api_index, uint32_t mem_offset,
+                int32_t buffer_size, CodecDevice *dev)
+{
+  GST_DEBUG (" >> Enter");
+  IOCTL_Data ioctl_data = { 0, };
+  int ret;
+
+  ioctl_data.api_index = api_index;
+  ioctl_data.ctx_index = ctx->index;
+  ioctl_data.mem_offset = mem_offset;
+  ioctl_data.buffer_size = buffer_size;
+
+  if (rings && ring_submit (&ioctl_data)) {
+    GST_DEBUG (" >> Leave");
+    return 0;
+  }
+
+  ret = device_ops->ioctl (dev->fd, IOCTL_RW(IOCTL_CMD_INVOKE_API_ASYNC), &ioctl_data);
+  if (ret < 0) {
+    GST_ERROR ("failed to submit api %d of context %d", api_index, ctx->index);
+  } else {
+    g_atomic_int_inc (&ioctl_pending);
+  }
+
+  GST_DEBUG (" >> Leave");
+  return ret;
+}
+
+//
+// async wait
+//
+// the request is submitted on its own and the thread sleeps until the
+// completion thread of the device reaps the reply, so the device is not
+// held by a blocked ioctl and one thread polls for all contexts.
+static int
+async_invoke (int fd, CodecContext *ctx, IOCTL_Data *data)
+{
+  CodecDevice dev = { fd, device_mem, device_caps.mem_size };
+  CodecCompletion completion;
+  gint cancel_gen = g_atomic_int_get (&ctx->wait.cancel_gen);
+  uint32_t api_index;
+
+  // the tag carries no CODEC_RING_WAITED, no one looks for it on the rings
+  api_index = (data->api_index & CODEC_RING_API_MASK) |
+    ((g_atomic_int_add (&ring_seq, 1) & CODEC_RING_SEQ_MASK)
+      << CODEC_RING_SEQ_SHIFT);
+  if (submit_request (ctx, api_index, data->mem_offset, data->buffer_size,
+        &dev) < 0) {
+    return -1;
+  }
+
+  gst_maru_codec_device_wait_completion (api_index, &completion);
+  data->mem_offset = completion.mem_offset;
+  if (completion.ret < 0) {
+    errno = g_atomic_int_get (&ctx->wait.cancel_gen) != cancel_gen ?
+      ECANCELED : EIO;
+    return -1;
+  }
+
+  return completion.ret;
+}
+
+static int
+reap_completion (CodecDevice *dev, CodecCompletion *completion)
+{
+  IOCTL_Completion data;
+
+  if (rings) {
+    if (ring_reap (completion)) {
+      return 1;
+    }
+    if (g_atomic_int_get (&ioctl_pending) == 0) {
+      return 0;
+    }
+  }
+
+  if (device_ops->ioctl (dev->fd, IOCTL_COMPLETION(IOCTL_CMD_GET_COMPLETION), &data) < 0) {
+    if (errno == EAGAIN) {
+      return 0;
+    }
+    GST_ERROR ("failed to get a completion, %d", dev->fd);
+    return -1;
+  }
+  g_atomic_int_add (&ioctl_pending, -1);
+
+  completion->ctx_index = data.ctx_index;
+  completion->api_index = data.api_index;
+  completion->mem_offset = data.mem_offset;
+  completion->ret = data.ret;
+
+  return 1;
+}
+
 // Interfaces
 Interface *interface_version_3 = &(Interface) {
   .init = init,
@@ -715,4 +1915,20 @@ Interface *interface_version_3 = &(Interface) {
   .get_device_version = get_device_version,
   .prepare_elements = prepare_elements,
   .get_profile_status = get_profile_status,
+  .encode_video_batch = encode_video_batch,
+  .decode_audio_batch = decode_audio_batch,
+  .encode_audio_batch = encode_audio_batch,
+  .register_completion_fd = register_completion_fd,
+  .submit_request = submit_request,
+  .reap_completion = reap_completion,
+  .setup_rings = setup_rings,
+  .release_rings = release_rings,
+  .cancel_requests = cancel_requests,
+  .get_capabilities = get_capabilities,
+  .decode_video_buffer = decode_video_buffer,
+  .encode_video_buffer = encode_video_buffer,
+  .transcode_video = transcode_video,
+  .decode_video_to_mosaic = decode_video_to_mosaic,
+  .copy_mosaic = copy_mosaic,
+  .decode_image_batch = decode_image_batch,
 };
@@ -0,0 +1,254 @@
+/*
+ * Gstreamer codec plugin for Tizen Emulator.
+ *
+ * Copyright (C) 2013 Samsung Electronics Co., Ltd. All rights reserved.
+ *
+ * Contact:
+ * KiTae Kim <kt920.kim@samsung.com>
+ * SeokYeon Hwang <syeon.hwang@samsung.com>
+ * YeongKyoon Lee <yeongkyoon.lee@samsung.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Contributors:
+ * - S-Core Co., Ltd
+ *
+ */
+
+#ifndef __GST_MARU_INTERFACE3_H__
+#define __GST_MARU_INTERFACE3_H__
+
+#include "gstmaru.h"
+#include "gstmaruinterface.h"
+
+/*
+ * layout of the requests and replies of the version 3 device.
+ */
+
+enum IOCTL_CMD {
+  IOCTL_CMD_GET_VERSION,
+  IOCTL_CMD_GET_ELEMENTS_SIZE,
+  IOCTL_CMD_GET_ELEMENTS,
+  IOCTL_CMD_GET_CONTEXT_INDEX,
+  IOCTL_CMD_SECURE_BUFFER,
+  IOCTL_CMD_TRY_SECURE_BUFFER,
+  IOCTL_CMD_RELEASE_BUFFER,
+  IOCTL_CMD_INVOKE_API_AND_GET_DATA,
+  IOCTL_CMD_GET_PROFILE_STATUS,
+  IOCTL_CMD_REGISTER_EVENTFD,
+  IOCTL_CMD_INVOKE_API_ASYNC,
+  IOCTL_CMD_GET_COMPLETION,
+  IOCTL_CMD_SETUP_RINGS,
+  IOCTL_CMD_RING_DOORBELL,
+  IOCTL_CMD_WAIT_COMPLETION,
+  IOCTL_CMD_INVOKE_API_TIMED,
+  IOCTL_CMD_CANCEL_REQUESTS,
+  IOCTL_CMD_GET_CAPABILITIES,
+};
+
+typedef struct {
+  uint32_t  api_index;
+  uint32_t  ctx_index;
+  uint32_t  mem_offset;
+  int32_t  buffer_size;
+} __attribute__((packed)) IOCTL_Data;
+
+/* one finished request of IOCTL_CMD_INVOKE_API_ASYNC. the device signals
+ * the eventfd registered with IOCTL_CMD_REGISTER_EVENTFD whenever it
+ * queues one, and IOCTL_CMD_GET_COMPLETION fails with EAGAIN once the
+ * queue is empty. */
+typedef struct {
+  uint32_t  ctx_index;
+  uint32_t  api_index;
+  uint32_t  mem_offset;
+  int32_t  ret;
+} __attribute__((packed)) IOCTL_Completion;
+
+/* IOCTL_CMD_INVOKE_API_AND_GET_DATA with a deadline. the request fails
+ * with ETIMEDOUT when it is not done in timeout_ms, or with ECANCELED
+ * when IOCTL_CMD_CANCEL_REQUESTS is issued for its context. */
+typedef struct {
+  IOCTL_Data data;
+  int32_t  timeout_ms;
+} __attribute__((packed)) IOCTL_TimedData;
+
+/* reply of IOCTL_CMD_GET_CAPABILITIES. flags are CODEC_CAP_* and
+ * mem_size is the size of the device memory that may be mapped. hosts
+ * older than the command fail it with ENOTTY. */
+typedef struct {
+  uint32_t  flags;
+  uint32_t  mem_size;
+} __attribute__((packed)) IOCTL_Capabilities;
+
+#define BRILLCODEC_KEY         'B'
+#define IOCTL_RW(CMD)           (_IOWR(BRILLCODEC_KEY, CMD, IOCTL_Data))
+#define IOCTL_COMPLETION(CMD)   (_IOR(BRILLCODEC_KEY, CMD, IOCTL_Completion))
+#define IOCTL_EVENTFD(CMD)      (_IOW(BRILLCODEC_KEY, CMD, int32_t))
+#define IOCTL_TIMED(CMD)        (_IOWR(BRILLCODEC_KEY, CMD, IOCTL_TimedData))
+#define IOCTL_CAPS(CMD)         (_IOR(BRILLCODEC_KEY, CMD, IOCTL_Capabilities))
+#define IOCTL_NONE(CMD)         (_IO(BRILLCODEC_KEY, CMD))
+
+/*
+ * submission and completion rings in device memory, set up with
+ * IOCTL_CMD_SETUP_RINGS which returns their offset and size. the plugin
+ * produces sq entries and consumes cq entries, the device does the
+ * opposite, so every index has a single writer. IOCTL_CMD_RING_DOORBELL
+ * is only needed when the device set CODEC_RING_NEED_WAKEUP before it
+ * went idle. completions are signalled on the registered eventfd when
+ * the cq was drained before they were posted.
+ */
+#define CODEC_RING_ENTRIES      64
+#define CODEC_RING_NEED_WAKEUP  (1 << 0)
+
+/* the upper half of api_index of an sq entry holds a sequence number of
+ * the plugin, and its top bit marks requests someone blocks on. the
+ * device echoes api_index in the completion, so a reply goes back to its
+ * own request even when a context has two of the same api in flight.
+ * IOCTL_CMD_WAIT_COMPLETION blocks until the cq tail differs from
+ * mem_offset. */
+#define CODEC_RING_API_MASK     0xffff
+#define CODEC_RING_SEQ_SHIFT    16
+#define CODEC_RING_SEQ_MASK     0x7fff
+#define CODEC_RING_WAITED       (1u << 31)
+
+struct codec_sq_ring {
+    uint32_t head;
+    uint32_t tail;
+    uint32_t flags;
+    uint32_t reserved;
+    IOCTL_Data entries[CODEC_RING_ENTRIES];
+};
+
+struct codec_cq_ring {
+    uint32_t head;
+    uint32_t tail;
+    uint32_t reserved[2];
+    IOCTL_Completion entries[CODEC_RING_ENTRIES];
+};
+
+struct codec_rings {
+    struct codec_sq_ring sq;
+    struct codec_cq_ring cq;
+};
+
+#define OFFSET_PICTURE_BUFFER   0x100
+
+struct video_decode_input {
+    int32_t inbuf_size;
+    int32_t idx;
+    int64_t in_offset;
+    uint8_t inbuf;          // for pointing inbuf address
+} __attribute__((packed));
+
+struct video_decode_output {
+    int32_t len;
+    int32_t got_picture;
+    uint8_t data;           // for pointing data address
+} __attribute__((packed));
+
+struct video_encode_input {
+    int32_t inbuf_size;
+    int64_t in_timestamp;
+    uint8_t inbuf;          // for pointing inbuf address
+} __attribute__((packed));
+
+struct video_encode_output {
+    int32_t len;
+    int32_t coded_frame;
+    int32_t key_frame;
+    uint8_t data;           // for pointing data address
+} __attribute__((packed));
+
+// a packet for the decoder context whose picture is handed to the
+// encoder context encoder_index on the host. the host converts the
+// picture when the encoder wants another pix_fmt.
+struct video_transcode_input {
+    int32_t encoder_index;
+    int32_t inbuf_size;
+    int32_t idx;
+    int64_t in_offset;
+    uint8_t inbuf;          // for pointing inbuf address
+} __attribute__((packed));
+
+struct video_transcode_output {
+    int32_t len;
+    int32_t got_picture;
+    struct video_encode_output encoded;
+} __attribute__((packed));
+
+// a packet for a stream of a mosaic, the picture is scaled into the
+// region of the canvas of context canvas_index. the output is
+// video_decode_output.
+struct video_mosaic_input {
+    int32_t canvas_index;
+    MosaicRegion region;
+    int32_t inbuf_size;
+    int32_t idx;
+    int64_t in_offset;
+    uint8_t inbuf;          // for pointing inbuf address
+} __attribute__((packed));
+
+// independent images for one context, each decoded and scaled by the
+// host to the size and pix_fmt of its entry:
+//   image_batch_input, image_batch_entry + inbuf for every image
+// the lengths come back in image_batch_output, the pictures back to back
+// from OFFSET_PICTURE_BUFFER.
+struct image_batch_input {
+    int32_t nb_images;
+} __attribute__((packed));
+
+struct image_batch_entry {
+    int32_t width, height;
+    int32_t pix_fmt;
+    int32_t inbuf_size;
+    uint8_t inbuf;          // for pointing inbuf address
+} __attribute__((packed));
+
+struct image_batch_output {
+    int32_t nb_images;
+    int32_t lens[CODEC_IMAGE_BATCH_MAX];
+} __attribute__((packed));
+
+struct audio_decode_input {
+    int32_t inbuf_size;
+    uint8_t inbuf;          // for pointing inbuf address
+} __attribute__((packed));
+
+struct audio_decode_output {
+    int32_t len;
+    int32_t got_frame;
+    uint8_t data;           // for pointing data address
+} __attribute__((packed));
+
+struct audio_encode_input {
+    int32_t inbuf_size;
+    uint8_t inbuf;          // for pointing inbuf address
+} __attribute__((packed));
+
+struct audio_encode_output {
+    int32_t len;
+    uint8_t data;           // for pointing data address
+} __attribute__((packed));
+
+// the reply of a batched audio decode. the samples of all packets follow
+// each other from OFFSET_PICTURE_BUFFER.
+struct audio_decode_batch_output {
+    int32_t nb_packets;
+    AudioData audio;
+    int32_t len[MAX_AUDIO_DECODE_BATCH];
+} __attribute__((packed));
+
+#endif /* __GST_MARU_INTERFACE3_H__ */
@@ -0,0 +1,1078 @@
+/*
+ * GStreamer codec plugin for Tizen Emulator.
+ *
+ * Copyright (C) 2013 Samsung Electronics Co., Ltd. All rights reserved.
+ *
+ * Contact:
+ * KiTae Kim <kt920.kim@samsung.com>
+ * SeokYeon Hwang <syeon.hwang@samsung.com>
+ * YeongKyoon Lee <yeongkyoon.lee@samsung.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Contributors:
+ * - S-Core Co., Ltd
+ *
+ */
+
+/*
+ * in-process stand-in for /dev/brillcodec.
+ *
+ * it speaks the version 3 protocol and answers every request with a null
+ * codec: decoders return gray pictures or silence and encoders return
+ * small empty packets. it lets the plugin run on a host without the
+ * emulator, e.g. to exercise the asynchronous request path.
+ *
+ * GST_MARU_LOOPBACK_DELAY_US delays every request to stand for the work
+ * of a real codec, e.g. to see how fast a flush cancels a slow request.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "gstmaru.h"
+#include "gstmaruinterface.h"
+#include "gstmaruinterface3.h"
+#include "gstmarudevice.h"
+
+#define LOOPBACK_MEM_SIZE       (32 * 1024 * 1024)
+#define LOOPBACK_SLOT_SIZE      (4 * 1024 * 1024)
+#define LOOPBACK_SLOTS          (LOOPBACK_MEM_SIZE / LOOPBACK_SLOT_SIZE)
+
+#define LOOPBACK_WIDTH          352
+#define LOOPBACK_HEIGHT         288
+#define LOOPBACK_FRAME_SIZE     1024
+#define LOOPBACK_PACKET_SIZE    16
+#define LOOPBACK_GOP_SIZE       12
+
+// how long the ring poller spins on an empty sq before it sleeps
+#define LOOPBACK_POLL_IDLE_US   200
+
+typedef struct {
+  int fd;
+  int event_fd;
+  GQueue completions;
+
+  // like the driver, one synchronous request at a time per open file
+  GMutex invoke_lock;
+
+  // request rings
+  struct codec_rings *rings;
+  uint32_t rings_offset;
+  GThread *poller;
+  GMutex ring_lock;
+  GCond ring_cond;
+  GCond cq_cond;
+  gboolean kicked;
+  gint stopping;
+
+  // syscalls the plugin made, to compare the ring and ioctl paths
+  guint ioctls;
+  guint doorbells;
+  guint ring_requests;
+} LoopbackFile;
+
+typedef struct {
+  int32_t media_type;
+  VideoData video;
+  AudioData audio;
+  int64_t frames;
+  guint cancel_gen;
+} LoopbackContext;
+
+typedef struct {
+  int fd;
+  IOCTL_Data data;
+} LoopbackRequest;
+
+static const CodecElement loopback_elements[] = {
+  { CODEC_TYPE_DECODE, AVMEDIA_TYPE_VIDEO, "mpeg4", "MPEG-4 part 2",
+    { .pix_fmts = { PIX_FMT_YUV420P, -1, -1, -1 } } },
+  { CODEC_TYPE_ENCODE, AVMEDIA_TYPE_VIDEO, "mpeg4", "MPEG-4 part 2",
+    { .pix_fmts = { PIX_FMT_YUV420P, -1, -1, -1 } } },
+  { CODEC_TYPE_DECODE, AVMEDIA_TYPE_VIDEO, "mjpeg", "MJPEG (Motion JPEG)",
+    { .pix_fmts = { PIX_FMT_YUVJ420P, -1, -1, -1 } } },
+  { CODEC_TYPE_DECODE, AVMEDIA_TYPE_VIDEO, "h264",
+    "H.264 / AVC / MPEG-4 AVC / MPEG-4 part 10",
+    { .pix_fmts = { PIX_FMT_YUV420P, -1, -1, -1 } } },
+  { CODEC_TYPE_DECODE, AVMEDIA_TYPE_AUDIO, "aac", "AAC (Advanced Audio Coding)",
+    { .sample_fmts = { SAMPLE_FMT_S16, -1, -1, -1 } } },
+  { CODEC_TYPE_ENCODE, AVMEDIA_TYPE_AUDIO, "aac", "AAC (Advanced Audio Coding)",
+    { .sample_fmts = { SAMPLE_FMT_S16, -1, -1, -1 } } },
+};
+
+static struct {
+  GMutex lock;
+  GCond slot_freed;
+  uint8_t *mem;
+  int mem_fd;
+  int mem_users;
+  gboolean slot_used[LOOPBACK_SLOTS];
+  GHashTable *files;
+  GHashTable *contexts;
+  int32_t last_ctx_index;
+  gulong delay_us;
+  GCond cancelled;
+  GThread *worker;
+  GAsyncQueue *requests;
+} loopback;
+
+static LoopbackFile *
+lookup_file (int fd)
+{
+  return g_hash_table_lookup (loopback.files, GINT_TO_POINTER (fd));
+}
+
+//
+// device memory
+//
+
+static gpointer
+loopback_mmap (int fd, size_t size)
+{
+  gpointer mem = MAP_FAILED;
+
+  if (size > LOOPBACK_MEM_SIZE) {
+    errno = EINVAL;
+    return MAP_FAILED;
+  }
+
+  g_mutex_lock (&loopback.lock);
+  if (!loopback.mem) {
+    // backed by a memfd, so that the broker can share it like the
+    // memory of the real device
+    int mem_fd = memfd_create ("maru-loopback", MFD_CLOEXEC);
+
+    if (mem_fd >= 0 && ftruncate (mem_fd, LOOPBACK_MEM_SIZE) == 0) {
+      mem = mmap (NULL, LOOPBACK_MEM_SIZE, PROT_READ | PROT_WRITE,
+          MAP_SHARED, mem_fd, 0);
+    }
+    if (mem != MAP_FAILED) {
+      loopback.mem = mem;
+      loopback.mem_fd = mem_fd;
+    } else if (mem_fd >= 0) {
+      close (mem_fd);
+    }
+  }
+  if (loopback.mem) {
+    loopback.mem_users++;
+    mem = loopback.mem;
+  }
+  g_mutex_unlock (&loopback.lock);
+
+  return mem;
+}
+
+static int
+loopback_munmap (gpointer mem, size_t size)
+{
+  int ret = 0;
+
+  g_mutex_lock (&loopback.lock);
+  if (mem != loopback.mem || loopback.mem_users == 0) {
+    errno = EINVAL;
+    ret = -1;
+  } else if (--loopback.mem_users == 0) {
+    ret = munmap (loopback.mem, LOOPBACK_MEM_SIZE);
+    close (loopback.mem_fd);
+    loopback.mem = NULL;
+  }
+  g_mutex_unlock (&loopback.lock);
+
+  return ret;
+}
+
+int
+gst_maru_loopback_memory_fd (void)
+{
+  int fd = -1;
+
+  g_mutex_lock (&loopback.lock);
+  if (loopback.mem) {
+    fd = dup (loopback.mem_fd);
+  }
+  g_mutex_unlock (&loopback.lock);
+
+  return fd;
+}
+
+// a slot holds one request and later its reply, like a memory block of
+// the real device.
+static int
+secure_slot (int32_t buffer_size, gboolean blocking, uint32_t *mem_offset)
+{
+  int i;
+
+  if (buffer_size > LOOPBACK_SLOT_SIZE - OFFSET_PICTURE_BUFFER) {
+    errno = ENOMEM;
+    return -1;
+  }
+
+  g_mutex_lock (&loopback.lock);
+  for (;;) {
+    for (i = 0; i < LOOPBACK_SLOTS; i++) {
+      if (!loopback.slot_used[i]) {
+        loopback.slot_used[i] = TRUE;
+        g_mutex_unlock (&loopback.lock);
+        *mem_offset = i * LOOPBACK_SLOT_SIZE;
+        return 0;
+      }
+    }
+    if (!blocking) {
+      g_mutex_unlock (&loopback.lock);
+      errno = EBUSY;
+      return -1;
+    }
+    g_cond_wait (&loopback.slot_freed, &loopback.lock);
+  }
+}
+
+static int
+release_slot (uint32_t mem_offset)
+{
+  int i = mem_offset / LOOPBACK_SLOT_SIZE;
+
+  if (i >= LOOPBACK_SLOTS) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  g_mutex_lock (&loopback.lock);
+  loopback.slot_used[i] = FALSE;
+  g_cond_signal (&loopback.slot_freed);
+  g_mutex_unlock (&loopback.lock);
+
+  return 0;
+}
+
+//
+// null codec
+//
+
+static int
+audio_frame_bytes (LoopbackContext *ctx)
+{
+  return ctx->audio.frame_size * ctx->audio.channels * sizeof(int16_t);
+}
+
+static int
+loopback_init (int32_t ctx_index, uint8_t *buffer)
+{
+  LoopbackContext *ctx;
+  uint8_t *p = buffer + sizeof(int32_t);
+  int32_t codec_type;
+  gchar name[32];
+  int i, size = 0;
+
+  memcpy (&codec_type, p, sizeof(codec_type));
+  p += sizeof(codec_type);
+  memcpy (name, p, sizeof(name));
+  p += sizeof(name);
+  name[sizeof(name) - 1] = '\0';
+
+  for (i = 0; i < G_N_ELEMENTS (loopback_elements); i++) {
+    if (loopback_elements[i].codec_type == codec_type &&
+        !strcmp (loopback_elements[i].name, name)) {
+      break;
+    }
+  }
+  if (i == G_N_ELEMENTS (loopback_elements)) {
+    GST_ERROR ("loopback has no codec %s", name);
+    size = -1;
+    memcpy (buffer, &size, sizeof(size));
+    return 0;
+  }
+
+  ctx = g_new0 (LoopbackContext, 1);
+  ctx->media_type = loopback_elements[i].media_type;
+  memcpy (&ctx->video, p, sizeof(VideoData));
+  p += sizeof(VideoData);
+  memcpy (&ctx->audio, p, sizeof(AudioData));
+
+  if (ctx->video.width <= 0 || ctx->video.height <= 0) {
+    ctx->video.width = LOOPBACK_WIDTH;
+    ctx->video.height = LOOPBACK_HEIGHT;
+  }
+  ctx->video.pix_fmt = PIX_FMT_YUV420P;
+  if (ctx->audio.channels <= 0) {
+    ctx->audio.channels = 2;
+  }
+  if (ctx->audio.sample_rate <= 0) {
+    ctx->audio.sample_rate = 44100;
+  }
+  ctx->audio.sample_fmt = SAMPLE_FMT_S16;
+  ctx->audio.frame_size = LOOPBACK_FRAME_SIZE;
+  ctx->audio.bits_per_sample_fmt = 16;
+
+  g_mutex_lock (&loopback.lock);
+  g_hash_table_replace (loopback.contexts, GINT_TO_POINTER (ctx_index), ctx);
+  g_mutex_unlock (&loopback.lock);
+
+  // ret, audio format if any and no codec data
+  p = buffer;
+  memcpy (p, &size, sizeof(size));
+  p += sizeof(size);
+  if (ctx->media_type == AVMEDIA_TYPE_AUDIO) {
+    memcpy (p, &ctx->audio.sample_fmt, sizeof(int32_t));
+    p += sizeof(int32_t);
+    memcpy (p, &ctx->audio.frame_size, sizeof(int32_t));
+    p += sizeof(int32_t);
+    memcpy (p, &ctx->audio.bits_per_sample_fmt, sizeof(int32_t));
+    p += sizeof(int32_t);
+  }
+  memcpy (p, &size, sizeof(size));
+
+  return 0;
+}
+
+// the time the host codec takes. the wait ends early when the requests
+// of the context are cancelled or the deadline passes.
+static int
+loopback_delay (int32_t ctx_index, gint64 deadline)
+{
+  LoopbackContext *ctx;
+  gint64 end, now;
+  guint gen;
+  int err = 0;
+
+  if (!loopback.delay_us) {
+    return 0;
+  }
+
+  end = g_get_monotonic_time () + loopback.delay_us;
+  if (deadline && deadline < end) {
+    end = deadline;
+  }
+
+  g_mutex_lock (&loopback.lock);
+  ctx = g_hash_table_lookup (loopback.contexts, GINT_TO_POINTER (ctx_index));
+  gen = ctx ? ctx->cancel_gen : 0;
+  for (;;) {
+    ctx = g_hash_table_lookup (loopback.contexts, GINT_TO_POINTER (ctx_index));
+    if (ctx && ctx->cancel_gen != gen) {
+      err = ECANCELED;
+      break;
+    }
+    now = g_get_monotonic_time ();
+    if (now >= end) {
+      if (end == deadline) {
+        err = ETIMEDOUT;
+      }
+      break;
+    }
+    g_cond_wait_until (&loopback.cancelled, &loopback.lock, end);
+  }
+  g_mutex_unlock (&loopback.lock);
+
+  if (err) {
+    errno = err;
+    return -1;
+  }
+  return 0;
+}
+
+static void
+loopback_cancel (int32_t ctx_index)
+{
+  LoopbackContext *ctx;
+
+  g_mutex_lock (&loopback.lock);
+  ctx = g_hash_table_lookup (loopback.contexts, GINT_TO_POINTER (ctx_index));
+  if (ctx) {
+    ctx->cancel_gen++;
+    g_cond_broadcast (&loopback.cancelled);
+  }
+  g_mutex_unlock (&loopback.lock);
+}
+
+static int
+loopback_invoke (IOCTL_Data *data, gint64 deadline)
+{
+  LoopbackContext *ctx;
+  uint8_t *buffer = loopback.mem + data->mem_offset;
+  int32_t nb, i;
+  uint8_t *p;
+
+  if (loopback_delay (data->ctx_index, deadline) < 0) {
+    return -1;
+  }
+
+  if (data->api_index == CODEC_INIT) {
+    return loopback_init (data->ctx_index, buffer);
+  }
+
+  g_mutex_lock (&loopback.lock);
+  ctx = g_hash_table_lookup (loopback.contexts,
+      GINT_TO_POINTER (data->ctx_index));
+  if (data->api_index == CODEC_DEINIT) {
+    g_hash_table_remove (loopback.contexts, GINT_TO_POINTER (data->ctx_index));
+    ctx = NULL;
+  }
+  g_mutex_unlock (&loopback.lock);
+
+  switch (data->api_index) {
+  case CODEC_DEINIT:
+  case CODEC_FLUSH_BUFFERS:
+    return 0;
+  case CODEC_PICTURE_COPY:
+  case CODEC_MOSAIC_COPY:
+    if (secure_slot (data->buffer_size, TRUE, &data->mem_offset) < 0) {
+      return -1;
+    }
+    memset (loopback.mem + data->mem_offset, 0x80, data->buffer_size);
+    return 0;
+  default:
+    break;
+  }
+
+  if (!ctx) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  switch (data->api_index) {
+  case CODEC_DECODE_VIDEO:
+  case CODEC_DECODE_VIDEO_AND_PICTURE_COPY:
+  {
+    struct video_decode_input *decode_input =
+      (struct video_decode_input *)(buffer + sizeof(int32_t));
+    struct video_decode_output *decode_output =
+      (struct video_decode_output *)buffer;
+    int32_t len = decode_input->inbuf_size;
+
+    decode_output->len = len;
+    decode_output->got_picture = 1;
+    memcpy (&decode_output->data, &ctx->video, sizeof(VideoData));
+    if (data->api_index == CODEC_DECODE_VIDEO_AND_PICTURE_COPY &&
+        data->buffer_size > 0) {
+      memset (buffer + OFFSET_PICTURE_BUFFER, 0x80,
+          MIN (data->buffer_size, LOOPBACK_SLOT_SIZE - OFFSET_PICTURE_BUFFER));
+    }
+    return 0;
+  }
+  case CODEC_ENCODE_VIDEO:
+  {
+    struct video_encode_output *encode_output =
+      (struct video_encode_output *)buffer;
+
+    encode_output->len = LOOPBACK_PACKET_SIZE;
+    encode_output->coded_frame = 1;
+    encode_output->key_frame = (ctx->frames++ % LOOPBACK_GOP_SIZE) == 0;
+    memset (&encode_output->data, 0, LOOPBACK_PACKET_SIZE);
+    return 0;
+  }
+  case CODEC_DECODE_IMAGE_BATCH:
+  {
+    struct image_batch_output *batch_output =
+      (struct image_batch_output *)buffer;
+    int32_t lens[CODEC_IMAGE_BATCH_MAX];
+
+    // the pictures overwrite the input, take the lengths first
+    memcpy (&nb, buffer + sizeof(int32_t), sizeof(nb));
+    nb = CLAMP (nb, 0, CODEC_IMAGE_BATCH_MAX);
+    p = buffer + sizeof(int32_t) + sizeof(struct image_batch_input);
+    for (i = 0; i < nb; i++) {
+      struct image_batch_entry *entry = (struct image_batch_entry *)p;
+      lens[i] = entry->inbuf_size;
+      p += sizeof(struct image_batch_entry) - 1 + entry->inbuf_size;
+    }
+
+    batch_output->nb_images = nb;
+    memcpy (batch_output->lens, lens, nb * sizeof(int32_t));
+    if (data->buffer_size > 0) {
+      memset (buffer + OFFSET_PICTURE_BUFFER, 0x80,
+          MIN (data->buffer_size, LOOPBACK_SLOT_SIZE - OFFSET_PICTURE_BUFFER));
+    }
+    return 0;
+  }
+  case CODEC_DECODE_VIDEO_TO_MOSAIC:
+  {
+    struct video_mosaic_input *mosaic_input =
+      (struct video_mosaic_input *)(buffer + sizeof(int32_t));
+    struct video_decode_output *decode_output =
+      (struct video_decode_output *)buffer;
+    int32_t len = mosaic_input->inbuf_size;
+    gboolean has_canvas;
+
+    g_mutex_lock (&loopback.lock);
+    has_canvas = g_hash_table_contains (loopback.contexts,
+        GINT_TO_POINTER (mosaic_input->canvas_index));
+    g_mutex_unlock (&loopback.lock);
+    if (!has_canvas) {
+      errno = EINVAL;
+      return -1;
+    }
+
+    decode_output->len = len;
+    decode_output->got_picture = 1;
+    memcpy (&decode_output->data, &ctx->video, sizeof(VideoData));
+    return 0;
+  }
+  case CODEC_DECODE_VIDEO_AND_ENCODE:
+  {
+    struct video_transcode_input *transcode_input =
+      (struct video_transcode_input *)(buffer + sizeof(int32_t));
+    struct video_transcode_output *transcode_output =
+      (struct video_transcode_output *)buffer;
+    int32_t len = transcode_input->inbuf_size;
+    LoopbackContext *encoder;
+
+    g_mutex_lock (&loopback.lock);
+    encoder = g_hash_table_lookup (loopback.contexts,
+        GINT_TO_POINTER (transcode_input->encoder_index));
+    g_mutex_unlock (&loopback.lock);
+    if (!encoder) {
+      errno = EINVAL;
+      return -1;
+    }
+
+    transcode_output->len = len;
+    transcode_output->got_picture = 1;
+    transcode_output->encoded.len = LOOPBACK_PACKET_SIZE;
+    transcode_output->encoded.coded_frame = 1;
+    transcode_output->encoded.key_frame =
+      (encoder->frames++ % LOOPBACK_GOP_SIZE) == 0;
+    memset (&transcode_output->encoded.data, 0, LOOPBACK_PACKET_SIZE);
+    return 0;
+  }
+  case CODEC_ENCODE_VIDEO_BATCH:
+    memcpy (&nb, buffer + sizeof(int32_t), sizeof(nb));
+    memcpy (buffer, &nb, sizeof(nb));
+    p = buffer + sizeof(nb);
+    for (i = 0; i < nb; i++) {
+      struct video_encode_output *encode_output =
+        (struct video_encode_output *)p;
+
+      encode_output->len = LOOPBACK_PACKET_SIZE;
+      encode_output->coded_frame = 1;
+      encode_output->key_frame = (ctx->frames++ % LOOPBACK_GOP_SIZE) == 0;
+      memset (&encode_output->data, 0, LOOPBACK_PACKET_SIZE);
+      p = &encode_output->data + LOOPBACK_PACKET_SIZE;
+    }
+    return 0;
+  case CODEC_DECODE_AUDIO:
+  {
+    struct audio_decode_output *decode_output =
+      (struct audio_decode_output *)buffer;
+
+    decode_output->len = audio_frame_bytes (ctx);
+    decode_output->got_frame = 1;
+    memcpy (&decode_output->data, &ctx->audio, sizeof(AudioData));
+    memset (buffer + OFFSET_PICTURE_BUFFER, 0, decode_output->len);
+    return 0;
+  }
+  case CODEC_DECODE_AUDIO_BATCH:
+  {
+    struct audio_decode_batch_output *decode_output =
+      (struct audio_decode_batch_output *)buffer;
+
+    memcpy (&nb, buffer + sizeof(int32_t), sizeof(nb));
+    nb = CLAMP (nb, 0, MAX_AUDIO_DECODE_BATCH);
+    decode_output->nb_packets = nb;
+    memcpy (&decode_output->audio, &ctx->audio, sizeof(AudioData));
+    for (i = 0; i < nb; i++) {
+      decode_output->len[i] = audio_frame_bytes (ctx);
+    }
+    memset (buffer + OFFSET_PICTURE_BUFFER, 0, nb * audio_frame_bytes (ctx));
+    return 0;
+  }
+  case CODEC_ENCODE_AUDIO:
+  {
+    struct audio_encode_output *encode_output =
+      (struct audio_encode_output *)buffer;
+
+    encode_output->len = LOOPBACK_PACKET_SIZE;
+    memset (&encode_output->data, 0, LOOPBACK_PACKET_SIZE);
+    return 0;
+  }
+  case CODEC_ENCODE_AUDIO_BATCH:
+    memcpy (&nb, buffer + sizeof(int32_t), sizeof(nb));
+    memcpy (buffer, &nb, sizeof(nb));
+    p = buffer + sizeof(nb);
+    for (i = 0; i < nb; i++) {
+      struct audio_encode_output *encode_output =
+        (struct audio_encode_output *)p;
+
+      encode_output->len = LOOPBACK_PACKET_SIZE;
+      memset (&encode_output->data, 0, LOOPBACK_PACKET_SIZE);
+      p = &encode_output->data + LOOPBACK_PACKET_SIZE;
+    }
+    return 0;
+  default:
+    GST_ERROR ("loopback does not handle api %d", data->api_index);
+    errno = EINVAL;
+    return -1;
+  }
+}
+
+//
+// asynchronous requests
+//
+
+static gpointer
+loopback_worker (gpointer unused)
+{
+  LoopbackRequest *request;
+  IOCTL_Completion *completion;
+  LoopbackFile *file;
+  uint64_t one = 1;
+
+  while ((request = g_async_queue_pop (loopback.requests))->fd >= 0) {
+    completion = g_new (IOCTL_Completion, 1);
+    completion->ctx_index = request->data.ctx_index;
+    completion->api_index = request->data.api_index;
+
+    // like on the rings, the sequence number is only echoed
+    request->data.api_index &= CODEC_RING_API_MASK;
+    completion->ret = loopback_invoke (&request->data, 0);
+    completion->mem_offset = request->data.mem_offset;
+
+    g_mutex_lock (&loopback.lock);
+    file = lookup_file (request->fd);
+    if (file) {
+      g_queue_push_tail (&file->completions, completion);
+      if (file->event_fd >= 0 &&
+          write (file->event_fd, &one, sizeof(one)) < 0) {
+        GST_ERROR ("failed to signal eventfd %d", file->event_fd);
+      }
+    } else {
+      g_free (completion);
+    }
+    g_mutex_unlock (&loopback.lock);
+
+    g_free (request);
+  }
+  g_free (request);
+
+  return NULL;
+}
+
+static int
+loopback_submit (int fd, IOCTL_Data *data)
+{
+  LoopbackRequest *request = g_new (LoopbackRequest, 1);
+
+  request->fd = fd;
+  request->data = *data;
+
+  g_mutex_lock (&loopback.lock);
+  if (!loopback.worker) {
+    loopback.requests = g_async_queue_new ();
+    loopback.worker =
+      g_thread_new ("maru-loopback", loopback_worker, NULL);
+  }
+  g_mutex_unlock (&loopback.lock);
+
+  g_async_queue_push (loopback.requests, request);
+
+  return 0;
+}
+
+//
+// request rings
+//
+
+static void
+signal_completion (LoopbackFile *file)
+{
+  uint64_t one = 1;
+
+  g_mutex_lock (&loopback.lock);
+  if (file->event_fd >= 0 &&
+      write (file->event_fd, &one, sizeof(one)) < 0) {
+    GST_ERROR ("failed to signal eventfd %d", file->event_fd);
+  }
+  g_mutex_unlock (&loopback.lock);
+}
+
+static void
+post_completion (LoopbackFile *file, IOCTL_Data *data, int ret)
+{
+  struct codec_cq_ring *cq = &file->rings->cq;
+  IOCTL_Completion *entry;
+  uint32_t tail = cq->tail;
+
+  while (tail - __atomic_load_n (&cq->head, __ATOMIC_ACQUIRE) >= CODEC_RING_ENTRIES) {
+    if (g_atomic_int_get (&file->stopping)) {
+      return;
+    }
+    g_usleep (LOOPBACK_POLL_IDLE_US);
+  }
+
+  entry = &cq->entries[tail % CODEC_RING_ENTRIES];
+  entry->ctx_index = data->ctx_index;
+  entry->api_index = data->api_index;
+  entry->mem_offset = data->mem_offset;
+  entry->ret = ret;
+  __atomic_store_n (&cq->tail, tail + 1, __ATOMIC_SEQ_CST);
+
+  g_mutex_lock (&file->ring_lock);
+  g_cond_broadcast (&file->cq_cond);
+  g_mutex_unlock (&file->ring_lock);
+
+  // the plugin may have found the cq empty just before, wake it up.
+  if (__atomic_load_n (&cq->head, __ATOMIC_SEQ_CST) == tail) {
+    signal_completion (file);
+  }
+}
+
+static gpointer
+loopback_poller (gpointer user_data)
+{
+  LoopbackFile *file = user_data;
+  struct codec_sq_ring *sq = &file->rings->sq;
+  gint64 idle_since = 0;
+  int ret;
+  IOCTL_Data data, request;
+  uint32_t head;
+
+  while (!g_atomic_int_get (&file->stopping)) {
+    head = sq->head;
+    if (head != __atomic_load_n (&sq->tail, __ATOMIC_ACQUIRE)) {
+      data = sq->entries[head % CODEC_RING_ENTRIES];
+      __atomic_store_n (&sq->head, head + 1, __ATOMIC_RELEASE);
+      g_atomic_int_inc ((gint *) &file->ring_requests);
+
+      // the sequence number is only echoed in the completion
+      request = data;
+      request.api_index &= CODEC_RING_API_MASK;
+      ret = loopback_invoke (&request, 0);
+      data.mem_offset = request.mem_offset;
+      post_completion (file, &data, ret);
+      idle_since = 0;
+      continue;
+    }
+
+    if (!idle_since) {
+      idle_since = g_get_monotonic_time ();
+    }
+    if (g_get_monotonic_time () - idle_since < LOOPBACK_POLL_IDLE_US) {
+      g_thread_yield ();
+      continue;
+    }
+
+    // from now on a submission needs the doorbell. check the tail once
+    // more, the plugin may have missed the flag.
+    __atomic_store_n (&sq->flags, CODEC_RING_NEED_WAKEUP, __ATOMIC_SEQ_CST);
+    if (head == __atomic_load_n (&sq->tail, __ATOMIC_SEQ_CST)) {
+      g_mutex_lock (&file->ring_lock);
+      while (!file->kicked && !g_atomic_int_get (&file->stopping)) {
+        g_cond_wait (&file->ring_cond, &file->ring_lock);
+      }
+      file->kicked = FALSE;
+      g_mutex_unlock (&file->ring_lock);
+    }
+    __atomic_store_n (&sq->flags, 0, __ATOMIC_SEQ_CST);
+    idle_since = 0;
+  }
+
+  return NULL;
+}
+
+static int
+loopback_setup_rings (LoopbackFile *file, IOCTL_Data *data)
+{
+  if (!file->rings) {
+    // the rings keep the memory mapped until the poller is gone.
+    g_mutex_lock (&loopback.lock);
+    if (!loopback.mem) {
+      g_mutex_unlock (&loopback.lock);
+      errno = EINVAL;
+      return -1;
+    }
+    loopback.mem_users++;
+    g_mutex_unlock (&loopback.lock);
+
+    if (secure_slot (sizeof(struct codec_rings), FALSE,
+          &file->rings_offset) < 0) {
+      loopback_munmap (loopback.mem, LOOPBACK_MEM_SIZE);
+      return -1;
+    }
+    file->rings = (struct codec_rings *)(loopback.mem + file->rings_offset);
+    memset (file->rings, 0, sizeof(struct codec_rings));
+    file->poller = g_thread_new ("maru-loopback-ring", loopback_poller, file);
+  }
+
+  data->mem_offset = file->rings_offset;
+  data->buffer_size = sizeof(struct codec_rings);
+
+  return 0;
+}
+
+static void
+loopback_ring_doorbell (LoopbackFile *file)
+{
+  g_atomic_int_inc ((gint *) &file->doorbells);
+
+  g_mutex_lock (&file->ring_lock);
+  file->kicked = TRUE;
+  g_cond_signal (&file->ring_cond);
+  g_mutex_unlock (&file->ring_lock);
+}
+
+static int
+loopback_wait_completion (LoopbackFile *file, IOCTL_Data *data)
+{
+  if (!file->rings) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  g_mutex_lock (&file->ring_lock);
+  while (__atomic_load_n (&file->rings->cq.tail, __ATOMIC_SEQ_CST) ==
+      data->mem_offset && !g_atomic_int_get (&file->stopping)) {
+    g_cond_wait (&file->cq_cond, &file->ring_lock);
+  }
+  g_mutex_unlock (&file->ring_lock);
+
+  return 0;
+}
+
+static void
+loopback_release_rings (LoopbackFile *file)
+{
+  if (!file->rings) {
+    return;
+  }
+
+  g_mutex_lock (&file->ring_lock);
+  g_atomic_int_set (&file->stopping, TRUE);
+  g_cond_signal (&file->ring_cond);
+  g_cond_broadcast (&file->cq_cond);
+  g_mutex_unlock (&file->ring_lock);
+  g_thread_join (file->poller);
+
+  release_slot (file->rings_offset);
+  loopback_munmap (loopback.mem, LOOPBACK_MEM_SIZE);
+  file->rings = NULL;
+}
+
+static int
+loopback_get_completion (int fd, IOCTL_Completion *data)
+{
+  IOCTL_Completion *completion;
+  LoopbackFile *file;
+
+  g_mutex_lock (&loopback.lock);
+  file = lookup_file (fd);
+  completion = file ? g_queue_pop_head (&file->completions) : NULL;
+  g_mutex_unlock (&loopback.lock);
+
+  if (!completion) {
+    errno = EAGAIN;
+    return -1;
+  }
+
+  *data = *completion;
+  g_free (completion);
+
+  return 0;
+}
+
+//
+// CodecDeviceOps
+//
+
+static int
+loopback_open (void)
+{
+  LoopbackFile *file;
+  int fd;
+
+  // an eventfd is the cheapest way to own a real file descriptor.
+  fd = eventfd (0, EFD_CLOEXEC);
+  if (fd < 0) {
+    return -1;
+  }
+
+  file = g_new0 (LoopbackFile, 1);
+  file->fd = fd;
+  file->event_fd = -1;
+  g_queue_init (&file->completions);
+  g_mutex_init (&file->invoke_lock);
+  g_mutex_init (&file->ring_lock);
+  g_cond_init (&file->ring_cond);
+  g_cond_init (&file->cq_cond);
+
+  g_mutex_lock (&loopback.lock);
+  if (!loopback.files) {
+    loopback.files = g_hash_table_new (g_direct_hash, g_direct_equal);
+    loopback.contexts =
+      g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, g_free);
+    if (g_getenv ("GST_MARU_LOOPBACK_DELAY_US")) {
+      loopback.delay_us =
+        g_ascii_strtoull (g_getenv ("GST_MARU_LOOPBACK_DELAY_US"), NULL, 10);
+    }
+  }
+  g_hash_table_insert (loopback.files, GINT_TO_POINTER (fd), file);
+  g_mutex_unlock (&loopback.lock);
+
+  return fd;
+}
+
+static int
+loopback_close (int fd)
+{
+  LoopbackFile *file;
+  GThread *worker = NULL;
+
+  g_mutex_lock (&loopback.lock);
+  file = lookup_file (fd);
+  if (!file) {
+    g_mutex_unlock (&loopback.lock);
+    errno = EBADF;
+    return -1;
+  }
+  g_hash_table_remove (loopback.files, GINT_TO_POINTER (fd));
+  g_mutex_unlock (&loopback.lock);
+
+  loopback_release_rings (file);
+  GST_INFO ("loopback %d: %u ioctls, %u doorbells, %u requests from rings",
+    fd, file->ioctls, file->doorbells, file->ring_requests);
+
+  g_queue_foreach (&file->completions, (GFunc) g_free, NULL);
+  g_queue_clear (&file->completions);
+  g_mutex_clear (&file->invoke_lock);
+  g_mutex_clear (&file->ring_lock);
+  g_cond_clear (&file->ring_cond);
+  g_cond_clear (&file->cq_cond);
+  g_free (file);
+
+  g_mutex_lock (&loopback.lock);
+  if (g_hash_table_size (loopback.files) == 0 && loopback.worker) {
+    LoopbackRequest *stop = g_new0 (LoopbackRequest, 1);
+
+    stop->fd = -1;
+    g_async_queue_push (loopback.requests, stop);
+    worker = loopback.worker;
+    loopback.worker = NULL;
+  }
+  g_mutex_unlock (&loopback.lock);
+
+  if (worker) {
+    g_thread_join (worker);
+    g_async_queue_unref (loopback.requests);
+    loopback.requests = NULL;
+  }
+
+  return close (fd);
+}
+
+static int
+loopback_ioctl (int fd, unsigned long request, void *data)
+{
+  IOCTL_Data *ioctl_data = data;
+  LoopbackFile *file;
+  int ret;
+
+  g_mutex_lock (&loopback.lock);
+  file = lookup_file (fd);
+  g_mutex_unlock (&loopback.lock);
+  if (!file) {
+    errno = EBADF;
+    return -1;
+  }
+  g_atomic_int_inc ((gint *) &file->ioctls);
+
+  switch (_IOC_NR (request)) {
+  case IOCTL_CMD_GET_VERSION:
+    *(uint32_t *)data = 3;
+    return 0;
+  case IOCTL_CMD_GET_ELEMENTS_SIZE:
+    *(uint32_t *)data = sizeof(loopback_elements);
+    return 0;
+  case IOCTL_CMD_GET_ELEMENTS:
+    memcpy (data, loopback_elements, sizeof(loopback_elements));
+    return 0;
+  case IOCTL_CMD_GET_CONTEXT_INDEX:
+    g_mutex_lock (&loopback.lock);
+    *(int *)data = ++loopback.last_ctx_index;
+    g_mutex_unlock (&loopback.lock);
+    return 0;
+  case IOCTL_CMD_SECURE_BUFFER:
+    return secure_slot (ioctl_data->buffer_size, TRUE,
+        &ioctl_data->mem_offset);
+  case IOCTL_CMD_TRY_SECURE_BUFFER:
+    return secure_slot (ioctl_data->buffer_size, FALSE,
+        &ioctl_data->mem_offset);
+  case IOCTL_CMD_RELEASE_BUFFER:
+    return release_slot (*(uint32_t *)data);
+  case IOCTL_CMD_INVOKE_API_AND_GET_DATA:
+    g_mutex_lock (&file->invoke_lock);
+    ret = loopback_invoke (ioctl_data, 0);
+    g_mutex_unlock (&file->invoke_lock);
+    return ret;
+  case IOCTL_CMD_INVOKE_API_TIMED:
+  {
+    IOCTL_TimedData *timed_data = data;
+    gint64 deadline = g_get_monotonic_time () +
+      (gint64) timed_data->timeout_ms * G_TIME_SPAN_MILLISECOND;
+
+    g_mutex_lock (&file->invoke_lock);
+    ret = loopback_invoke (&timed_data->data, deadline);
+    g_mutex_unlock (&file->invoke_lock);
+    return ret;
+  }
+  case IOCTL_CMD_CANCEL_REQUESTS:
+    loopback_cancel (ioctl_data->ctx_index);
+    return 0;
+  case IOCTL_CMD_GET_CAPABILITIES:
+  {
+    IOCTL_Capabilities *caps = data;
+
+    caps->flags = CODEC_CAP_DECODE_AND_COPY | CODEC_CAP_VIDEO_ENCODE_BATCH |
+      CODEC_CAP_AUDIO_DECODE_BATCH | CODEC_CAP_AUDIO_ENCODE_BATCH |
+      CODEC_CAP_ASYNC | CODEC_CAP_RINGS | CODEC_CAP_TIMED |
+      CODEC_CAP_TRY_SECURE | CODEC_CAP_TRANSCODE | CODEC_CAP_MOSAIC |
+      CODEC_CAP_IMAGE_BATCH;
+    caps->mem_size = LOOPBACK_MEM_SIZE;
+    return 0;
+  }
+  case IOCTL_CMD_GET_PROFILE_STATUS:
+    *(uint8_t *)data = 0;
+    return 0;
+  case IOCTL_CMD_REGISTER_EVENTFD:
+    g_mutex_lock (&loopback.lock);
+    file->event_fd = *(int32_t *)data;
+    g_mutex_unlock (&loopback.lock);
+    return 0;
+  case IOCTL_CMD_INVOKE_API_ASYNC:
+    return loopback_submit (fd, ioctl_data);
+  case IOCTL_CMD_GET_COMPLETION:
+    return loopback_get_completion (fd, data);
+  case IOCTL_CMD_SETUP_RINGS:
+    return loopback_setup_rings (file, ioctl_data);
+  case IOCTL_CMD_RING_DOORBELL:
+    loopback_ring_doorbell (file);
+    return 0;
+  case IOCTL_CMD_WAIT_COMPLETION:
+    return loopback_wait_completion (file, ioctl_data);
+  default:
+    errno = ENOTTY;
+    return -1;
+  }
+}
+
+CodecDeviceOps *device_ops_loopback = &(CodecDeviceOps) {
+  .open = loopback_open,
+  .close = loopback_close,
+  .ioctl = loopback_ioctl,
+  .mmap = loopback_mmap,
+  .munmap = loopback_munmap,
+};
@@ -61,11 +61,18 @@ codec_init_data_to (CodecContext *ctx, CodecElement *codec, gpointer buffer)
 
   // copy VideoData, AudioData, bit_rate, codec_tag and codecdata_size
   // into device memory. the size of codecdata is variable.
-  memcpy (buffer + size, ctx, sizeof(CodecContext) - 12);
-  size += (sizeof(CodecContext) - 12);
+  memcpy (buffer + size, ctx, offsetof(CodecContext, codecdata));
+  size += offsetof(CodecContext, codecdata);
   memcpy (buffer + size, ctx->codecdata, ctx->codecdata_size);
   size += ctx->codecdata_size;
 
+  // optional trailer, left out by default so the request stays the same
+  // for hosts that do not know it.
+  if (ctx->skip_frame != SKIP_FRAME_NONE) {
+    memcpy (buffer + size, &ctx->skip_frame, sizeof(ctx->skip_frame));
+    size += sizeof(ctx->skip_frame);
+  }
+
   // data length
   size -= sizeof(size);
   memcpy (buffer, &size, sizeof(size));
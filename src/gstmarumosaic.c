@@ -0,0 +1,748 @@
+/* GStreamer
+ * Copyright (C) <1999> Erik Walthinsen <omega@cse.ogi.edu>
+ * Copyright (C) 2013 Samsung Electronics Co., Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "gstmarudevice.h"
+#include "gstmaruutils.h"
+#include "gstmaruinterface.h"
+
+/* maru_mosaic decodes every stream linked to it into a cell of one
+ * canvas the host keeps, and copies the canvas out once per output frame
+ * instead of copying every picture and compositing them in the guest.
+ *
+ * sink_N goes to column N % columns and row N / columns. the canvas
+ * belongs to the context of the first stream opened, a canvas is copied
+ * out when a stream has a picture for the next output frame.
+ */
+
+enum
+{
+  ARG_0,
+  ARG_WIDTH,
+  ARG_HEIGHT,
+  ARG_COLUMNS,
+  ARG_ROWS,
+  ARG_FRAMERATE,
+  ARG_PRIORITY
+};
+
+typedef struct {
+  GstPad *pad;
+  guint index;
+
+  CodecElement *decoder;
+  CodecContext *context;
+  CodecDevice *dev;
+  gboolean opened;
+
+  GstSegment segment;
+  gboolean eos;
+  MosaicRegion region;
+} MosaicStream;
+
+typedef struct _GstMaruMosaic
+{
+  GstElement element;
+
+  GstPad *srcpad;
+
+  /* guards the streams, the canvas and the output time */
+  GMutex lock;
+  /* held while the canvas is copied out and pushed, so frames leave in
+   * order and the canvas stays. guards started. taken before lock. */
+  GMutex output_lock;
+  GList *streams;
+  MosaicStream *canvas;
+  gboolean started;
+  gboolean flushing;
+  GstClockTime next_time;
+  gint out_size;
+
+  /* properties */
+  gint width, height;
+  gint columns, rows;
+  gint fps_n, fps_d;
+  gint priority;
+} GstMaruMosaic;
+
+typedef struct _GstMaruMosaicClass
+{
+  GstElementClass parent_class;
+} GstMaruMosaicClass;
+
+#define DEFAULT_WIDTH       1280
+#define DEFAULT_HEIGHT      720
+#define DEFAULT_COLUMNS     4
+#define DEFAULT_ROWS        4
+#define DEFAULT_PRIORITY    CODEC_PRIORITY_NORMAL
+#define MAX_CELLS           64
+
+G_DEFINE_TYPE (GstMaruMosaic, gst_marumosaic, GST_TYPE_ELEMENT);
+
+/* decoders the sink template and the negotiation choose from */
+static GList *mosaic_codecs = NULL;
+
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS (GST_VIDEO_CAPS_MAKE ("I420")));
+
+static void gst_marumosaic_finalize (GObject *object);
+static void gst_marumosaic_set_property (GObject * object,
+    guint prop_id, const GValue * value, GParamSpec * pspec);
+static void gst_marumosaic_get_property (GObject * object,
+    guint prop_id, GValue * value, GParamSpec * pspec);
+static GstPad *gst_marumosaic_request_new_pad (GstElement *element,
+    GstPadTemplate *templ, const gchar *name, const GstCaps *caps);
+static void gst_marumosaic_release_pad (GstElement *element, GstPad *pad);
+static GstStateChangeReturn gst_marumosaic_change_state (GstElement *element,
+    GstStateChange transition);
+static gboolean gst_marumosaic_sink_event (GstPad *pad, GstObject *parent,
+    GstEvent *event);
+static GstFlowReturn gst_marumosaic_chain (GstPad *pad, GstObject *parent,
+    GstBuffer *buffer);
+
+static void
+gst_marumosaic_class_init (GstMaruMosaicClass *klass)
+{
+  GST_DEBUG (" >> ENTER");
+  GObjectClass *gobject_class = (GObjectClass *) klass;
+  GstElementClass *element_class = (GstElementClass *) klass;
+
+  gobject_class->set_property = gst_marumosaic_set_property;
+  gobject_class->get_property = gst_marumosaic_get_property;
+  gobject_class->finalize = gst_marumosaic_finalize;
+
+  g_object_class_install_property (gobject_class, ARG_WIDTH,
+      g_param_spec_int ("width", "Width",
+      "Width of the output frame", 16, 8192, DEFAULT_WIDTH,
+      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, ARG_HEIGHT,
+      g_param_spec_int ("height", "Height",
+      "Height of the output frame", 16, 8192, DEFAULT_HEIGHT,
+      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, ARG_COLUMNS,
+      g_param_spec_int ("columns", "Columns",
+      "Number of cells in a row", 1, MAX_CELLS, DEFAULT_COLUMNS,
+      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, ARG_ROWS,
+      g_param_spec_int ("rows", "Rows",
+      "Number of cells in a column", 1, MAX_CELLS, DEFAULT_ROWS,
+      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, ARG_FRAMERATE,
+      gst_param_spec_fraction ("framerate", "Framerate",
+      "Output frames per second", 1, 1, 120, 1, 25, 1,
+      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, ARG_PRIORITY,
+      g_param_spec_enum ("priority", "Priority",
+      "Which streams the device serves first",
+      GST_MARU_TYPE_PRIORITY, DEFAULT_PRIORITY,
+      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  gst_element_class_set_metadata (element_class,
+      "Maru video mosaic",
+      "Codec/Decoder/Video",
+      "Decodes several video streams into the cells of one frame on the codec device",
+      "Sooyoung Ha <yoosah.ha@samsung.com>");
+
+  gst_element_class_add_pad_template (element_class,
+      gst_pad_template_new ("sink_%u", GST_PAD_SINK, GST_PAD_REQUEST,
+          gst_maru_codecs_to_caps (mosaic_codecs,
+              CODEC_TYPE_DECODE, AVMEDIA_TYPE_VIDEO)));
+  gst_element_class_add_static_pad_template (element_class, &src_template);
+
+  element_class->request_new_pad = gst_marumosaic_request_new_pad;
+  element_class->release_pad = gst_marumosaic_release_pad;
+  element_class->change_state = gst_marumosaic_change_state;
+}
+
+static void
+gst_marumosaic_init (GstMaruMosaic *marumosaic)
+{
+  GST_DEBUG (" >> ENTER");
+  marumosaic->srcpad = gst_pad_new_from_static_template (&src_template, "src");
+  gst_pad_use_fixed_caps (marumosaic->srcpad);
+  gst_element_add_pad (GST_ELEMENT (marumosaic), marumosaic->srcpad);
+
+  g_mutex_init (&marumosaic->lock);
+  g_mutex_init (&marumosaic->output_lock);
+  marumosaic->next_time = GST_CLOCK_TIME_NONE;
+
+  marumosaic->width = DEFAULT_WIDTH;
+  marumosaic->height = DEFAULT_HEIGHT;
+  marumosaic->columns = DEFAULT_COLUMNS;
+  marumosaic->rows = DEFAULT_ROWS;
+  marumosaic->fps_n = 25;
+  marumosaic->fps_d = 1;
+  marumosaic->priority = DEFAULT_PRIORITY;
+}
+
+static void
+gst_marumosaic_stream_close (MosaicStream *stream)
+{
+  if (stream->opened) {
+    gst_maru_avcodec_close (stream->context, stream->dev);
+    stream->opened = FALSE;
+  }
+}
+
+static void
+gst_marumosaic_stream_free (MosaicStream *stream)
+{
+  gst_marumosaic_stream_close (stream);
+  g_free (stream->context);
+  g_free (stream->dev);
+  g_free (stream);
+}
+
+/* closes every stream, the canvas goes with the context it belongs to */
+static void
+gst_marumosaic_close (GstMaruMosaic *marumosaic)
+{
+  GST_DEBUG (" >> ENTER");
+  GList *elem;
+
+  g_mutex_lock (&marumosaic->output_lock);
+  g_mutex_lock (&marumosaic->lock);
+  for (elem = marumosaic->streams; elem; elem = elem->next) {
+    gst_marumosaic_stream_close ((MosaicStream *)elem->data);
+  }
+  if (marumosaic->canvas && !marumosaic->canvas->pad) {
+    // its pad was released before
+    gst_marumosaic_stream_free (marumosaic->canvas);
+  }
+  marumosaic->canvas = NULL;
+  marumosaic->started = FALSE;
+  marumosaic->flushing = FALSE;
+  marumosaic->next_time = GST_CLOCK_TIME_NONE;
+  g_mutex_unlock (&marumosaic->lock);
+  g_mutex_unlock (&marumosaic->output_lock);
+}
+
+static void
+gst_marumosaic_finalize (GObject *object)
+{
+  GST_DEBUG (" >> ENTER");
+  GstMaruMosaic *marumosaic = (GstMaruMosaic *) object;
+
+  gst_marumosaic_close (marumosaic);
+  g_list_free_full (marumosaic->streams,
+      (GDestroyNotify) gst_marumosaic_stream_free);
+  g_mutex_clear (&marumosaic->lock);
+  g_mutex_clear (&marumosaic->output_lock);
+
+  G_OBJECT_CLASS (gst_marumosaic_parent_class)->finalize (object);
+}
+
+static GstPad *
+gst_marumosaic_request_new_pad (GstElement *element, GstPadTemplate *templ,
+    const gchar *name, const GstCaps *caps)
+{
+  GST_DEBUG (" >> ENTER");
+  GstMaruMosaic *marumosaic = (GstMaruMosaic *) element;
+  MosaicStream *stream;
+  gint cell_width, cell_height;
+  gchar *pad_name;
+  guint index = 0;
+  GList *elem;
+
+  g_mutex_lock (&marumosaic->lock);
+  if (name && sscanf (name, "sink_%u", &index) == 1) {
+    for (elem = marumosaic->streams; elem; elem = elem->next) {
+      if (((MosaicStream *)elem->data)->index == index) {
+        g_mutex_unlock (&marumosaic->lock);
+        GST_ERROR_OBJECT (marumosaic, "pad %s exists already", name);
+        return NULL;
+      }
+    }
+  } else {
+    // the first free cell
+    for (elem = marumosaic->streams; elem; ) {
+      if (((MosaicStream *)elem->data)->index == index) {
+        index++;
+        elem = marumosaic->streams;
+      } else {
+        elem = elem->next;
+      }
+    }
+  }
+
+  if (index >= (guint)(marumosaic->columns * marumosaic->rows)) {
+    g_mutex_unlock (&marumosaic->lock);
+    GST_ERROR_OBJECT (marumosaic, "no cell for sink_%u in %dx%d", index,
+        marumosaic->columns, marumosaic->rows);
+    return NULL;
+  }
+
+  stream = g_new0 (MosaicStream, 1);
+  stream->index = index;
+  // instead of AVCodecContext
+  stream->context = g_malloc0 (sizeof(CodecContext));
+  stream->context->video.pix_fmt = PIX_FMT_NONE;
+  stream->context->audio.sample_fmt = SAMPLE_FMT_NONE;
+  stream->context->priority = marumosaic->priority;
+  stream->dev = g_malloc0 (sizeof(CodecDevice));
+  gst_segment_init (&stream->segment, GST_FORMAT_TIME);
+
+  // cells start at even lines and columns for the chroma planes
+  cell_width = (marumosaic->width / marumosaic->columns) & ~1;
+  cell_height = (marumosaic->height / marumosaic->rows) & ~1;
+  stream->region.canvas_width = marumosaic->width;
+  stream->region.canvas_height = marumosaic->height;
+  stream->region.pix_fmt = PIX_FMT_YUV420P;
+  stream->region.x = (index % marumosaic->columns) * cell_width;
+  stream->region.y = (index / marumosaic->columns) * cell_height;
+  stream->region.width = cell_width;
+  stream->region.height = cell_height;
+
+  pad_name = g_strdup_printf ("sink_%u", index);
+  stream->pad = gst_pad_new_from_template (templ, pad_name);
+  g_free (pad_name);
+  gst_pad_set_element_private (stream->pad, stream);
+  gst_pad_set_chain_function (stream->pad,
+      GST_DEBUG_FUNCPTR (gst_marumosaic_chain));
+  gst_pad_set_event_function (stream->pad,
+      GST_DEBUG_FUNCPTR (gst_marumosaic_sink_event));
+
+  marumosaic->streams = g_list_append (marumosaic->streams, stream);
+  g_mutex_unlock (&marumosaic->lock);
+
+  gst_pad_set_active (stream->pad, TRUE);
+  gst_element_add_pad (element, stream->pad);
+
+  return stream->pad;
+}
+
+static void
+gst_marumosaic_release_pad (GstElement *element, GstPad *pad)
+{
+  GST_DEBUG (" >> ENTER");
+  GstMaruMosaic *marumosaic = (GstMaruMosaic *) element;
+  MosaicStream *stream = gst_pad_get_element_private (pad);
+
+  g_mutex_lock (&marumosaic->output_lock);
+  g_mutex_lock (&marumosaic->lock);
+  marumosaic->streams = g_list_remove (marumosaic->streams, stream);
+  stream->pad = NULL;
+  if (stream != marumosaic->canvas) {
+    gst_marumosaic_stream_free (stream);
+  }
+  // else the canvas stays until the mosaic stops
+  g_mutex_unlock (&marumosaic->lock);
+  g_mutex_unlock (&marumosaic->output_lock);
+
+  gst_element_remove_pad (element, pad);
+}
+
+static gboolean
+gst_marumosaic_setcaps (GstMaruMosaic *marumosaic, MosaicStream *stream,
+    GstCaps *caps)
+{
+  GST_DEBUG (" >> ENTER");
+  CodecElement *decoder;
+  gboolean ret = TRUE;
+
+  decoder = gst_maru_caps_to_codec (mosaic_codecs, caps,
+      CODEC_TYPE_DECODE, AVMEDIA_TYPE_VIDEO);
+  if (!decoder) {
+    GST_ERROR_OBJECT (marumosaic, "no decoder for %" GST_PTR_FORMAT, caps);
+    return FALSE;
+  }
+
+  g_mutex_lock (&marumosaic->output_lock);
+  g_mutex_lock (&marumosaic->lock);
+  if (stream->opened && stream == marumosaic->canvas) {
+    // the canvas goes with the context, the next stream opened starts
+    // a new one
+    marumosaic->canvas = NULL;
+  }
+  gst_marumosaic_stream_close (stream);
+
+  stream->decoder = decoder;
+  gst_maru_caps_with_codecname (decoder->name, decoder->media_type,
+      caps, stream->context);
+  if (!stream->context->video.fps_d || !stream->context->video.fps_n) {
+    GST_DEBUG_OBJECT (marumosaic, "forcing 25/1 framerate");
+    stream->context->video.fps_n = 1;
+    stream->context->video.fps_d = 25;
+  }
+
+  if (gst_maru_avcodec_open (stream->context, decoder, stream->dev) < 0) {
+    GST_ERROR_OBJECT (marumosaic, "failed to open maru_%sdec for sink_%u",
+        decoder->name, stream->index);
+    ret = FALSE;
+  } else {
+    stream->opened = TRUE;
+    if (!marumosaic->canvas) {
+      marumosaic->canvas = stream;
+    }
+  }
+  g_mutex_unlock (&marumosaic->lock);
+  g_mutex_unlock (&marumosaic->output_lock);
+
+  return ret;
+}
+
+/* stream-start, caps and segment of the output, before its first frame */
+static gboolean
+gst_marumosaic_start (GstMaruMosaic *marumosaic)
+{
+  GST_DEBUG (" >> ENTER");
+  GstVideoInfo info;
+  GstSegment segment;
+  GstCaps *caps;
+  gchar *stream_id;
+  gboolean ret;
+
+  gst_video_info_set_format (&info, GST_VIDEO_FORMAT_I420,
+      marumosaic->width, marumosaic->height);
+  GST_VIDEO_INFO_FPS_N (&info) = marumosaic->fps_n;
+  GST_VIDEO_INFO_FPS_D (&info) = marumosaic->fps_d;
+  marumosaic->out_size = gst_maru_avpicture_size (PIX_FMT_YUV420P,
+      marumosaic->width, marumosaic->height);
+
+  stream_id = gst_pad_create_stream_id (marumosaic->srcpad,
+      GST_ELEMENT (marumosaic), NULL);
+  gst_pad_push_event (marumosaic->srcpad, gst_event_new_stream_start (stream_id));
+  g_free (stream_id);
+
+  caps = gst_video_info_to_caps (&info);
+  ret = gst_pad_push_event (marumosaic->srcpad, gst_event_new_caps (caps));
+  gst_caps_unref (caps);
+  if (!ret) {
+    return FALSE;
+  }
+
+  gst_segment_init (&segment, GST_FORMAT_TIME);
+  gst_pad_push_event (marumosaic->srcpad, gst_event_new_segment (&segment));
+
+  marumosaic->started = TRUE;
+  return TRUE;
+}
+
+/* copies the canvas out if a picture at running_time is due. the request
+ * goes through the device of the calling stream, the stream the canvas
+ * belongs to may be decoding at the same time. the frame is taken under
+ * the lock, the copy and the push run without it. */
+static GstFlowReturn
+gst_marumosaic_output (GstMaruMosaic *marumosaic, MosaicStream *stream,
+    GstClockTime running_time)
+{
+  GST_DEBUG (" >> ENTER");
+  GstClockTime duration = GST_CLOCK_TIME_NONE;
+  GstFlowReturn flow;
+  CodecContext *canvas = NULL;
+  gboolean due;
+  GstBuffer *outbuf;
+  GstMapInfo mapinfo;
+  int ret;
+
+  g_mutex_lock (&marumosaic->output_lock);
+  g_mutex_lock (&marumosaic->lock);
+  due = marumosaic->canvas && !marumosaic->flushing &&
+      !(GST_CLOCK_TIME_IS_VALID (marumosaic->next_time) &&
+      GST_CLOCK_TIME_IS_VALID (running_time) &&
+      running_time < marumosaic->next_time);
+  if (due) {
+    duration = gst_util_uint64_scale_int (GST_SECOND,
+        marumosaic->fps_d, marumosaic->fps_n);
+    if (!GST_CLOCK_TIME_IS_VALID (running_time)) {
+      running_time = GST_CLOCK_TIME_IS_VALID (marumosaic->next_time) ?
+        marumosaic->next_time : 0;
+    }
+    marumosaic->next_time = running_time + duration;
+    canvas = marumosaic->canvas->context;
+  }
+  g_mutex_unlock (&marumosaic->lock);
+
+  if (!canvas) {
+    g_mutex_unlock (&marumosaic->output_lock);
+    return GST_FLOW_OK;
+  }
+
+  if (!marumosaic->started && !gst_marumosaic_start (marumosaic)) {
+    g_mutex_unlock (&marumosaic->output_lock);
+    return GST_FLOW_NOT_NEGOTIATED;
+  }
+
+  outbuf = gst_buffer_new_allocate (NULL, marumosaic->out_size, NULL);
+  gst_buffer_map (outbuf, &mapinfo, GST_MAP_WRITE);
+  ret = interface->copy_mosaic (canvas, mapinfo.data, marumosaic->out_size,
+      stream->dev);
+  gst_buffer_unmap (outbuf, &mapinfo);
+  if (ret < 0) {
+    g_mutex_unlock (&marumosaic->output_lock);
+    gst_buffer_unref (outbuf);
+    GST_ELEMENT_ERROR (marumosaic, STREAM, DECODE, (NULL),
+        ("failed to copy the canvas"));
+    return GST_FLOW_ERROR;
+  }
+
+  GST_BUFFER_PTS (outbuf) = running_time;
+  GST_BUFFER_DURATION (outbuf) = duration;
+
+  flow = gst_pad_push (marumosaic->srcpad, outbuf);
+  g_mutex_unlock (&marumosaic->output_lock);
+
+  return flow;
+}
+
+static GstFlowReturn
+gst_marumosaic_chain (GstPad *pad, GstObject *parent, GstBuffer *buffer)
+{
+  GST_DEBUG (" >> ENTER");
+  GstMaruMosaic *marumosaic = (GstMaruMosaic *) parent;
+  MosaicStream *stream = gst_pad_get_element_private (pad);
+  GstClockTime running_time;
+  GstFlowReturn flow = GST_FLOW_OK;
+  GstMapInfo mapinfo;
+  int got_picture = 0;
+  int32_t canvas_index;
+  gint len;
+
+  g_mutex_lock (&marumosaic->lock);
+  if (G_UNLIKELY (!stream->opened || !marumosaic->canvas)) {
+    g_mutex_unlock (&marumosaic->lock);
+    GST_ELEMENT_ERROR (marumosaic, CORE, NEGOTIATION, (NULL),
+        ("sink_%u is not set up", stream->index));
+    gst_buffer_unref (buffer);
+    return GST_FLOW_NOT_NEGOTIATED;
+  }
+  canvas_index = marumosaic->canvas->context->index;
+  g_mutex_unlock (&marumosaic->lock);
+
+  running_time = gst_segment_to_running_time (&stream->segment,
+      GST_FORMAT_TIME, GST_BUFFER_PTS_IS_VALID (buffer) ?
+      GST_BUFFER_PTS (buffer) : GST_BUFFER_DTS (buffer));
+
+  gst_buffer_map (buffer, &mapinfo, GST_MAP_READ);
+  len = interface->decode_video_to_mosaic (stream->context, canvas_index,
+      &stream->region, mapinfo.data, mapinfo.size, &got_picture, stream->dev);
+  gst_buffer_unmap (buffer, &mapinfo);
+  gst_buffer_unref (buffer);
+
+  if (len < 0) {
+    GST_WARNING_OBJECT (marumosaic, "failed to decode a buffer of sink_%u",
+        stream->index);
+    return GST_FLOW_OK;
+  }
+
+  if (got_picture) {
+    flow = gst_marumosaic_output (marumosaic, stream, running_time);
+    if (flow == GST_FLOW_FLUSHING && !GST_PAD_IS_FLUSHING (pad)) {
+      // the output flushes for another stream, this one goes on
+      flow = GST_FLOW_OK;
+    }
+  }
+
+  return flow;
+}
+
+static gboolean
+gst_marumosaic_sink_event (GstPad *pad, GstObject *parent, GstEvent *event)
+{
+  GST_DEBUG (" >> ENTER");
+  GstMaruMosaic *marumosaic = (GstMaruMosaic *) parent;
+  MosaicStream *stream = gst_pad_get_element_private (pad);
+  gboolean ret = TRUE, all_eos = TRUE, forward;
+  GstCaps *caps;
+  GList *elem;
+
+  switch (GST_EVENT_TYPE (event)) {
+  case GST_EVENT_CAPS:
+    gst_event_parse_caps (event, &caps);
+    ret = gst_marumosaic_setcaps (marumosaic, stream, caps);
+    break;
+  case GST_EVENT_SEGMENT:
+    gst_event_copy_segment (event, &stream->segment);
+    break;
+  case GST_EVENT_FLUSH_START:
+    // unblocks a push in progress. the output flushes once however many
+    // streams flush.
+    g_mutex_lock (&marumosaic->lock);
+    forward = !marumosaic->flushing;
+    marumosaic->flushing = TRUE;
+    g_mutex_unlock (&marumosaic->lock);
+    if (forward) {
+      return gst_pad_push_event (marumosaic->srcpad, event);
+    }
+    break;
+  case GST_EVENT_FLUSH_STOP:
+    // the other streams go on, only this one starts over
+    if (stream->opened) {
+      interface->flush_buffers (stream->context, stream->dev);
+    }
+    gst_segment_init (&stream->segment, GST_FORMAT_TIME);
+    stream->eos = FALSE;
+
+    // the flush dropped the segment of the output, it starts over
+    g_mutex_lock (&marumosaic->output_lock);
+    g_mutex_lock (&marumosaic->lock);
+    forward = marumosaic->flushing;
+    if (forward) {
+      marumosaic->flushing = FALSE;
+      marumosaic->started = FALSE;
+      marumosaic->next_time = GST_CLOCK_TIME_NONE;
+    }
+    g_mutex_unlock (&marumosaic->lock);
+    g_mutex_unlock (&marumosaic->output_lock);
+    if (forward) {
+      return gst_pad_push_event (marumosaic->srcpad, event);
+    }
+    break;
+  case GST_EVENT_EOS:
+    g_mutex_lock (&marumosaic->lock);
+    stream->eos = TRUE;
+    for (elem = marumosaic->streams; elem; elem = elem->next) {
+      all_eos &= ((MosaicStream *)elem->data)->eos;
+    }
+    g_mutex_unlock (&marumosaic->lock);
+    if (all_eos) {
+      return gst_pad_push_event (marumosaic->srcpad, event);
+    }
+    break;
+  case GST_EVENT_STREAM_START:
+    break;
+  default:
+    return gst_pad_event_default (pad, parent, event);
+  }
+
+  gst_event_unref (event);
+  return ret;
+}
+
+static GstStateChangeReturn
+gst_marumosaic_change_state (GstElement *element, GstStateChange transition)
+{
+  GST_DEBUG (" >> ENTER");
+  GstMaruMosaic *marumosaic = (GstMaruMosaic *) element;
+  GstStateChangeReturn ret;
+
+  ret = GST_ELEMENT_CLASS (gst_marumosaic_parent_class)->change_state (element,
+      transition);
+
+  switch (transition) {
+  case GST_STATE_CHANGE_PAUSED_TO_READY:
+    gst_marumosaic_close (marumosaic);
+    break;
+  default:
+    break;
+  }
+
+  return ret;
+}
+
+static void
+gst_marumosaic_set_property (GObject *object,
+  guint prop_id, const GValue *value, GParamSpec *pspec)
+{
+  GST_DEBUG (" >> ENTER");
+  GstMaruMosaic *marumosaic = (GstMaruMosaic *) object;
+  GList *l;
+
+  if (prop_id == ARG_PRIORITY) {
+    // every stream takes it at its next request
+    g_mutex_lock (&marumosaic->lock);
+    marumosaic->priority = g_value_get_enum (value);
+    for (l = marumosaic->streams; l; l = l->next) {
+      ((MosaicStream *) l->data)->context->priority = marumosaic->priority;
+    }
+    g_mutex_unlock (&marumosaic->lock);
+    return;
+  }
+
+  if (marumosaic->streams) {
+    GST_WARNING_OBJECT (marumosaic,
+      "Can't change properties once streams are linked !");
+    return;
+  }
+
+  switch (prop_id) {
+    case ARG_WIDTH:
+      marumosaic->width = g_value_get_int (value) & ~1;
+      break;
+    case ARG_HEIGHT:
+      marumosaic->height = g_value_get_int (value) & ~1;
+      break;
+    case ARG_COLUMNS:
+      marumosaic->columns = g_value_get_int (value);
+      break;
+    case ARG_ROWS:
+      marumosaic->rows = g_value_get_int (value);
+      break;
+    case ARG_FRAMERATE:
+      marumosaic->fps_n = gst_value_get_fraction_numerator (value);
+      marumosaic->fps_d = gst_value_get_fraction_denominator (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_marumosaic_get_property (GObject *object,
+  guint prop_id, GValue *value, GParamSpec *pspec)
+{
+  GST_DEBUG (" >> ENTER");
+  GstMaruMosaic *marumosaic = (GstMaruMosaic *) object;
+
+  switch (prop_id) {
+    case ARG_WIDTH:
+      g_value_set_int (value, marumosaic->width);
+      break;
+    case ARG_HEIGHT:
+      g_value_set_int (value, marumosaic->height);
+      break;
+    case ARG_COLUMNS:
+      g_value_set_int (value, marumosaic->columns);
+      break;
+    case ARG_ROWS:
+      g_value_set_int (value, marumosaic->rows);
+      break;
+    case ARG_FRAMERATE:
+      gst_value_set_fraction (value, marumosaic->fps_n, marumosaic->fps_d);
+      break;
+    case ARG_PRIORITY:
+      g_value_set_enum (value, marumosaic->priority);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+gboolean
+gst_marumosaic_register (GstPlugin *plugin, GList *element)
+{
+  if (!interface->decode_video_to_mosaic) {
+    GST_DEBUG ("the device can not decode into a mosaic, maru_mosaic is not registered");
+    return TRUE;
+  }
+
+  mosaic_codecs = element;
+
+  return gst_element_register (plugin, "maru_mosaic", GST_RANK_NONE,
+      gst_marumosaic_get_type ());
+}
@@ -0,0 +1,652 @@
+/*
+ * GStreamer codec plugin for Tizen Emulator.
+ *
+ * Copyright (C) 2013 - 2014 Samsung Electronics Co., Ltd. All rights reserved.
+ *
+ * Contact:
+ * KiTae Kim <kt920.kim@samsung.com>
+ * SeokYeon Hwang <syeon.hwang@samsung.com>
+ * YeongKyoon Lee <yeongkyoon.lee@samsung.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Contributors:
+ * - S-Core Co., Ltd
+ *
+ */
+
+
+#include "gstmarupicture.h"
+#include "gstmaruutils.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/*
+ * A decoded picture in device memory is laid out as described by
+ * gst_maru_avpicture_layout (). The routines below copy it into a mapped
+ * output frame and convert it on the way when downstream asked for a
+ * different format, so the picture is touched only once.
+ */
+
+typedef void (*PictureConvertFunc) (GstVideoFrame *dest, const guint8 *src,
+    const int offsets[4], const int strides[4], int width, int height);
+
+typedef struct {
+  enum PixelFormat pix_fmt;
+  GstVideoFormat format;
+  PictureConvertFunc convert;
+} PictureConverter;
+
+static void
+copy_plane (guint8 *dest, int dest_stride, const guint8 *src, int src_stride,
+    int row_size, int rows)
+{
+  int i;
+
+  if (dest_stride == src_stride && row_size == src_stride) {
+    memcpy (dest, src, row_size * rows);
+    return;
+  }
+
+  for (i = 0; i < rows; i++) {
+    memcpy (dest, src, row_size);
+    dest += dest_stride;
+    src += src_stride;
+  }
+}
+
+static inline void
+interleave_row (guint8 *dest, const guint8 *u, const guint8 *v, int n)
+{
+  int i = 0;
+
+#ifdef __SSE2__
+  for (; i + 16 <= n; i += 16) {
+    __m128i mu = _mm_loadu_si128 ((const __m128i *) (u + i));
+    __m128i mv = _mm_loadu_si128 ((const __m128i *) (v + i));
+
+    _mm_storeu_si128 ((__m128i *) (dest + 2 * i), _mm_unpacklo_epi8 (mu, mv));
+    _mm_storeu_si128 ((__m128i *) (dest + 2 * i + 16),
+        _mm_unpackhi_epi8 (mu, mv));
+  }
+#endif
+  for (; i < n; i++) {
+    dest[2 * i] = u[i];
+    dest[2 * i + 1] = v[i];
+  }
+}
+
+static void
+convert_i420_to_semi_planar (GstVideoFrame *dest, const guint8 *src,
+    const int offsets[4], const int strides[4], int width, int height,
+    gboolean swap_uv)
+{
+  const guint8 *u, *v;
+  guint8 *uv;
+  int i, chroma_width, chroma_height, uv_stride;
+
+  copy_plane (GST_VIDEO_FRAME_PLANE_DATA (dest, 0),
+      GST_VIDEO_FRAME_PLANE_STRIDE (dest, 0), src + offsets[0], strides[0],
+      width, height);
+
+  chroma_width = DIV_ROUND_UP_X(width, 1);
+  chroma_height = DIV_ROUND_UP_X(height, 1);
+
+  u = src + offsets[swap_uv ? 2 : 1];
+  v = src + offsets[swap_uv ? 1 : 2];
+  uv = GST_VIDEO_FRAME_PLANE_DATA (dest, 1);
+  uv_stride = GST_VIDEO_FRAME_PLANE_STRIDE (dest, 1);
+
+  for (i = 0; i < chroma_height; i++) {
+    interleave_row (uv, u, v, chroma_width);
+    uv += uv_stride;
+    u += strides[1];
+    v += strides[2];
+  }
+}
+
+static void
+convert_i420_to_nv12 (GstVideoFrame *dest, const guint8 *src,
+    const int offsets[4], const int strides[4], int width, int height)
+{
+  convert_i420_to_semi_planar (dest, src, offsets, strides,
+      width, height, FALSE);
+}
+
+static void
+convert_i420_to_nv21 (GstVideoFrame *dest, const guint8 *src,
+    const int offsets[4], const int strides[4], int width, int height)
+{
+  convert_i420_to_semi_planar (dest, src, offsets, strides,
+      width, height, TRUE);
+}
+
+/*
+ * I420 to packed RGB, BT.601 limited range in 6 bit fixed point.
+ *   R = (74 * (Y - 16) + 102 * (V - 128) + 32) >> 6
+ *   G = (74 * (Y - 16) -  25 * (U - 128) - 52 * (V - 128) + 32) >> 6
+ *   B = (74 * (Y - 16) + 129 * (U - 128) + 32) >> 6
+ * intermediate values fit in 16 bits with saturation, which only hits
+ * results that are clipped to 255 anyway.
+ */
+enum { CHANNEL_R, CHANNEL_G, CHANNEL_B, CHANNEL_X };
+
+static inline guint8
+clip_u8 (int v)
+{
+  return v < 0 ? 0 : (v > 255 ? 255 : v);
+}
+
+static inline void
+yuv_to_rgbx_row (guint8 *dest, const guint8 *y, const guint8 *u,
+    const guint8 *v, int width, const int pos[4])
+{
+  int i = 0;
+
+#ifdef __SSE2__
+  const __m128i zero = _mm_setzero_si128 ();
+  const __m128i y_off = _mm_set1_epi16 (16);
+  const __m128i uv_off = _mm_set1_epi16 (128);
+  const __m128i round = _mm_set1_epi16 (32);
+  const __m128i y_coef = _mm_set1_epi16 (74);
+  const __m128i rv_coef = _mm_set1_epi16 (102);
+  const __m128i gu_coef = _mm_set1_epi16 (25);
+  const __m128i gv_coef = _mm_set1_epi16 (52);
+  const __m128i bu_coef = _mm_set1_epi16 (129);
+  const __m128i alpha = _mm_set1_epi8 ((char) 0xff);
+
+  for (; i + 8 <= width; i += 8) {
+    __m128i my, mu, mv, r, g, b, c[4], lo, hi;
+    int32_t u4, v4;
+
+    memcpy (&u4, u + i / 2, sizeof (u4));
+    memcpy (&v4, v + i / 2, sizeof (v4));
+
+    my = _mm_unpacklo_epi8 (_mm_loadl_epi64 ((const __m128i *) (y + i)), zero);
+    mu = _mm_unpacklo_epi8 (_mm_cvtsi32_si128 (u4), zero);
+    mv = _mm_unpacklo_epi8 (_mm_cvtsi32_si128 (v4), zero);
+    /* one chroma sample covers two pixels */
+    mu = _mm_sub_epi16 (_mm_unpacklo_epi16 (mu, mu), uv_off);
+    mv = _mm_sub_epi16 (_mm_unpacklo_epi16 (mv, mv), uv_off);
+    my = _mm_add_epi16 (_mm_mullo_epi16 (_mm_sub_epi16 (my, y_off), y_coef),
+        round);
+
+    r = _mm_adds_epi16 (my, _mm_mullo_epi16 (mv, rv_coef));
+    g = _mm_subs_epi16 (_mm_subs_epi16 (my, _mm_mullo_epi16 (mu, gu_coef)),
+        _mm_mullo_epi16 (mv, gv_coef));
+    b = _mm_adds_epi16 (my, _mm_mullo_epi16 (mu, bu_coef));
+
+    c[pos[CHANNEL_R]] = _mm_packus_epi16 (_mm_srai_epi16 (r, 6), zero);
+    c[pos[CHANNEL_G]] = _mm_packus_epi16 (_mm_srai_epi16 (g, 6), zero);
+    c[pos[CHANNEL_B]] = _mm_packus_epi16 (_mm_srai_epi16 (b, 6), zero);
+    c[pos[CHANNEL_X]] = alpha;
+
+    lo = _mm_unpacklo_epi8 (c[0], c[1]);
+    hi = _mm_unpacklo_epi8 (c[2], c[3]);
+    _mm_storeu_si128 ((__m128i *) (dest + i * 4), _mm_unpacklo_epi16 (lo, hi));
+    _mm_storeu_si128 ((__m128i *) (dest + i * 4 + 16),
+        _mm_unpackhi_epi16 (lo, hi));
+  }
+#endif
+  for (; i < width; i++) {
+    int c = 74 * (y[i] - 16) + 32;
+    int d = u[i / 2] - 128;
+    int e = v[i / 2] - 128;
+    guint8 *p = dest + i * 4;
+
+    p[pos[CHANNEL_R]] = clip_u8 ((c + 102 * e) >> 6);
+    p[pos[CHANNEL_G]] = clip_u8 ((c - 25 * d - 52 * e) >> 6);
+    p[pos[CHANNEL_B]] = clip_u8 ((c + 129 * d) >> 6);
+    p[pos[CHANNEL_X]] = 0xff;
+  }
+}
+
+static void
+convert_i420_to_rgbx (GstVideoFrame *dest, const guint8 *src,
+    const int offsets[4], const int strides[4], int width, int height,
+    const int pos[4])
+{
+  guint8 *d = GST_VIDEO_FRAME_PLANE_DATA (dest, 0);
+  int d_stride = GST_VIDEO_FRAME_PLANE_STRIDE (dest, 0);
+  int i;
+
+  for (i = 0; i < height; i++) {
+    yuv_to_rgbx_row (d, src + offsets[0] + i * strides[0],
+        src + offsets[1] + (i / 2) * strides[1],
+        src + offsets[2] + (i / 2) * strides[2], width, pos);
+    d += d_stride;
+  }
+}
+
+#define DEFINE_RGBX_CONVERTER(name, r, g, b, x) \
+static void \
+convert_i420_to_##name (GstVideoFrame *dest, const guint8 *src, \
+    const int offsets[4], const int strides[4], int width, int height) \
+{ \
+  static const int pos[4] = { r, g, b, x }; \
+  convert_i420_to_rgbx (dest, src, offsets, strides, width, height, pos); \
+}
+
+/* byte position of R, G, B and X/A in a pixel */
+DEFINE_RGBX_CONVERTER (rgbx, 0, 1, 2, 3)
+DEFINE_RGBX_CONVERTER (bgrx, 2, 1, 0, 3)
+DEFINE_RGBX_CONVERTER (xrgb, 1, 2, 3, 0)
+DEFINE_RGBX_CONVERTER (xbgr, 3, 2, 1, 0)
+
+#undef DEFINE_RGBX_CONVERTER
+
+/* I420 to packed 4:2:2 */
+static inline void
+pack_422_row (guint8 *dest, const guint8 *y, const guint8 *u,
+    const guint8 *v, int width, gboolean chroma_first)
+{
+  int i = 0;
+
+#ifdef __SSE2__
+  for (; i + 16 <= width; i += 16) {
+    __m128i my = _mm_loadu_si128 ((const __m128i *) (y + i));
+    __m128i muv = _mm_unpacklo_epi8 (
+        _mm_loadl_epi64 ((const __m128i *) (u + i / 2)),
+        _mm_loadl_epi64 ((const __m128i *) (v + i / 2)));
+
+    if (chroma_first) {
+      _mm_storeu_si128 ((__m128i *) (dest + i * 2), _mm_unpacklo_epi8 (muv, my));
+      _mm_storeu_si128 ((__m128i *) (dest + i * 2 + 16),
+          _mm_unpackhi_epi8 (muv, my));
+    } else {
+      _mm_storeu_si128 ((__m128i *) (dest + i * 2), _mm_unpacklo_epi8 (my, muv));
+      _mm_storeu_si128 ((__m128i *) (dest + i * 2 + 16),
+          _mm_unpackhi_epi8 (my, muv));
+    }
+  }
+#endif
+  for (; i < width; i += 2) {
+    guint8 *p = dest + i * 2;
+    guint8 y1 = (i + 1 < width) ? y[i + 1] : y[i];
+
+    if (chroma_first) {
+      p[0] = u[i / 2];
+      p[1] = y[i];
+      p[2] = v[i / 2];
+      p[3] = y1;
+    } else {
+      p[0] = y[i];
+      p[1] = u[i / 2];
+      p[2] = y1;
+      p[3] = v[i / 2];
+    }
+  }
+}
+
+static void
+convert_i420_to_422 (GstVideoFrame *dest, const guint8 *src,
+    const int offsets[4], const int strides[4], int width, int height,
+    gboolean chroma_first)
+{
+  guint8 *d = GST_VIDEO_FRAME_PLANE_DATA (dest, 0);
+  int d_stride = GST_VIDEO_FRAME_PLANE_STRIDE (dest, 0);
+  int i;
+
+  for (i = 0; i < height; i++) {
+    pack_422_row (d, src + offsets[0] + i * strides[0],
+        src + offsets[1] + (i / 2) * strides[1],
+        src + offsets[2] + (i / 2) * strides[2], width, chroma_first);
+    d += d_stride;
+  }
+}
+
+static void
+convert_i420_to_yuy2 (GstVideoFrame *dest, const guint8 *src,
+    const int offsets[4], const int strides[4], int width, int height)
+{
+  convert_i420_to_422 (dest, src, offsets, strides, width, height, FALSE);
+}
+
+static void
+convert_i420_to_uyvy (GstVideoFrame *dest, const guint8 *src,
+    const int offsets[4], const int strides[4], int width, int height)
+{
+  convert_i420_to_422 (dest, src, offsets, strides, width, height, TRUE);
+}
+
+static const PictureConverter converters[] = {
+  { PIX_FMT_YUV420P, GST_VIDEO_FORMAT_NV12, convert_i420_to_nv12 },
+  { PIX_FMT_YUV420P, GST_VIDEO_FORMAT_NV21, convert_i420_to_nv21 },
+  { PIX_FMT_YUV420P, GST_VIDEO_FORMAT_YUY2, convert_i420_to_yuy2 },
+  { PIX_FMT_YUV420P, GST_VIDEO_FORMAT_UYVY, convert_i420_to_uyvy },
+  { PIX_FMT_YUV420P, GST_VIDEO_FORMAT_BGRx, convert_i420_to_bgrx },
+  { PIX_FMT_YUV420P, GST_VIDEO_FORMAT_RGBx, convert_i420_to_rgbx },
+  { PIX_FMT_YUV420P, GST_VIDEO_FORMAT_xRGB, convert_i420_to_xrgb },
+  { PIX_FMT_YUV420P, GST_VIDEO_FORMAT_xBGR, convert_i420_to_xbgr },
+  { PIX_FMT_YUV420P, GST_VIDEO_FORMAT_BGRA, convert_i420_to_bgrx },
+  { PIX_FMT_YUV420P, GST_VIDEO_FORMAT_RGBA, convert_i420_to_rgbx },
+  { PIX_FMT_YUV420P, GST_VIDEO_FORMAT_ARGB, convert_i420_to_xrgb },
+  { PIX_FMT_YUV420P, GST_VIDEO_FORMAT_ABGR, convert_i420_to_xbgr },
+  /* full range pictures are only repacked, RGB would need another matrix */
+  { PIX_FMT_YUVJ420P, GST_VIDEO_FORMAT_NV12, convert_i420_to_nv12 },
+  { PIX_FMT_YUVJ420P, GST_VIDEO_FORMAT_NV21, convert_i420_to_nv21 },
+  { PIX_FMT_YUVJ420P, GST_VIDEO_FORMAT_YUY2, convert_i420_to_yuy2 },
+  { PIX_FMT_YUVJ420P, GST_VIDEO_FORMAT_UYVY, convert_i420_to_uyvy },
+};
+
+static const PictureConverter *
+find_converter (int pix_fmt, GstVideoFormat format)
+{
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (converters); i++) {
+    if (converters[i].pix_fmt == pix_fmt && converters[i].format == format) {
+      return &converters[i];
+    }
+  }
+
+  return NULL;
+}
+
+gboolean
+gst_maru_picture_can_convert (int pix_fmt, GstVideoFormat format)
+{
+  return find_converter (pix_fmt, format) != NULL;
+}
+
+static void
+append_format (GValue *list, GstVideoFormat format)
+{
+  GValue v = { 0, };
+  guint i, n;
+
+  n = gst_value_list_get_size (list);
+  for (i = 0; i < n; i++) {
+    const gchar *s = g_value_get_string (gst_value_list_get_value (list, i));
+    if (gst_video_format_from_string (s) == format) {
+      return;
+    }
+  }
+
+  g_value_init (&v, G_TYPE_STRING);
+  g_value_set_string (&v, gst_video_format_to_string (format));
+  gst_value_list_append_value (list, &v);
+  g_value_unset (&v);
+}
+
+static void
+append_converted_formats (GValue *list, const gchar *name)
+{
+  enum PixelFormat pix_fmt;
+  guint i;
+
+  pix_fmt = gst_maru_videoformat_to_pixfmt (gst_video_format_from_string (name));
+  if (pix_fmt == PIX_FMT_NONE) {
+    return;
+  }
+
+  for (i = 0; i < G_N_ELEMENTS (converters); i++) {
+    if (converters[i].pix_fmt == pix_fmt) {
+      append_format (list, converters[i].format);
+    }
+  }
+}
+
+/* add every format we can convert the listed formats into, after them. */
+void
+gst_maru_picture_append_formats (GstCaps *caps)
+{
+  guint i, j, n;
+
+  for (i = 0; i < gst_caps_get_size (caps); i++) {
+    GstStructure *s = gst_caps_get_structure (caps, i);
+    const GValue *formats = gst_structure_get_value (s, "format");
+    GValue list = { 0, };
+
+    if (!formats) {
+      continue;
+    }
+
+    g_value_init (&list, GST_TYPE_LIST);
+    if (G_VALUE_HOLDS_STRING (formats)) {
+      gst_value_list_append_value (&list, formats);
+      append_converted_formats (&list, g_value_get_string (formats));
+    } else if (GST_VALUE_HOLDS_LIST (formats)) {
+      n = gst_value_list_get_size (formats);
+      for (j = 0; j < n; j++) {
+        gst_value_list_append_value (&list,
+            gst_value_list_get_value (formats, j));
+      }
+      for (j = 0; j < n; j++) {
+        append_converted_formats (&list,
+            g_value_get_string (gst_value_list_get_value (formats, j)));
+      }
+    }
+
+    if (gst_value_list_get_size (&list) > 1) {
+      gst_structure_set_value (s, "format", &list);
+    }
+    g_value_unset (&list);
+  }
+}
+
+/*
+ * Downscaling, done while reading the picture out of device memory so only
+ * the smaller picture is written. Exact halving is the common thumbnail
+ * case and gets a SIMD path (its double rounding may differ by one from the
+ * scalar loop); other ratios use a box filter.
+ */
+static inline void
+halve_row (guint8 *dest, const guint8 *row0, const guint8 *row1, int n)
+{
+  int i = 0;
+
+#ifdef __SSE2__
+  const __m128i mask = _mm_set1_epi16 (0x00ff);
+
+  for (; i + 8 <= n; i += 8) {
+    __m128i v = _mm_avg_epu8 (_mm_loadu_si128 ((const __m128i *) (row0 + 2 * i)),
+        _mm_loadu_si128 ((const __m128i *) (row1 + 2 * i)));
+    __m128i avg = _mm_avg_epu16 (_mm_and_si128 (v, mask),
+        _mm_srli_epi16 (v, 8));
+
+    _mm_storel_epi64 ((__m128i *) (dest + i),
+        _mm_packus_epi16 (avg, _mm_setzero_si128 ()));
+  }
+#endif
+  for (; i < n; i++) {
+    dest[i] = (row0[2 * i] + row0[2 * i + 1] +
+        row1[2 * i] + row1[2 * i + 1] + 2) >> 2;
+  }
+}
+
+static void
+box_scale_plane (guint8 *dest, int dest_stride, int dest_width,
+    int dest_height, const guint8 *src, int src_stride, int src_width,
+    int src_height)
+{
+  int x, y, i, j;
+
+  if (src_width / 2 == dest_width && src_height / 2 == dest_height) {
+    for (y = 0; y < dest_height; y++) {
+      halve_row (dest + y * dest_stride, src + 2 * y * src_stride,
+          src + (2 * y + 1) * src_stride, dest_width);
+    }
+    return;
+  }
+
+  for (y = 0; y < dest_height; y++) {
+    int y0 = y * src_height / dest_height;
+    int y1 = MAX ((y + 1) * src_height / dest_height, y0 + 1);
+    guint8 *d = dest + y * dest_stride;
+
+    for (x = 0; x < dest_width; x++) {
+      int x0 = x * src_width / dest_width;
+      int x1 = MAX ((x + 1) * src_width / dest_width, x0 + 1);
+      int count = (x1 - x0) * (y1 - y0);
+      unsigned int sum = 0;
+
+      for (j = y0; j < y1; j++) {
+        const guint8 *s = src + j * src_stride;
+        for (i = x0; i < x1; i++) {
+          sum += s[i];
+        }
+      }
+      d[x] = (sum + count / 2) / count;
+    }
+  }
+}
+
+/* only 8 bit planar pictures, one component per plane, can be scaled */
+gboolean
+gst_maru_picture_can_scale (int pix_fmt)
+{
+  const GstVideoFormatInfo *finfo;
+  guint c;
+
+  finfo = gst_video_format_get_info (gst_maru_pixfmt_to_videoformat (pix_fmt));
+  if (!finfo || GST_VIDEO_FORMAT_INFO_FORMAT (finfo) == GST_VIDEO_FORMAT_UNKNOWN) {
+    return FALSE;
+  }
+
+  for (c = 0; c < GST_VIDEO_FORMAT_INFO_N_COMPONENTS (finfo); c++) {
+    if (GST_VIDEO_FORMAT_INFO_DEPTH (finfo, c) != 8 ||
+        GST_VIDEO_FORMAT_INFO_PSTRIDE (finfo, c) != 1) {
+      return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
+static void
+scale_picture (guint8 *dest, const int dest_offsets[4],
+    const int dest_strides[4], int dest_width, int dest_height,
+    const guint8 *src, const int offsets[4], const int strides[4],
+    int width, int height, const GstVideoFormatInfo *finfo)
+{
+  guint c, plane;
+
+  for (c = 0; c < GST_VIDEO_FORMAT_INFO_N_COMPONENTS (finfo); c++) {
+    plane = GST_VIDEO_FORMAT_INFO_PLANE (finfo, c);
+    box_scale_plane (dest + dest_offsets[plane], dest_strides[plane],
+        GST_VIDEO_FORMAT_INFO_SCALE_WIDTH (finfo, c, dest_width),
+        GST_VIDEO_FORMAT_INFO_SCALE_HEIGHT (finfo, c, dest_height),
+        src + offsets[plane], strides[plane],
+        GST_VIDEO_FORMAT_INFO_SCALE_WIDTH (finfo, c, width),
+        GST_VIDEO_FORMAT_INFO_SCALE_HEIGHT (finfo, c, height));
+  }
+}
+
+static gboolean
+scale_and_convert (GstVideoFrame *dest, const guint8 *src,
+    const int offsets[4], const int strides[4], int pix_fmt,
+    int width, int height)
+{
+  const GstVideoFormatInfo *finfo;
+  const PictureConverter *converter = NULL;
+  int dest_width = GST_VIDEO_FRAME_WIDTH (dest);
+  int dest_height = GST_VIDEO_FRAME_HEIGHT (dest);
+  int tmp_offsets[4], tmp_strides[4];
+  guint8 *tmp;
+  int size;
+  guint i;
+
+  if (dest_width > width || dest_height > height ||
+      !gst_maru_picture_can_scale (pix_fmt)) {
+    GST_ERROR ("can not scale pixel format %d from %dx%d to %dx%d",
+        pix_fmt, width, height, dest_width, dest_height);
+    return FALSE;
+  }
+  finfo = gst_video_format_get_info (gst_maru_pixfmt_to_videoformat (pix_fmt));
+
+  if (GST_VIDEO_FRAME_FORMAT (dest) == GST_VIDEO_FORMAT_INFO_FORMAT (finfo)) {
+    for (i = 0; i < GST_VIDEO_FRAME_N_PLANES (dest); i++) {
+      tmp_offsets[i] = (guint8 *) GST_VIDEO_FRAME_PLANE_DATA (dest, i) -
+          (guint8 *) GST_VIDEO_FRAME_PLANE_DATA (dest, 0);
+      tmp_strides[i] = GST_VIDEO_FRAME_PLANE_STRIDE (dest, i);
+    }
+    scale_picture (GST_VIDEO_FRAME_PLANE_DATA (dest, 0), tmp_offsets,
+        tmp_strides, dest_width, dest_height, src, offsets, strides,
+        width, height, finfo);
+    return TRUE;
+  }
+
+  converter = find_converter (pix_fmt, GST_VIDEO_FRAME_FORMAT (dest));
+  if (!converter) {
+    GST_ERROR ("can not convert pixel format %d to %s", pix_fmt,
+        gst_video_format_to_string (GST_VIDEO_FRAME_FORMAT (dest)));
+    return FALSE;
+  }
+
+  // scale into a small native picture first, then convert that one.
+  size = gst_maru_avpicture_layout (pix_fmt, dest_width, dest_height,
+      tmp_offsets, tmp_strides);
+  tmp = g_try_malloc (size);
+  if (!tmp) {
+    GST_ERROR ("failed to allocate scaled picture");
+    return FALSE;
+  }
+  scale_picture (tmp, tmp_offsets, tmp_strides, dest_width, dest_height,
+      src, offsets, strides, width, height, finfo);
+  converter->convert (dest, tmp, tmp_offsets, tmp_strides,
+      dest_width, dest_height);
+  g_free (tmp);
+
+  return TRUE;
+}
+
+gboolean
+gst_maru_picture_copy (GstVideoFrame *dest, const guint8 *src,
+    int pix_fmt, int width, int height)
+{
+  const PictureConverter *converter;
+  int offsets[4], strides[4];
+  guint i;
+
+  if (gst_maru_avpicture_layout (pix_fmt, width, height,
+        offsets, strides) < 0) {
+    GST_ERROR ("unknown layout of pixel format %d", pix_fmt);
+    return FALSE;
+  }
+
+  if (GST_VIDEO_FRAME_WIDTH (dest) != width ||
+      GST_VIDEO_FRAME_HEIGHT (dest) != height) {
+    return scale_and_convert (dest, src, offsets, strides, pix_fmt,
+        width, height);
+  }
+
+  if (GST_VIDEO_FRAME_FORMAT (dest) == gst_maru_pixfmt_to_videoformat (pix_fmt)) {
+    for (i = 0; i < GST_VIDEO_FRAME_N_PLANES (dest) && i < 4; i++) {
+      if (!strides[i]) {
+        break;
+      }
+      copy_plane (GST_VIDEO_FRAME_PLANE_DATA (dest, i),
+          GST_VIDEO_FRAME_PLANE_STRIDE (dest, i), src + offsets[i], strides[i],
+          MIN (strides[i], GST_VIDEO_FRAME_PLANE_STRIDE (dest, i)),
+          GST_VIDEO_FRAME_COMP_HEIGHT (dest, i));
+    }
+    return TRUE;
+  }
+
+  converter = find_converter (pix_fmt, GST_VIDEO_FRAME_FORMAT (dest));
+  if (!converter) {
+    GST_ERROR ("can not convert pixel format %d to %s", pix_fmt,
+        gst_video_format_to_string (GST_VIDEO_FRAME_FORMAT (dest)));
+    return FALSE;
+  }
+
+  converter->convert (dest, src, offsets, strides, width, height);
+
+  return TRUE;
+}
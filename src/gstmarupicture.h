@@ -0,0 +1,46 @@
+/*
+ * GStreamer codec plugin for Tizen Emulator.
+ *
+ * Copyright (C) 2013 - 2014 Samsung Electronics Co., Ltd. All rights reserved.
+ *
+ * Contact:
+ * KiTae Kim <kt920.kim@samsung.com>
+ * SeokYeon Hwang <syeon.hwang@samsung.com>
+ * YeongKyoon Lee <yeongkyoon.lee@samsung.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Contributors:
+ * - S-Core Co., Ltd
+ *
+ */
+
+#ifndef __GST_MARU_PICTURE_H__
+#define __GST_MARU_PICTURE_H__
+
+#include "gstmaru.h"
+#include <gst/video/video.h>
+
+gboolean gst_maru_picture_can_convert (int pix_fmt, GstVideoFormat format);
+
+void gst_maru_picture_append_formats (GstCaps *caps);
+
+gboolean gst_maru_picture_can_scale (int pix_fmt);
+
+gboolean gst_maru_picture_copy (GstVideoFrame *dest, const guint8 *src,
+    int pix_fmt, int width, int height);
+
+#endif
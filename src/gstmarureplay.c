@@ -0,0 +1,402 @@
+/*
+ * Gstreamer codec plugin for Tizen Emulator.
+ *
+ * Copyright (C) 2013 Samsung Electronics Co., Ltd. All rights reserved.
+ *
+ * Contact:
+ * KiTae Kim <kt920.kim@samsung.com>
+ * SeokYeon Hwang <syeon.hwang@samsung.com>
+ * YeongKyoon Lee <yeongkyoon.lee@samsung.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Contributors:
+ * - S-Core Co., Ltd
+ *
+ */
+
+/*
+ * gst-maru-codec-replay sends the requests of a GST_MARU_TRACE file to a
+ * device again and compares how long they took then and now.
+ *
+ * every context of the trace is replayed by a thread of its own, one
+ * request after the other. with --realtime no request is sent earlier
+ * than it was in the trace, otherwise they are sent as fast as the
+ * device answers.
+ *
+ *   gst-maru-codec-replay [--realtime] [--broker] trace
+ *
+ * the loopback device answers unless --broker sends the requests to
+ * gst-maru-codec-broker, e.g. to replay them against the real device.
+ */
+
+#include <errno.h>
+#include <sys/mman.h>
+
+#include "gstmaru.h"
+#include "gstmaruinterface.h"
+#include "gstmaruinterface3.h"
+#include "gstmarudevice.h"
+#include "gstmarutrace.h"
+
+GST_DEBUG_CATEGORY (maru_debug);
+
+#define REPLAY_APIS   CODEC_FUNC_TYPE_COUNT
+
+typedef struct {
+  CodecTraceRecord record;
+  uint8_t *payload;
+} ReplayRequest;
+
+typedef struct {
+  GQueue requests;
+  GThread *thread;
+} ReplayContext;
+
+typedef struct {
+  guint count;
+  guint failures;
+  gint64 traced;
+  gint64 replayed;
+  gint64 replayed_max;
+} ReplayStats;
+
+static const char *api_names[] = {
+  "init",
+  "decode_video",
+  "encode_video",
+  "decode_audio",
+  "encode_audio",
+  "picture_copy",
+  "deinit",
+  "flush_buffers",
+  "decode_video_and_picture_copy",
+  "encode_video_batch",
+  "decode_audio_batch",
+  "encode_audio_batch",
+  "decode_video_and_encode",
+  "decode_video_to_mosaic",
+  "mosaic_copy",
+  "decode_image_batch",
+};
+// every api has a name
+G_STATIC_ASSERT (G_N_ELEMENTS (api_names) == REPLAY_APIS);
+
+static struct {
+  CodecDeviceOps *ops;
+  int fd;
+  uint8_t *mem;
+  uint32_t mem_size;
+  gboolean realtime;
+  gint64 start;
+
+  GMutex lock;
+  ReplayStats apis[REPLAY_APIS];
+  ReplayStats secure;
+  ReplayStats release;
+} replay;
+
+static GHashTable *
+read_trace (const gchar *path, gint64 *span)
+{
+  CodecTraceHeader header;
+  CodecTraceRecord record;
+  GHashTable *contexts;
+  FILE *trace;
+
+  trace = fopen (path, "rb");
+  if (!trace) {
+    g_printerr ("cannot open %s: %s\n", path, g_strerror (errno));
+    return NULL;
+  }
+  if (fread (&header, sizeof(header), 1, trace) != 1 ||
+      memcmp (header.magic, CODEC_TRACE_MAGIC, sizeof(header.magic))) {
+    g_printerr ("%s is not a codec trace\n", path);
+    fclose (trace);
+    return NULL;
+  }
+  g_print ("trace of device version %d, %u bytes of memory\n",
+    header.device_version, header.mem_size);
+
+  contexts = g_hash_table_new (g_direct_hash, g_direct_equal);
+  *span = 0;
+  while (fread (&record, sizeof(record), 1, trace) == 1) {
+    ReplayRequest *request = g_new0 (ReplayRequest, 1);
+    ReplayContext *context;
+
+    request->record = record;
+    if (record.payload_size) {
+      request->payload = g_malloc (record.payload_size);
+      if (fread (request->payload, record.payload_size, 1, trace) != 1) {
+        g_printerr ("%s is cut short\n", path);
+        g_free (request->payload);
+        g_free (request);
+        break;
+      }
+    }
+    *span = MAX (*span, record.start + record.duration);
+
+    context = g_hash_table_lookup (contexts,
+      GINT_TO_POINTER (record.ctx_index));
+    if (!context) {
+      context = g_new0 (ReplayContext, 1);
+      g_queue_init (&context->requests);
+      g_hash_table_insert (contexts,
+        GINT_TO_POINTER (record.ctx_index), context);
+    }
+    g_queue_push_tail (&context->requests, request);
+  }
+  fclose (trace);
+
+  return contexts;
+}
+
+// offsets of the trace are replaced by the ones the device gives now
+static uint32_t
+map_offset (GHashTable *offsets, uint32_t offset)
+{
+  gpointer mapped;
+
+  if (g_hash_table_lookup_extended (offsets,
+      GUINT_TO_POINTER (offset), NULL, &mapped)) {
+    return GPOINTER_TO_UINT (mapped);
+  }
+  return offset;
+}
+
+static void
+add_stats (ReplayStats *stats, CodecTraceRecord *record, int ret,
+    gint64 elapsed)
+{
+  g_mutex_lock (&replay.lock);
+  stats->count++;
+  if (ret < 0) {
+    stats->failures++;
+  }
+  stats->traced += record->duration;
+  stats->replayed += elapsed;
+  stats->replayed_max = MAX (stats->replayed_max, elapsed);
+  g_mutex_unlock (&replay.lock);
+}
+
+static gpointer
+replay_context (gpointer user_data)
+{
+  ReplayContext *context = user_data;
+  GHashTable *offsets = g_hash_table_new (g_direct_hash, g_direct_equal);
+  GHashTableIter iter;
+  gpointer key, value;
+  ReplayRequest *request;
+  int32_t ctx_index;
+
+  if (replay.ops->ioctl (replay.fd,
+      IOCTL_RW(IOCTL_CMD_GET_CONTEXT_INDEX), &ctx_index) < 0) {
+    g_printerr ("cannot get a context index: %s\n", g_strerror (errno));
+    return NULL;
+  }
+
+  while ((request = g_queue_pop_head (&context->requests))) {
+    CodecTraceRecord *record = &request->record;
+    ReplayStats *stats = NULL;
+    IOCTL_Data data = { 0, };
+    uint32_t offset;
+    gint64 start = 0;
+    int ret = -1;
+
+    if (replay.realtime) {
+      gint64 delay = replay.start + record->start - g_get_monotonic_time ();
+
+      if (delay > 0) {
+        g_usleep (delay);
+      }
+    }
+
+    // what failed then is not asked again
+    if (record->ret < 0) {
+      goto next;
+    }
+
+    switch (record->type) {
+    case CODEC_TRACE_SECURE:
+      data.ctx_index = ctx_index;
+      data.buffer_size = record->size;
+      start = g_get_monotonic_time ();
+      ret = replay.ops->ioctl (replay.fd,
+        IOCTL_RW(IOCTL_CMD_SECURE_BUFFER), &data);
+      if (ret == 0) {
+        g_hash_table_insert (offsets, GUINT_TO_POINTER (record->mem_offset),
+          GUINT_TO_POINTER (data.mem_offset));
+      }
+      stats = &replay.secure;
+      break;
+    case CODEC_TRACE_RELEASE:
+      offset = map_offset (offsets, record->mem_offset);
+      start = g_get_monotonic_time ();
+      ret = replay.ops->ioctl (replay.fd,
+        IOCTL_RW(IOCTL_CMD_RELEASE_BUFFER), &offset);
+      g_hash_table_remove (offsets, GUINT_TO_POINTER (record->mem_offset));
+      stats = &replay.release;
+      break;
+    case CODEC_TRACE_INVOKE:
+      data.api_index = record->api_index;
+      data.ctx_index = ctx_index;
+      data.mem_offset = map_offset (offsets, record->mem_offset);
+      data.buffer_size = record->size;
+      if (request->payload &&
+          data.mem_offset + record->payload_size <= replay.mem_size) {
+        memcpy (replay.mem + data.mem_offset, request->payload,
+          record->payload_size);
+      }
+      start = g_get_monotonic_time ();
+      ret = replay.ops->ioctl (replay.fd,
+        IOCTL_RW(IOCTL_CMD_INVOKE_API_AND_GET_DATA), &data);
+      if (ret == 0 && g_hash_table_remove (offsets,
+          GUINT_TO_POINTER (record->mem_offset))) {
+        g_hash_table_insert (offsets, GUINT_TO_POINTER (record->reply_offset),
+          GUINT_TO_POINTER (data.mem_offset));
+      }
+      if (record->api_index >= 0 && record->api_index < REPLAY_APIS) {
+        stats = &replay.apis[record->api_index];
+      } else {
+        GST_WARNING ("no stats for unknown api %d", record->api_index);
+      }
+      break;
+    default:
+      break;
+    }
+
+    if (stats) {
+      add_stats (stats, record, ret, g_get_monotonic_time () - start);
+    }
+
+next:
+    g_free (request->payload);
+    g_free (request);
+  }
+
+  // the trace may end before the memory was given back
+  g_hash_table_iter_init (&iter, offsets);
+  while (g_hash_table_iter_next (&iter, &key, &value)) {
+    uint32_t offset = GPOINTER_TO_UINT (value);
+
+    replay.ops->ioctl (replay.fd, IOCTL_RW(IOCTL_CMD_RELEASE_BUFFER), &offset);
+  }
+  g_hash_table_destroy (offsets);
+
+  return NULL;
+}
+
+static void
+print_stats (const char *name, ReplayStats *stats)
+{
+  if (!stats->count) {
+    return;
+  }
+  g_print ("%-30s %8u %8u %12" G_GINT64_FORMAT " %12" G_GINT64_FORMAT
+    " %12" G_GINT64_FORMAT "\n", name, stats->count, stats->failures,
+    stats->traced / stats->count, stats->replayed / stats->count,
+    stats->replayed_max);
+}
+
+int
+main (int argc, char *argv[])
+{
+  gboolean broker = FALSE;
+  GOptionEntry entries[] = {
+    { "realtime", 'r', 0, G_OPTION_ARG_NONE, &replay.realtime,
+      "Keep the timing of the trace", NULL },
+    { "broker", 'b', 0, G_OPTION_ARG_NONE, &broker,
+      "Send the requests to gst-maru-codec-broker", NULL },
+    { NULL }
+  };
+  GOptionContext *options;
+  GError *error = NULL;
+  IOCTL_Capabilities caps = { 0, };
+  GHashTable *contexts;
+  GHashTableIter iter;
+  gpointer key, value;
+  gint64 span, elapsed;
+  guint requests = 0;
+  int i;
+
+  options = g_option_context_new ("TRACE - replay the device requests of a trace");
+  g_option_context_add_main_entries (options, entries, NULL);
+  g_option_context_add_group (options, gst_init_get_option_group ());
+  if (!g_option_context_parse (options, &argc, &argv, &error) || argc != 2) {
+    g_printerr ("%s\n", error ? error->message :
+      "give the trace written with GST_MARU_TRACE");
+    return 1;
+  }
+  g_option_context_free (options);
+
+  GST_DEBUG_CATEGORY_INIT (maru_debug,
+      "tizen-emul", 0, "Tizen Emulator Codec Replay");
+
+  contexts = read_trace (argv[1], &span);
+  if (!contexts) {
+    return 1;
+  }
+
+  replay.ops = broker ? device_ops_broker : device_ops_loopback;
+  replay.fd = replay.ops->open ();
+  if (replay.fd < 0) {
+    perror ("[gst-maru-replay] failed to open codec device");
+    return 1;
+  }
+  replay.mem_size = CODEC_DEVICE_MEM_SIZE;
+  if (replay.ops->ioctl (replay.fd,
+      IOCTL_CAPS(IOCTL_CMD_GET_CAPABILITIES), &caps) == 0 && caps.mem_size) {
+    replay.mem_size = caps.mem_size;
+  }
+  replay.mem = replay.ops->mmap (replay.fd, replay.mem_size);
+  if (replay.mem == MAP_FAILED) {
+    perror ("[gst-maru-replay] memory mapping failure");
+    return 1;
+  }
+
+  replay.start = g_get_monotonic_time ();
+  g_hash_table_iter_init (&iter, contexts);
+  while (g_hash_table_iter_next (&iter, &key, &value)) {
+    ReplayContext *context = value;
+
+    requests += g_queue_get_length (&context->requests);
+    context->thread = g_thread_new ("replay", replay_context, context);
+  }
+  g_hash_table_iter_init (&iter, contexts);
+  while (g_hash_table_iter_next (&iter, &key, &value)) {
+    ReplayContext *context = value;
+
+    g_thread_join (context->thread);
+    g_free (context);
+  }
+  elapsed = g_get_monotonic_time () - replay.start;
+  g_hash_table_destroy (contexts);
+
+  g_print ("%-30s %8s %8s %12s %12s %12s\n", "request", "count", "failed",
+    "traced us", "replayed us", "max us");
+  for (i = 0; i < REPLAY_APIS; i++) {
+    print_stats (api_names[i], &replay.apis[i]);
+  }
+  print_stats ("secure_buffer", &replay.secure);
+  print_stats ("release_buffer", &replay.release);
+  g_print ("%u requests in %.3f s, traced in %.3f s\n", requests,
+    elapsed / 1e6, span / 1e6);
+
+  replay.ops->munmap (replay.mem, replay.mem_size);
+  replay.ops->close (replay.fd);
+
+  return 0;
+}
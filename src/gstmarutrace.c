@@ -0,0 +1,202 @@
+/*
+ * Gstreamer codec plugin for Tizen Emulator.
+ *
+ * Copyright (C) 2013 Samsung Electronics Co., Ltd. All rights reserved.
+ *
+ * Contact:
+ * KiTae Kim <kt920.kim@samsung.com>
+ * SeokYeon Hwang <syeon.hwang@samsung.com>
+ * YeongKyoon Lee <yeongkyoon.lee@samsung.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Contributors:
+ * - S-Core Co., Ltd
+ *
+ */
+
+#include <errno.h>
+
+#include "gstmaru.h"
+#include "gstmaruinterface.h"
+#include "gstmarudevice.h"
+#include "gstmarutrace.h"
+
+gboolean codec_tracing = FALSE;
+
+static GMutex trace_lock;
+static FILE *trace_file;
+static gint64 trace_start;
+static gboolean trace_header;
+// device memory secured but not sent yet, offset -> size
+static GHashTable *trace_requests;
+// offset -> index of the context a buffer belongs to
+static GHashTable *trace_owners;
+
+void
+gst_maru_trace_init (void)
+{
+  const gchar *path = g_getenv ("GST_MARU_TRACE");
+
+  if (!path || codec_tracing) {
+    return;
+  }
+
+  trace_file = fopen (path, "wb");
+  if (!trace_file) {
+    GST_ERROR ("failed to open trace file %s", path);
+    return;
+  }
+  trace_requests = g_hash_table_new (g_direct_hash, g_direct_equal);
+  trace_owners = g_hash_table_new (g_direct_hash, g_direct_equal);
+  trace_start = g_get_monotonic_time ();
+  codec_tracing = TRUE;
+
+  GST_INFO ("trace device requests to %s", path);
+}
+
+// called with trace_lock held
+static void
+trace_write (CodecTraceRecord *record, gint64 start, const void *payload)
+{
+  record->start = start - trace_start;
+  record->duration = g_get_monotonic_time () - start;
+
+  if (!trace_header) {
+    // the device is known once the first request is made
+    CodecTraceHeader header = { CODEC_TRACE_MAGIC, };
+
+    memcpy (header.magic, CODEC_TRACE_MAGIC, sizeof(header.magic));
+    header.device_version = device_version;
+    header.mem_size = device_caps.mem_size;
+    fwrite (&header, sizeof(header), 1, trace_file);
+    trace_header = TRUE;
+  }
+
+  fwrite (record, sizeof(*record), 1, trace_file);
+  if (record->payload_size) {
+    fwrite (payload, record->payload_size, 1, trace_file);
+  }
+  fflush (trace_file);
+}
+
+void
+gst_maru_trace_secure (int32_t ctx_index, uint32_t mem_offset,
+                          int32_t size, int ret, gint64 start)
+{
+  CodecTraceRecord record = { CODEC_TRACE_SECURE, };
+
+  record.err = ret < 0 ? errno : 0;
+  record.ctx_index = ctx_index;
+  record.mem_offset = mem_offset;
+  record.size = size;
+  record.ret = ret;
+
+  g_mutex_lock (&trace_lock);
+  if (ret == 0) {
+    g_hash_table_insert (trace_requests,
+      GUINT_TO_POINTER (mem_offset), GINT_TO_POINTER (size));
+    g_hash_table_insert (trace_owners,
+      GUINT_TO_POINTER (mem_offset), GINT_TO_POINTER (ctx_index));
+  }
+  trace_write (&record, start, NULL);
+  g_mutex_unlock (&trace_lock);
+}
+
+void
+gst_maru_trace_release (uint32_t mem_offset, int ret, gint64 start)
+{
+  CodecTraceRecord record = { CODEC_TRACE_RELEASE, };
+  gpointer owner = GINT_TO_POINTER (-1);
+
+  record.err = ret < 0 ? errno : 0;
+  record.mem_offset = mem_offset;
+  record.ret = ret;
+
+  g_mutex_lock (&trace_lock);
+  g_hash_table_lookup_extended (trace_owners,
+    GUINT_TO_POINTER (mem_offset), NULL, &owner);
+  g_hash_table_remove (trace_owners, GUINT_TO_POINTER (mem_offset));
+  g_hash_table_remove (trace_requests, GUINT_TO_POINTER (mem_offset));
+  record.ctx_index = GPOINTER_TO_INT (owner);
+  trace_write (&record, start, NULL);
+  g_mutex_unlock (&trace_lock);
+}
+
+// copies the request that is about to be sent from mem_offset, before
+// the reply may overwrite it
+gpointer
+gst_maru_trace_request (int32_t ctx_index, uint32_t mem_offset,
+                          uint32_t *payload_size)
+{
+  const uint8_t *request = (const uint8_t *)device_mem + mem_offset;
+  gpointer size, owner = GINT_TO_POINTER (-1), payload = NULL;
+
+  *payload_size = 0;
+
+  g_mutex_lock (&trace_lock);
+  g_hash_table_lookup_extended (trace_owners,
+    GUINT_TO_POINTER (mem_offset), NULL, &owner);
+  if (GPOINTER_TO_INT (owner) == ctx_index &&
+      g_hash_table_lookup_extended (trace_requests,
+        GUINT_TO_POINTER (mem_offset), NULL, &size)) {
+    // a request starts with the length of what follows
+    uint32_t limit = device_caps.mem_size - mem_offset;
+
+    if (GPOINTER_TO_INT (size) > 0) {
+      limit = MIN (limit, GPOINTER_TO_UINT (size));
+    }
+    *payload_size = MIN (limit, *(const uint32_t *)request + sizeof(uint32_t));
+    payload = g_memdup (request, *payload_size);
+    g_hash_table_remove (trace_requests, GUINT_TO_POINTER (mem_offset));
+  }
+  g_mutex_unlock (&trace_lock);
+
+  return payload;
+}
+
+void
+gst_maru_trace_invoke (int32_t ctx_index, int32_t api_index,
+                          uint32_t mem_offset, uint32_t reply_offset,
+                          int32_t buffer_size, int ret, gint64 start,
+                          gpointer request, uint32_t payload_size)
+{
+  CodecTraceRecord record = { CODEC_TRACE_INVOKE, };
+  gpointer owner = GINT_TO_POINTER (-1);
+
+  record.err = ret < 0 ? errno : 0;
+  record.ctx_index = ctx_index;
+  record.api_index = api_index;
+  record.mem_offset = mem_offset;
+  record.reply_offset = reply_offset;
+  record.size = buffer_size;
+  record.ret = ret;
+  record.payload_size = request ? payload_size : 0;
+
+  g_mutex_lock (&trace_lock);
+  g_hash_table_lookup_extended (trace_owners,
+    GUINT_TO_POINTER (mem_offset), NULL, &owner);
+  if (ret == 0 && reply_offset != mem_offset &&
+      GPOINTER_TO_INT (owner) == ctx_index) {
+    g_hash_table_remove (trace_owners, GUINT_TO_POINTER (mem_offset));
+    g_hash_table_insert (trace_owners,
+      GUINT_TO_POINTER (reply_offset), GINT_TO_POINTER (ctx_index));
+  }
+  trace_write (&record, start, request);
+  g_mutex_unlock (&trace_lock);
+
+  g_free (request);
+}
@@ -0,0 +1,86 @@
+/*
+ * Gstreamer codec plugin for Tizen Emulator.
+ *
+ * Copyright (C) 2013 Samsung Electronics Co., Ltd. All rights reserved.
+ *
+ * Contact:
+ * KiTae Kim <kt920.kim@samsung.com>
+ * SeokYeon Hwang <syeon.hwang@samsung.com>
+ * YeongKyoon Lee <yeongkyoon.lee@samsung.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Contributors:
+ * - S-Core Co., Ltd
+ *
+ */
+
+#ifndef __GST_MARU_TRACE_H__
+#define __GST_MARU_TRACE_H__
+
+#include "gstmaru.h"
+
+/*
+ * trace of the device traffic of a process, written when GST_MARU_TRACE
+ * names a file and replayed by gst-maru-codec-replay.
+ *
+ * a CodecTraceHeader is followed by CodecTraceRecords in the order the
+ * requests finished. a record of an invoke carries the request that was
+ * written to device memory before it, payload_size bytes.
+ */
+#define CODEC_TRACE_MAGIC       "MARUTRC1"
+
+enum codec_trace_type {
+  CODEC_TRACE_SECURE,
+  CODEC_TRACE_RELEASE,
+  CODEC_TRACE_INVOKE,
+};
+
+typedef struct {
+  char      magic[8];
+  int32_t   device_version;
+  uint32_t  mem_size;
+} __attribute__((packed)) CodecTraceHeader;
+
+typedef struct {
+  uint32_t  type;
+  int32_t   ctx_index;
+  int32_t   api_index;
+  uint32_t  mem_offset;     // buffer, or the request of an invoke
+  uint32_t  reply_offset;   // the reply of an invoke
+  int32_t   size;           // secured size, or buffer_size of an invoke
+  int32_t   ret;
+  int32_t   err;
+  int64_t   start;          // us since the trace began
+  int64_t   duration;       // us
+  uint32_t  payload_size;
+} __attribute__((packed)) CodecTraceRecord;
+
+extern gboolean codec_tracing;
+
+void gst_maru_trace_init (void);
+
+void gst_maru_trace_secure (int32_t ctx_index, uint32_t mem_offset,
+                          int32_t size, int ret, gint64 start);
+void gst_maru_trace_release (uint32_t mem_offset, int ret, gint64 start);
+gpointer gst_maru_trace_request (int32_t ctx_index, uint32_t mem_offset,
+                          uint32_t *payload_size);
+void gst_maru_trace_invoke (int32_t ctx_index, int32_t api_index,
+                          uint32_t mem_offset, uint32_t reply_offset,
+                          int32_t buffer_size, int ret, gint64 start,
+                          gpointer request, uint32_t payload_size);
+
+#endif
@@ -0,0 +1,524 @@
+/* GStreamer
+ * Copyright (C) <1999> Erik Walthinsen <omega@cse.ogi.edu>
+ * Copyright (C) 2013 Samsung Electronics Co., Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "gstmarudevice.h"
+#include "gstmaruutils.h"
+#include "gstmaruinterface.h"
+
+/* maru_transcode decodes a video stream and encodes it again without
+ * the pictures crossing into the guest. the device pipes the output of
+ * the decoder context into the encoder context, only packets are copied.
+ */
+
+enum
+{
+  ARG_0,
+  ARG_ENCODER,
+  ARG_BIT_RATE,
+  ARG_PRIORITY
+};
+
+typedef struct {
+  GstClockTime timestamp;
+  GstClockTime duration;
+} TranscodeTimestamp;
+
+typedef struct _GstMaruTranscode
+{
+  GstElement element;
+
+  GstPad *srcpad;
+  GstPad *sinkpad;
+
+  CodecElement *decoder;
+  CodecContext *dec_context;
+  CodecDevice *dec_dev;
+
+  CodecElement *encoder;
+  CodecContext *enc_context;
+  CodecDevice *enc_dev;
+
+  gboolean opened;
+
+  /* timestamps of the pictures the encoder holds */
+  GQueue *pending;
+
+  guint8 *working_buf;
+  gulong working_buf_size;
+
+  /* properties */
+  gchar *encoder_name;
+  gulong bitrate;
+} GstMaruTranscode;
+
+typedef struct _GstMaruTranscodeClass
+{
+  GstElementClass parent_class;
+} GstMaruTranscodeClass;
+
+#define DEFAULT_VIDEO_BITRATE   300000
+#define DEFAULT_PRIORITY        CODEC_PRIORITY_NORMAL
+
+G_DEFINE_TYPE (GstMaruTranscode, gst_marutranscode, GST_TYPE_ELEMENT);
+
+/* codecs the templates and the negotiation choose from */
+static GList *transcode_codecs = NULL;
+
+static void gst_marutranscode_finalize (GObject *object);
+static void gst_marutranscode_set_property (GObject * object,
+    guint prop_id, const GValue * value, GParamSpec * pspec);
+static void gst_marutranscode_get_property (GObject * object,
+    guint prop_id, GValue * value, GParamSpec * pspec);
+static GstStateChangeReturn gst_marutranscode_change_state (GstElement *element,
+    GstStateChange transition);
+static gboolean gst_marutranscode_sink_event (GstPad *pad, GstObject *parent,
+    GstEvent *event);
+static GstFlowReturn gst_marutranscode_chain (GstPad *pad, GstObject *parent,
+    GstBuffer *buffer);
+
+static CodecElement *
+gst_marutranscode_find_codec_by_name (const gchar *name)
+{
+  CodecElement *codec;
+  GList *elem;
+
+  for (elem = transcode_codecs; elem; elem = elem->next) {
+    codec = (CodecElement *)elem->data;
+    if (codec->media_type == AVMEDIA_TYPE_VIDEO &&
+        codec->codec_type == CODEC_TYPE_ENCODE && !strcmp (codec->name, name)) {
+      return codec;
+    }
+  }
+
+  return NULL;
+}
+
+static void
+gst_marutranscode_class_init (GstMaruTranscodeClass *klass)
+{
+  GST_DEBUG (" >> ENTER");
+  GObjectClass *gobject_class = (GObjectClass *) klass;
+  GstElementClass *element_class = (GstElementClass *) klass;
+
+  gobject_class->set_property = gst_marutranscode_set_property;
+  gobject_class->get_property = gst_marutranscode_get_property;
+  gobject_class->finalize = gst_marutranscode_finalize;
+
+  g_object_class_install_property (gobject_class, ARG_ENCODER,
+      g_param_spec_string ("encoder", "Encoder",
+      "Name of the codec to encode to, e.g. mpeg4. "
+      "NULL takes the first one downstream accepts",
+      NULL, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, ARG_BIT_RATE,
+      g_param_spec_ulong ("bitrate", "Bit Rate",
+      "Target VIDEO Bitrate", 0, G_MAXULONG, DEFAULT_VIDEO_BITRATE,
+      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, ARG_PRIORITY,
+      g_param_spec_enum ("priority", "Priority",
+      "Which streams the device serves first",
+      GST_MARU_TYPE_PRIORITY, DEFAULT_PRIORITY,
+      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  gst_element_class_set_metadata (element_class,
+      "Maru video transcoder",
+      "Codec/Decoder/Encoder/Video",
+      "Decodes and encodes a video stream on the codec device",
+      "Sooyoung Ha <yoosah.ha@samsung.com>");
+
+  gst_element_class_add_pad_template (element_class,
+      gst_pad_template_new ("sink", GST_PAD_SINK, GST_PAD_ALWAYS,
+          gst_maru_codecs_to_caps (transcode_codecs,
+              CODEC_TYPE_DECODE, AVMEDIA_TYPE_VIDEO)));
+  gst_element_class_add_pad_template (element_class,
+      gst_pad_template_new ("src", GST_PAD_SRC, GST_PAD_ALWAYS,
+          gst_maru_codecs_to_caps (transcode_codecs,
+              CODEC_TYPE_ENCODE, AVMEDIA_TYPE_VIDEO)));
+
+  element_class->change_state = gst_marutranscode_change_state;
+}
+
+static void
+gst_marutranscode_init (GstMaruTranscode *marutc)
+{
+  GST_DEBUG (" >> ENTER");
+  GstElementClass *element_class = GST_ELEMENT_GET_CLASS (marutc);
+
+  marutc->sinkpad = gst_pad_new_from_template (
+      gst_element_class_get_pad_template (element_class, "sink"), "sink");
+  gst_pad_set_chain_function (marutc->sinkpad,
+      GST_DEBUG_FUNCPTR (gst_marutranscode_chain));
+  gst_pad_set_event_function (marutc->sinkpad,
+      GST_DEBUG_FUNCPTR (gst_marutranscode_sink_event));
+  gst_element_add_pad (GST_ELEMENT (marutc), marutc->sinkpad);
+
+  marutc->srcpad = gst_pad_new_from_template (
+      gst_element_class_get_pad_template (element_class, "src"), "src");
+  gst_pad_use_fixed_caps (marutc->srcpad);
+  gst_element_add_pad (GST_ELEMENT (marutc), marutc->srcpad);
+
+  // instead of AVCodecContext
+  marutc->dec_context = g_malloc0 (sizeof(CodecContext));
+  marutc->dec_context->video.pix_fmt = PIX_FMT_NONE;
+  marutc->dec_context->audio.sample_fmt = SAMPLE_FMT_NONE;
+  marutc->dec_dev = g_malloc0 (sizeof(CodecDevice));
+
+  marutc->enc_context = g_malloc0 (sizeof(CodecContext));
+  marutc->enc_context->video.pix_fmt = PIX_FMT_NONE;
+  marutc->enc_context->audio.sample_fmt = SAMPLE_FMT_NONE;
+  marutc->enc_dev = g_malloc0 (sizeof(CodecDevice));
+
+  marutc->pending = g_queue_new ();
+  marutc->bitrate = DEFAULT_VIDEO_BITRATE;
+}
+
+static void
+gst_marutranscode_clear_pending (GstMaruTranscode *marutc)
+{
+  g_queue_foreach (marutc->pending, (GFunc) g_free, NULL);
+  g_queue_clear (marutc->pending);
+}
+
+static void
+gst_marutranscode_close (GstMaruTranscode *marutc)
+{
+  GST_DEBUG (" >> ENTER");
+  if (!marutc->opened) {
+    return;
+  }
+
+  gst_maru_avcodec_close (marutc->enc_context, marutc->enc_dev);
+  gst_maru_avcodec_close (marutc->dec_context, marutc->dec_dev);
+  gst_marutranscode_clear_pending (marutc);
+  marutc->opened = FALSE;
+}
+
+static void
+gst_marutranscode_finalize (GObject *object)
+{
+  GST_DEBUG (" >> ENTER");
+  GstMaruTranscode *marutc = (GstMaruTranscode *) object;
+
+  gst_marutranscode_close (marutc);
+
+  g_queue_free (marutc->pending);
+  g_free (marutc->working_buf);
+  g_free (marutc->encoder_name);
+
+  g_free (marutc->dec_context);
+  g_free (marutc->dec_dev);
+  g_free (marutc->enc_context);
+  g_free (marutc->enc_dev);
+
+  G_OBJECT_CLASS (gst_marutranscode_parent_class)->finalize (object);
+}
+
+static gboolean
+gst_marutranscode_setcaps (GstMaruTranscode *marutc, GstCaps *caps)
+{
+  GST_DEBUG (" >> ENTER");
+  GstStructure *structure;
+  GstCaps *allowed_caps, *other_caps, *icaps;
+  gboolean ret;
+
+  gst_marutranscode_close (marutc);
+
+  structure = gst_caps_get_structure (caps, 0);
+  if (!gst_structure_has_field (structure, "width") ||
+      !gst_structure_has_field (structure, "height")) {
+    GST_ERROR_OBJECT (marutc, "the picture size is needed to set up the encoder");
+    return FALSE;
+  }
+
+  marutc->decoder = gst_maru_caps_to_codec (transcode_codecs, caps,
+      CODEC_TYPE_DECODE, AVMEDIA_TYPE_VIDEO);
+  if (!marutc->decoder) {
+    GST_ERROR_OBJECT (marutc, "no decoder for %" GST_PTR_FORMAT, caps);
+    return FALSE;
+  }
+
+  gst_maru_caps_with_codecname (marutc->decoder->name,
+      marutc->decoder->media_type, caps, marutc->dec_context);
+  if (!marutc->dec_context->video.fps_d || !marutc->dec_context->video.fps_n) {
+    GST_DEBUG_OBJECT (marutc, "forcing 25/1 framerate");
+    marutc->dec_context->video.fps_n = 1;
+    marutc->dec_context->video.fps_d = 25;
+  }
+
+  allowed_caps = gst_pad_get_allowed_caps (marutc->srcpad);
+  if (!allowed_caps) {
+    allowed_caps = gst_pad_get_pad_template_caps (marutc->srcpad);
+  }
+
+  if (marutc->encoder_name) {
+    marutc->encoder = gst_marutranscode_find_codec_by_name (marutc->encoder_name);
+  } else {
+    marutc->encoder = gst_maru_caps_to_codec (transcode_codecs,
+        allowed_caps, CODEC_TYPE_ENCODE, AVMEDIA_TYPE_VIDEO);
+  }
+  if (!marutc->encoder) {
+    GST_ERROR_OBJECT (marutc, "no encoder for %" GST_PTR_FORMAT, allowed_caps);
+    gst_caps_unref (allowed_caps);
+    return FALSE;
+  }
+
+  // the encoder takes the pictures of the decoder, the host converts
+  // them when the encoder wants another pix_fmt.
+  marutc->enc_context->video = marutc->dec_context->video;
+  marutc->enc_context->video.pix_fmt = marutc->encoder->pix_fmts[0];
+  marutc->enc_context->bit_rate = marutc->bitrate;
+
+  if (gst_maru_avcodec_open (marutc->dec_context, marutc->decoder,
+        marutc->dec_dev) < 0) {
+    GST_ERROR_OBJECT (marutc, "failed to open maru_%sdec", marutc->decoder->name);
+    gst_caps_unref (allowed_caps);
+    return FALSE;
+  }
+
+  if (gst_maru_avcodec_open (marutc->enc_context, marutc->encoder,
+        marutc->enc_dev) < 0) {
+    GST_ERROR_OBJECT (marutc, "failed to open maru_%senc", marutc->encoder->name);
+    gst_maru_avcodec_close (marutc->dec_context, marutc->dec_dev);
+    gst_caps_unref (allowed_caps);
+    return FALSE;
+  }
+
+  marutc->opened = TRUE;
+
+  gst_maru_caps_with_codecname (marutc->encoder->name,
+      marutc->encoder->media_type, allowed_caps, marutc->enc_context);
+
+  other_caps =
+    gst_maru_codecname_to_caps (marutc->encoder->name, marutc->enc_context, TRUE);
+  if (!other_caps) {
+    GST_DEBUG ("Unsupported codec - no caps found");
+    gst_caps_unref (allowed_caps);
+    gst_marutranscode_close (marutc);
+    return FALSE;
+  }
+
+  icaps = gst_caps_intersect (allowed_caps, other_caps);
+  gst_caps_unref (allowed_caps);
+  gst_caps_unref (other_caps);
+  if (gst_caps_is_empty (icaps)) {
+    gst_caps_unref (icaps);
+    gst_marutranscode_close (marutc);
+    return FALSE;
+  }
+  icaps = gst_caps_truncate (icaps);
+
+  g_free (marutc->working_buf);
+  marutc->working_buf_size =
+    marutc->enc_context->video.width * marutc->enc_context->video.height * 6 +
+    FF_MIN_BUFFER_SIZE;
+  marutc->working_buf = g_malloc0 (marutc->working_buf_size);
+
+  GST_DEBUG_OBJECT (marutc, "%s to %" GST_PTR_FORMAT,
+      marutc->decoder->name, icaps);
+
+  ret = gst_pad_push_event (marutc->srcpad, gst_event_new_caps (icaps));
+  gst_caps_unref (icaps);
+
+  return ret;
+}
+
+static gboolean
+gst_marutranscode_sink_event (GstPad *pad, GstObject *parent, GstEvent *event)
+{
+  GST_DEBUG (" >> ENTER");
+  GstMaruTranscode *marutc = (GstMaruTranscode *) parent;
+  GstCaps *caps;
+  gboolean ret;
+
+  switch (GST_EVENT_TYPE (event)) {
+  case GST_EVENT_CAPS:
+    gst_event_parse_caps (event, &caps);
+    ret = gst_marutranscode_setcaps (marutc, caps);
+    gst_event_unref (event);
+    return ret;
+  case GST_EVENT_FLUSH_STOP:
+    if (marutc->opened) {
+      interface->flush_buffers (marutc->dec_context, marutc->dec_dev);
+      interface->flush_buffers (marutc->enc_context, marutc->enc_dev);
+    }
+    gst_marutranscode_clear_pending (marutc);
+    break;
+  default:
+    break;
+  }
+
+  return gst_pad_event_default (pad, parent, event);
+}
+
+static GstFlowReturn
+gst_marutranscode_chain (GstPad *pad, GstObject *parent, GstBuffer *buffer)
+{
+  GST_DEBUG (" >> ENTER");
+  GstMaruTranscode *marutc = (GstMaruTranscode *) parent;
+  TranscodeTimestamp *ts;
+  GstBuffer *outbuf;
+  GstMapInfo mapinfo;
+  int got_picture = 0, coded_frame = 0, is_keyframe = 0;
+  gint len;
+
+  if (G_UNLIKELY (!marutc->opened)) {
+    GST_ELEMENT_ERROR (marutc, CORE, NEGOTIATION, (NULL),
+        ("maru_transcode is not set up"));
+    gst_buffer_unref (buffer);
+    return GST_FLOW_NOT_NEGOTIATED;
+  }
+
+  gst_buffer_map (buffer, &mapinfo, GST_MAP_READ);
+  len = interface->transcode_video (marutc->dec_context, marutc->enc_context,
+      mapinfo.data, mapinfo.size, -1, GST_BUFFER_OFFSET (buffer),
+      marutc->working_buf, marutc->working_buf_size,
+      &got_picture, &coded_frame, &is_keyframe, marutc->dec_dev);
+  gst_buffer_unmap (buffer, &mapinfo);
+
+  if (len < 0) {
+    GST_ERROR_OBJECT (marutc, "failed to transcode buffer");
+    gst_buffer_unref (buffer);
+    return GST_FLOW_OK;
+  }
+
+  if (got_picture) {
+    ts = g_new (TranscodeTimestamp, 1);
+    ts->timestamp = GST_BUFFER_PTS_IS_VALID (buffer) ?
+      GST_BUFFER_PTS (buffer) : GST_BUFFER_DTS (buffer);
+    ts->duration = GST_BUFFER_DURATION (buffer);
+    g_queue_push_tail (marutc->pending, ts);
+  }
+  gst_buffer_unref (buffer);
+
+  /* Encoder needs more data */
+  if (!len) {
+    return GST_FLOW_OK;
+  }
+
+  outbuf = gst_buffer_new_allocate (NULL, len, NULL);
+  gst_buffer_fill (outbuf, 0, marutc->working_buf, len);
+
+  ts = g_queue_pop_head (marutc->pending);
+  if (ts) {
+    GST_BUFFER_PTS (outbuf) = ts->timestamp;
+    GST_BUFFER_DURATION (outbuf) = ts->duration;
+    g_free (ts);
+  }
+
+  /* buggy codec may not set coded_frame */
+  if (coded_frame && !is_keyframe) {
+    GST_BUFFER_FLAG_SET (outbuf, GST_BUFFER_FLAG_DELTA_UNIT);
+  }
+
+  return gst_pad_push (marutc->srcpad, outbuf);
+}
+
+static GstStateChangeReturn
+gst_marutranscode_change_state (GstElement *element, GstStateChange transition)
+{
+  GST_DEBUG (" >> ENTER");
+  GstMaruTranscode *marutc = (GstMaruTranscode *) element;
+  GstStateChangeReturn ret;
+
+  ret = GST_ELEMENT_CLASS (gst_marutranscode_parent_class)->change_state (element,
+      transition);
+
+  switch (transition) {
+  case GST_STATE_CHANGE_PAUSED_TO_READY:
+    gst_marutranscode_close (marutc);
+    break;
+  default:
+    break;
+  }
+
+  return ret;
+}
+
+static void
+gst_marutranscode_set_property (GObject *object,
+  guint prop_id, const GValue *value, GParamSpec *pspec)
+{
+  GST_DEBUG (" >> ENTER");
+  GstMaruTranscode *marutc = (GstMaruTranscode *) object;
+
+  if (prop_id == ARG_PRIORITY) {
+    // both contexts, read at every request
+    marutc->dec_context->priority = g_value_get_enum (value);
+    marutc->enc_context->priority = marutc->dec_context->priority;
+    return;
+  }
+
+  if (marutc->opened) {
+    GST_WARNING_OBJECT (marutc,
+      "Can't change properties once the transcoder is setup !");
+    return;
+  }
+
+  switch (prop_id) {
+    case ARG_ENCODER:
+      g_free (marutc->encoder_name);
+      marutc->encoder_name = g_value_dup_string (value);
+      break;
+    case ARG_BIT_RATE:
+      marutc->bitrate = g_value_get_ulong (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_marutranscode_get_property (GObject *object,
+  guint prop_id, GValue *value, GParamSpec *pspec)
+{
+  GST_DEBUG (" >> ENTER");
+  GstMaruTranscode *marutc = (GstMaruTranscode *) object;
+
+  switch (prop_id) {
+    case ARG_ENCODER:
+      g_value_set_string (value, marutc->encoder_name);
+      break;
+    case ARG_BIT_RATE:
+      g_value_set_ulong (value, marutc->bitrate);
+      break;
+    case ARG_PRIORITY:
+      g_value_set_enum (value, marutc->dec_context->priority);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+gboolean
+gst_marutranscode_register (GstPlugin *plugin, GList *element)
+{
+  if (!interface->transcode_video) {
+    GST_DEBUG ("the device can not transcode, maru_transcode is not registered");
+    return TRUE;
+  }
+
+  transcode_codecs = element;
+
+  return gst_element_register (plugin, "maru_transcode", GST_RANK_NONE,
+      gst_marutranscode_get_type ());
+}
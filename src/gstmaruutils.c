@@ -1304,99 +1304,210 @@ gst_maru_codecname_to_caps (const char *name, CodecContext *ctx, gboolean encode
   return caps;
 }
 
+#define PIX_FMT_INFO_PAL    (1 << 0)  /* 256 x 4 bytes palette follows the picture */
+
 typedef struct PixFmtInfo
 {
+  uint8_t nb_planes;            /* 0 if the layout is not known (hwaccel formats) */
   uint8_t x_chroma_shift;       /* X chroma subsampling factor is 2 ^ shift */
   uint8_t y_chroma_shift;       /* Y chroma subsampling factor is 2 ^ shift */
+  uint8_t flags;
+  uint8_t depth[4];             /* bits per pixel of each plane */
 } PixFmtInfo;
 
-static PixFmtInfo pix_fmt_info[PIX_FMT_NB];
-
-void
-gst_maru_init_pix_fmt_info (void)
-{
-  GST_DEBUG (" >> ENTER ");
-  pix_fmt_info[PIX_FMT_YUV420P].x_chroma_shift = 1,
-  pix_fmt_info[PIX_FMT_YUV420P].y_chroma_shift = 1;
+/* plane 1 and 2 are chroma planes and subsampled by the chroma shifts,
+ * plane 0 and the alpha plane 3 are not. */
+#define PACKED(bpp) \
+  { 1, 0, 0, 0, { bpp, 0, 0, 0 } }
+#define PACKED_YUV(xs, bpp) \
+  { 1, xs, 0, 0, { bpp, 0, 0, 0 } }
+#define PLANAR(xs, ys, d) \
+  { 3, xs, ys, 0, { d, d, d, 0 } }
+#define PLANAR_ALPHA(xs, ys, d) \
+  { 4, xs, ys, 0, { d, d, d, d } }
+#define SEMI_PLANAR(xs, ys) \
+  { 2, xs, ys, 0, { 8, 16, 0, 0 } }
+
+static const PixFmtInfo pix_fmt_info[PIX_FMT_NB] = {
+  /* YUV formats */
+  [PIX_FMT_YUV420P]     = PLANAR (1, 1, 8),
+  [PIX_FMT_YUVJ420P]    = PLANAR (1, 1, 8),
+  [PIX_FMT_YUV422P]     = PLANAR (1, 0, 8),
+  [PIX_FMT_YUVJ422P]    = PLANAR (1, 0, 8),
+  [PIX_FMT_YUV444P]     = PLANAR (0, 0, 8),
+  [PIX_FMT_YUVJ444P]    = PLANAR (0, 0, 8),
+  [PIX_FMT_YUV440P]     = PLANAR (0, 1, 8),
+  [PIX_FMT_YUVJ440P]    = PLANAR (0, 1, 8),
+  [PIX_FMT_YUV410P]     = PLANAR (2, 2, 8),
+  [PIX_FMT_YUV411P]     = PLANAR (2, 0, 8),
+  [PIX_FMT_YUVA420P]    = PLANAR_ALPHA (1, 1, 8),
+  [PIX_FMT_YUVA422P]    = PLANAR_ALPHA (1, 0, 8),
+  [PIX_FMT_YUVA444P]    = PLANAR_ALPHA (0, 0, 8),
+
+  [PIX_FMT_NV12]        = SEMI_PLANAR (1, 1),
+  [PIX_FMT_NV21]        = SEMI_PLANAR (1, 1),
+
+  [PIX_FMT_YUYV422]     = PACKED_YUV (1, 16),
+  [PIX_FMT_UYVY422]     = PACKED_YUV (1, 16),
+  [PIX_FMT_UYYVYY411]   = PACKED_YUV (2, 12),
+
+  /* high bit depth YUV formats, samples are stored in 16 bits */
+  [PIX_FMT_YUV420P9BE]  = PLANAR (1, 1, 16),
+  [PIX_FMT_YUV420P9LE]  = PLANAR (1, 1, 16),
+  [PIX_FMT_YUV420P10BE] = PLANAR (1, 1, 16),
+  [PIX_FMT_YUV420P10LE] = PLANAR (1, 1, 16),
+  [PIX_FMT_YUV420P16BE] = PLANAR (1, 1, 16),
+  [PIX_FMT_YUV420P16LE] = PLANAR (1, 1, 16),
+  [PIX_FMT_YUV422P9BE]  = PLANAR (1, 0, 16),
+  [PIX_FMT_YUV422P9LE]  = PLANAR (1, 0, 16),
+  [PIX_FMT_YUV422P10BE] = PLANAR (1, 0, 16),
+  [PIX_FMT_YUV422P10LE] = PLANAR (1, 0, 16),
+  [PIX_FMT_YUV422P16BE] = PLANAR (1, 0, 16),
+  [PIX_FMT_YUV422P16LE] = PLANAR (1, 0, 16),
+  [PIX_FMT_YUV444P9BE]  = PLANAR (0, 0, 16),
+  [PIX_FMT_YUV444P9LE]  = PLANAR (0, 0, 16),
+  [PIX_FMT_YUV444P10BE] = PLANAR (0, 0, 16),
+  [PIX_FMT_YUV444P10LE] = PLANAR (0, 0, 16),
+  [PIX_FMT_YUV444P16BE] = PLANAR (0, 0, 16),
+  [PIX_FMT_YUV444P16LE] = PLANAR (0, 0, 16),
+  [PIX_FMT_YUVA420P9BE]  = PLANAR_ALPHA (1, 1, 16),
+  [PIX_FMT_YUVA420P9LE]  = PLANAR_ALPHA (1, 1, 16),
+  [PIX_FMT_YUVA420P10BE] = PLANAR_ALPHA (1, 1, 16),
+  [PIX_FMT_YUVA420P10LE] = PLANAR_ALPHA (1, 1, 16),
+  [PIX_FMT_YUVA420P16BE] = PLANAR_ALPHA (1, 1, 16),
+  [PIX_FMT_YUVA420P16LE] = PLANAR_ALPHA (1, 1, 16),
+  [PIX_FMT_YUVA422P9BE]  = PLANAR_ALPHA (1, 0, 16),
+  [PIX_FMT_YUVA422P9LE]  = PLANAR_ALPHA (1, 0, 16),
+  [PIX_FMT_YUVA422P10BE] = PLANAR_ALPHA (1, 0, 16),
+  [PIX_FMT_YUVA422P10LE] = PLANAR_ALPHA (1, 0, 16),
+  [PIX_FMT_YUVA422P16BE] = PLANAR_ALPHA (1, 0, 16),
+  [PIX_FMT_YUVA422P16LE] = PLANAR_ALPHA (1, 0, 16),
+  [PIX_FMT_YUVA444P9BE]  = PLANAR_ALPHA (0, 0, 16),
+  [PIX_FMT_YUVA444P9LE]  = PLANAR_ALPHA (0, 0, 16),
+  [PIX_FMT_YUVA444P10BE] = PLANAR_ALPHA (0, 0, 16),
+  [PIX_FMT_YUVA444P10LE] = PLANAR_ALPHA (0, 0, 16),
+  [PIX_FMT_YUVA444P16BE] = PLANAR_ALPHA (0, 0, 16),
+  [PIX_FMT_YUVA444P16LE] = PLANAR_ALPHA (0, 0, 16),
+
+  /* gray formats */
+  [PIX_FMT_GRAY8]       = PACKED (8),
+  [PIX_FMT_GRAY16BE]    = PACKED (16),
+  [PIX_FMT_GRAY16LE]    = PACKED (16),
+  [PIX_FMT_Y400A]       = PACKED (16),
+  [PIX_FMT_MONOWHITE]   = PACKED (1),
+  [PIX_FMT_MONOBLACK]   = PACKED (1),
 
-  pix_fmt_info[PIX_FMT_YUV422P].x_chroma_shift = 1;
-  pix_fmt_info[PIX_FMT_YUV422P].y_chroma_shift = 0;
+  /* RGB formats */
+  [PIX_FMT_PAL8]        = { 1, 0, 0, PIX_FMT_INFO_PAL, { 8, 0, 0, 0 } },
+  [PIX_FMT_RGB24]       = PACKED (24),
+  [PIX_FMT_BGR24]       = PACKED (24),
+  [PIX_FMT_ARGB]        = PACKED (32),
+  [PIX_FMT_RGBA]        = PACKED (32),
+  [PIX_FMT_ABGR]        = PACKED (32),
+  [PIX_FMT_BGRA]        = PACKED (32),
+  [PIX_FMT_RGB48BE]     = PACKED (48),
+  [PIX_FMT_RGB48LE]     = PACKED (48),
+  [PIX_FMT_BGR48BE]     = PACKED (48),
+  [PIX_FMT_BGR48LE]     = PACKED (48),
+  [PIX_FMT_RGB565BE]    = PACKED (16),
+  [PIX_FMT_RGB565LE]    = PACKED (16),
+  [PIX_FMT_RGB555BE]    = PACKED (16),
+  [PIX_FMT_RGB555LE]    = PACKED (16),
+  [PIX_FMT_BGR565BE]    = PACKED (16),
+  [PIX_FMT_BGR565LE]    = PACKED (16),
+  [PIX_FMT_BGR555BE]    = PACKED (16),
+  [PIX_FMT_BGR555LE]    = PACKED (16),
+  [PIX_FMT_RGB444LE]    = PACKED (16),
+  [PIX_FMT_RGB444BE]    = PACKED (16),
+  [PIX_FMT_BGR444LE]    = PACKED (16),
+  [PIX_FMT_BGR444BE]    = PACKED (16),
+  [PIX_FMT_RGB8]        = PACKED (8),
+  [PIX_FMT_BGR8]        = PACKED (8),
+  [PIX_FMT_RGB4_BYTE]   = PACKED (8),
+  [PIX_FMT_BGR4_BYTE]   = PACKED (8),
+  [PIX_FMT_RGB4]        = PACKED (4),
+  [PIX_FMT_BGR4]        = PACKED (4),
+
+  /* planar RGB formats */
+  [PIX_FMT_GBRP]        = PLANAR (0, 0, 8),
+  [PIX_FMT_GBRP9BE]     = PLANAR (0, 0, 16),
+  [PIX_FMT_GBRP9LE]     = PLANAR (0, 0, 16),
+  [PIX_FMT_GBRP10BE]    = PLANAR (0, 0, 16),
+  [PIX_FMT_GBRP10LE]    = PLANAR (0, 0, 16),
+  [PIX_FMT_GBRP16BE]    = PLANAR (0, 0, 16),
+  [PIX_FMT_GBRP16LE]    = PLANAR (0, 0, 16),
+
+  /* hardware accelerated formats are left zeroed. */
+};
 
-  pix_fmt_info[PIX_FMT_YUV444P].x_chroma_shift = 0;
-  pix_fmt_info[PIX_FMT_YUV444P].y_chroma_shift = 0;
+#undef PACKED
+#undef PACKED_YUV
+#undef PLANAR
+#undef PLANAR_ALPHA
+#undef SEMI_PLANAR
 
-  pix_fmt_info[PIX_FMT_YUYV422].x_chroma_shift = 1;
-  pix_fmt_info[PIX_FMT_YUYV422].y_chroma_shift = 0;
+int
+gst_maru_avpicture_layout (int pix_fmt, int width, int height,
+    int offsets[4], int strides[4])
+{
+  GST_DEBUG (" >> ENTER ");
+  const PixFmtInfo *pinfo;
+  int fsize = 0;
+  int plane, w, h, stride;
 
-  pix_fmt_info[PIX_FMT_YUV410P].x_chroma_shift = 2;
-  pix_fmt_info[PIX_FMT_YUV410P].y_chroma_shift = 2;
+  if (pix_fmt < 0 || pix_fmt >= PIX_FMT_NB) {
+    return -1;
+  }
 
-  pix_fmt_info[PIX_FMT_YUV411P].x_chroma_shift = 2;
-  pix_fmt_info[PIX_FMT_YUV411P].y_chroma_shift = 0;
+  pinfo = &pix_fmt_info[pix_fmt];
+  if (pinfo->nb_planes == 0) {
+    return -1;
+  }
 
-  /* RGB formats */
-  pix_fmt_info[PIX_FMT_RGB24].x_chroma_shift = 0;
-  pix_fmt_info[PIX_FMT_RGB24].y_chroma_shift = 0;
+  for (plane = 0; plane < 4; plane++) {
+    if (plane >= pinfo->nb_planes) {
+      if (offsets) {
+        offsets[plane] = 0;
+      }
+      if (strides) {
+        strides[plane] = 0;
+      }
+      continue;
+    }
 
-  pix_fmt_info[PIX_FMT_BGR24].x_chroma_shift = 0;
-  pix_fmt_info[PIX_FMT_BGR24].y_chroma_shift = 0;
+    if (plane == 1 || plane == 2) {
+      w = DIV_ROUND_UP_X(width, pinfo->x_chroma_shift);
+      h = DIV_ROUND_UP_X(height, pinfo->y_chroma_shift);
+    } else {
+      /* luma is padded so that it covers the last chroma sample. */
+      w = ROUND_UP_X(width, pinfo->x_chroma_shift);
+      h = ROUND_UP_X(height, pinfo->y_chroma_shift);
+    }
+    stride = ROUND_UP_4((w * pinfo->depth[plane] + 7) >> 3);
 
-  pix_fmt_info[PIX_FMT_RGB32].x_chroma_shift = 0;
-  pix_fmt_info[PIX_FMT_RGB32].y_chroma_shift = 0;
+    if (offsets) {
+      offsets[plane] = fsize;
+    }
+    if (strides) {
+      strides[plane] = stride;
+    }
+    fsize += stride * h;
+  }
 
-  pix_fmt_info[PIX_FMT_RGB565].x_chroma_shift = 0;
-  pix_fmt_info[PIX_FMT_RGB565].y_chroma_shift = 0;
+  if (pinfo->flags & PIX_FMT_INFO_PAL) {
+    /* the palette is transported right after the picture data. */
+    fsize += 256 * 4;
+  }
 
-  pix_fmt_info[PIX_FMT_RGB555].x_chroma_shift = 0;
-  pix_fmt_info[PIX_FMT_RGB555].y_chroma_shift = 0;
+  return fsize;
 }
 
 int
 gst_maru_avpicture_size (int pix_fmt, int width, int height)
 {
   GST_DEBUG (" >> ENTER ");
-  int size, w2, h2, size2;
-  int stride, stride2;
-  int fsize;
-  PixFmtInfo *pinfo;
-
-  pinfo = &pix_fmt_info[pix_fmt];
 
-  switch (pix_fmt) {
-  case PIX_FMT_YUV420P:
-  case PIX_FMT_YUV422P:
-  case PIX_FMT_YUV444P:
-  case PIX_FMT_YUV410P:
-  case PIX_FMT_YUV411P:
-    stride = ROUND_UP_4(width);
-    h2 = ROUND_UP_X(height, pinfo->y_chroma_shift);
-    size = stride * h2;
-    w2 = DIV_ROUND_UP_X(width, pinfo->x_chroma_shift);
-    stride2 = ROUND_UP_4(w2);
-    h2 = DIV_ROUND_UP_X(height, pinfo->y_chroma_shift);
-    size2 = stride2 * h2;
-    fsize = size + 2 * size2;
-    break;
-  case PIX_FMT_RGB24:
-  case PIX_FMT_BGR24:
-    stride = ROUND_UP_4 (width * 3);
-    fsize = stride * height;
-    break;
-  case PIX_FMT_RGB32:
-    stride = width * 4;
-    fsize = stride * height;
-    break;
-  case PIX_FMT_RGB555:
-  case PIX_FMT_RGB565:
-    stride = ROUND_UP_4 (width * 2);
-    fsize = stride * height;
-    break;
-  default:
-    fsize = -1;
-    break;
-  }
-
-  return fsize;
+  return gst_maru_avpicture_layout (pix_fmt, width, height, NULL, NULL);
 }
 
 int
@@ -1626,3 +1737,82 @@ gst_maru_audioinfo_to_context (GstAudioInfo *info, CodecContext *context)
 
   context->audio.sample_fmt = smpl_fmt;
 }
+
+/* the caps of every codec of a kind, for elements that take any of them */
+GstCaps *
+gst_maru_codecs_to_caps (GList *codecs, int codec_type, int media_type)
+{
+  GstCaps *caps = gst_caps_new_empty ();
+  GstCaps *codec_caps;
+  CodecElement *codec;
+  GList *elem;
+
+  for (elem = codecs; elem; elem = elem->next) {
+    codec = (CodecElement *)elem->data;
+    if (codec->codec_type != codec_type || codec->media_type != media_type) {
+      continue;
+    }
+    codec_caps = gst_maru_codecname_to_caps (codec->name, NULL,
+        codec_type == CODEC_TYPE_ENCODE);
+    if (codec_caps) {
+      caps = gst_caps_merge (caps, codec_caps);
+    }
+  }
+
+  if (gst_caps_is_empty (caps)) {
+    gst_caps_unref (caps);
+    caps = gst_caps_new_empty_simple ("unknown/unknown");
+  }
+
+  return caps;
+}
+
+/* the first codec of a kind whose caps can go with caps */
+CodecElement *
+gst_maru_caps_to_codec (GList *codecs, const GstCaps *caps,
+    int codec_type, int media_type)
+{
+  GstCaps *codec_caps;
+  CodecElement *codec;
+  GList *elem;
+  gboolean found;
+
+  for (elem = codecs; elem; elem = elem->next) {
+    codec = (CodecElement *)elem->data;
+    if (codec->codec_type != codec_type || codec->media_type != media_type) {
+      continue;
+    }
+    codec_caps = gst_maru_codecname_to_caps (codec->name, NULL,
+        codec_type == CODEC_TYPE_ENCODE);
+    if (!codec_caps) {
+      continue;
+    }
+    found = gst_caps_can_intersect (caps, codec_caps);
+    gst_caps_unref (codec_caps);
+    if (found) {
+      return codec;
+    }
+  }
+
+  return NULL;
+}
+
+GType
+gst_maru_priority_get_type (void)
+{
+  static gsize priority_type = 0;
+  static const GEnumValue priority[] = {
+    {CODEC_PRIORITY_REALTIME, "Served before the other streams", "realtime"},
+    {CODEC_PRIORITY_NORMAL, "Normal", "normal"},
+    {CODEC_PRIORITY_BACKGROUND, "Served after the other streams", "background"},
+    {0, NULL, NULL},
+  };
+
+  // every element class has the property, they can be set up at once
+  if (g_once_init_enter (&priority_type)) {
+    g_once_init_leave (&priority_type,
+        g_enum_register_static ("GstMaruPriority", priority));
+  }
+
+  return (GType) priority_type;
+}
@@ -107,7 +107,8 @@ GstCaps *gst_maru_codecname_to_caps (const char *name, CodecContext *ctx, gboole
 
 void gst_maru_caps_to_codecname (const GstCaps *caps, gchar *codec_name, CodecContext *context);
 
-void gst_maru_init_pix_fmt_info (void);
+int gst_maru_avpicture_layout (int pix_fmt, int width, int height,
+    int offsets[4], int strides[4]);
 
 int gst_maru_avpicture_size (int pix_fmt, int width, int height);
 
@@ -127,4 +128,12 @@ gboolean gst_maru_channel_layout_to_gst (guint64 channel_layout, gint channels,
 void gst_maru_audioinfo_to_context (GstAudioInfo *info, CodecContext *context);
 
 void gst_maru_videoinfo_to_context (GstVideoInfo * info, CodecContext * context);
+
+GstCaps *gst_maru_codecs_to_caps (GList *codecs, int codec_type, int media_type);
+
+CodecElement *gst_maru_caps_to_codec (GList *codecs, const GstCaps *caps,
+    int codec_type, int media_type);
+
+#define GST_MARU_TYPE_PRIORITY (gst_maru_priority_get_type ())
+GType gst_maru_priority_get_type (void);
 #endif
@@ -25,9 +25,31 @@
 #include "gstmarudevice.h"
 #include "gstmaruutils.h"
 #include "gstmaruinterface.h"
+#include "gstmarupicture.h"
+#include "gstmarufdmem.h"
 
 #define GST_MARUDEC_PARAMS_QDATA g_quark_from_static_string("marudec-params")
 
+#define DEFAULT_SKIP_FRAME SKIP_FRAME_NONE
+#define DEFAULT_REQUEST_TIMEOUT 0
+#define DEFAULT_CHECKSUM_ONLY FALSE
+#define DEFAULT_FD_MEMORY FALSE
+#define DEFAULT_PRIORITY CODEC_PRIORITY_NORMAL
+
+enum
+{
+  PROP_0,
+  PROP_SKIP_FRAME,
+  PROP_REQUEST_TIMEOUT,
+  PROP_MEMORY_WAITS,
+  PROP_SPIN_HITS,
+  PROP_SPIN_MISSES,
+  PROP_WAIT_LATENCY,
+  PROP_CHECKSUM_ONLY,
+  PROP_FD_MEMORY,
+  PROP_PRIORITY
+};
+
 /* indicate dts, pts, offset in the stream */
 #define GST_TS_INFO_NONE &ts_info_none
 static const GstTSInfo ts_info_none = { -1, -1, -1, -1 };
@@ -58,15 +80,23 @@ static void gst_maruviddec_finalize (GObject *object);
 
 static gboolean gst_marudec_set_format (GstVideoDecoder * decoder, GstVideoCodecState * state);
 static GstFlowReturn gst_maruviddec_handle_frame (GstVideoDecoder * decoder, GstVideoCodecFrame * frame);
+static gboolean gst_maruviddec_sink_event (GstVideoDecoder * decoder, GstEvent * event);
+static gboolean gst_maruviddec_decide_allocation (GstVideoDecoder * decoder, GstQuery * query);
 static gboolean gst_marudec_negotiate (GstMaruVidDec *dec, gboolean force);
 static gint gst_maruviddec_frame (GstMaruVidDec *marudec, guint8 *data, guint size, gint *got_data,
                   const GstTSInfo *dec_info, gint64 in_offset, GstVideoCodecFrame * frame, GstFlowReturn *ret);
 
+static void gst_marudec_set_property (GObject *object,
+                  guint prop_id, const GValue *value, GParamSpec *pspec);
+static void gst_marudec_get_property (GObject *object,
+                  guint prop_id, GValue *value, GParamSpec *pspec);
+
 static gboolean gst_marudec_open (GstMaruVidDec *marudec);
 static gboolean gst_marudec_close (GstMaruVidDec *marudec);
 
 GstFlowReturn alloc_and_copy (GstMaruVidDec *marudec, guint64 offset, guint size,
                   GstCaps *caps, GstBuffer **buf);
+gchar *checksum_picture (GstMaruVidDec *marudec, guint size);
 
 // for profile
 static GTimer* profile_decode_timer = NULL;
@@ -287,6 +317,9 @@ gst_maruviddec_base_init (GstMaruVidDecClass *klass)
 
   if (!srccaps) {
     srccaps = gst_caps_from_string ("video/x-raw");
+  } else {
+    /* formats we can produce while copying the picture out of the device */
+    gst_maru_picture_append_formats (srccaps);
   }
 
   /* pad templates */
@@ -301,6 +334,28 @@ gst_maruviddec_base_init (GstMaruVidDecClass *klass)
   klass->codec = codec;
 }
 
+#define GST_MARU_TYPE_SKIP_FRAME (gst_maru_skip_frame_get_type ())
+static GType
+gst_maru_skip_frame_get_type (void)
+{
+  static gsize skip_frame_type = 0;
+  static const GEnumValue skip_frame[] = {
+    {SKIP_FRAME_NONE, "Decode all frames", "none"},
+    {SKIP_FRAME_NONREF, "Skip non-reference frames", "nonref"},
+    {SKIP_FRAME_NONKEY, "Skip all but keyframes", "nonkey"},
+    {SKIP_FRAME_ALL, "Skip all frames", "all"},
+    {0, NULL, NULL},
+  };
+
+  // decoders of several codecs can be created at once
+  if (g_once_init_enter (&skip_frame_type)) {
+    g_once_init_leave (&skip_frame_type,
+        g_enum_register_static ("GstMaruSkipFrame", skip_frame));
+  }
+
+  return (GType) skip_frame_type;
+}
+
 static void
 gst_maruviddec_class_init (GstMaruVidDecClass *klass)
 {
@@ -312,13 +367,65 @@ gst_maruviddec_class_init (GstMaruVidDecClass *klass)
 
   gobject_class->finalize = gst_maruviddec_finalize;
 
-  /* use these function when defines new properties.
-  gobject_class->set_property = gst_marudec_set_property
-  gobject_class->get_property = gst_marudec_get_property
-  */
+  gobject_class->set_property = gst_marudec_set_property;
+  gobject_class->get_property = gst_marudec_get_property;
+
+  g_object_class_install_property (gobject_class, PROP_SKIP_FRAME,
+      g_param_spec_enum ("skip-frame", "Skip frames",
+      "Which frames to skip during decoding",
+      GST_MARU_TYPE_SKIP_FRAME, DEFAULT_SKIP_FRAME,
+      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_REQUEST_TIMEOUT,
+      g_param_spec_uint ("request-timeout", "Request timeout",
+      "Give up on a device request after this many milliseconds (0 = never)",
+      0, G_MAXINT, DEFAULT_REQUEST_TIMEOUT,
+      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_MEMORY_WAITS,
+      g_param_spec_uint ("memory-waits", "Memory waits",
+      "How many times the decoder waited for device memory",
+      0, G_MAXUINT, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_SPIN_HITS,
+      g_param_spec_uint ("spin-hits", "Spin hits",
+      "How many replies came while the decoder spun for them, "
+      "with GST_MARU_CODEC_WAIT=hybrid",
+      0, G_MAXUINT, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_SPIN_MISSES,
+      g_param_spec_uint ("spin-misses", "Spin misses",
+      "How many times the decoder spun in vain and blocked, "
+      "with GST_MARU_CODEC_WAIT=hybrid",
+      0, G_MAXUINT, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_WAIT_LATENCY,
+      g_param_spec_int64 ("wait-latency", "Wait latency",
+      "Average time in usec the decoder waited for a reply, "
+      "with GST_MARU_CODEC_WAIT=hybrid",
+      0, G_MAXINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_CHECKSUM_ONLY,
+      g_param_spec_boolean ("checksum-only", "Checksum only",
+      "Post the CRC-32C of every picture in a \"maru-checksum\" element message "
+      "instead of pushing it",
+      DEFAULT_CHECKSUM_ONLY, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_FD_MEMORY,
+      g_param_spec_boolean ("fd-memory", "FD memory",
+      "Decode into memfd or dmabuf memory another process can map by fd",
+      DEFAULT_FD_MEMORY, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_PRIORITY,
+      g_param_spec_enum ("priority", "Priority",
+      "Which streams the device serves first",
+      GST_MARU_TYPE_PRIORITY, DEFAULT_PRIORITY,
+      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
   viddec_class->set_format = gst_marudec_set_format;
   viddec_class->handle_frame = gst_maruviddec_handle_frame;
+  viddec_class->sink_event = gst_maruviddec_sink_event;
+  viddec_class->decide_allocation = gst_maruviddec_decide_allocation;
 }
 
 static void
@@ -330,6 +437,10 @@ gst_maruviddec_init (GstMaruVidDec *marudec)
   marudec->context->audio.sample_fmt = SAMPLE_FMT_NONE;
 
   marudec->opened = FALSE;
+  marudec->skip_frame = DEFAULT_SKIP_FRAME;
+  marudec->request_timeout = DEFAULT_REQUEST_TIMEOUT;
+  marudec->checksum_only = DEFAULT_CHECKSUM_ONLY;
+  marudec->fd_memory = DEFAULT_FD_MEMORY;
 }
 
 static void
@@ -342,9 +453,87 @@ gst_maruviddec_finalize (GObject *object)
   g_free (marudec->context);
   marudec->context = NULL;
 
+  if (marudec->fd_allocator) {
+    gst_object_unref (marudec->fd_allocator);
+    marudec->fd_allocator = NULL;
+  }
+
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
 
+static void
+gst_marudec_set_property (GObject *object,
+  guint prop_id, const GValue *value, GParamSpec *pspec)
+{
+  GST_DEBUG (" >> ENTER ");
+  GstMaruVidDec *marudec = (GstMaruVidDec *) object;
+
+  switch (prop_id) {
+    case PROP_SKIP_FRAME:
+      // the host context picks it up at the next open.
+      marudec->skip_frame = g_value_get_enum (value);
+      break;
+    case PROP_REQUEST_TIMEOUT:
+      marudec->request_timeout = g_value_get_uint (value);
+      marudec->context->timeout_ms = marudec->request_timeout;
+      break;
+    case PROP_CHECKSUM_ONLY:
+      marudec->checksum_only = g_value_get_boolean (value);
+      break;
+    case PROP_FD_MEMORY:
+      // taken at the next allocation query
+      marudec->fd_memory = g_value_get_boolean (value);
+      break;
+    case PROP_PRIORITY:
+      marudec->context->priority = g_value_get_enum (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_marudec_get_property (GObject *object,
+  guint prop_id, GValue *value, GParamSpec *pspec)
+{
+  GST_DEBUG (" >> ENTER ");
+  GstMaruVidDec *marudec = (GstMaruVidDec *) object;
+
+  switch (prop_id) {
+    case PROP_SKIP_FRAME:
+      g_value_set_enum (value, marudec->skip_frame);
+      break;
+    case PROP_REQUEST_TIMEOUT:
+      g_value_set_uint (value, marudec->request_timeout);
+      break;
+    case PROP_MEMORY_WAITS:
+      g_value_set_uint (value, marudec->context->wait.mem_waits);
+      break;
+    case PROP_SPIN_HITS:
+      g_value_set_uint (value, marudec->context->wait.spin_hits);
+      break;
+    case PROP_SPIN_MISSES:
+      g_value_set_uint (value, marudec->context->wait.spin_misses);
+      break;
+    case PROP_WAIT_LATENCY:
+      g_value_set_int64 (value, marudec->context->wait.latency);
+      break;
+    case PROP_CHECKSUM_ONLY:
+      g_value_set_boolean (value, marudec->checksum_only);
+      break;
+    case PROP_FD_MEMORY:
+      g_value_set_boolean (value, marudec->fd_memory);
+      break;
+    case PROP_PRIORITY:
+      g_value_set_enum (value, marudec->context->priority);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
 static gboolean
 gst_marudec_set_format (GstVideoDecoder * decoder, GstVideoCodecState * state)
 {
@@ -392,6 +581,7 @@ gst_marudec_set_format (GstVideoDecoder * decoder, GstVideoCodecState * state)
 
   gst_maru_caps_with_codecname (oclass->codec->name, oclass->codec->media_type,
                                 state->caps, marudec->context);
+  marudec->context->skip_frame = marudec->skip_frame;
 
   GST_LOG_OBJECT (marudec, "size after %dx%d", marudec->context->video.width,
       marudec->context->video.height);
@@ -472,6 +662,8 @@ gst_marudec_open (GstMaruVidDec *marudec)
 static gboolean
 gst_marudec_close (GstMaruVidDec *marudec)
 {
+  CodecDevice *dev;
+
   GST_DEBUG (" >> ENTER ");
   if (!marudec->opened) {
     GST_DEBUG_OBJECT (marudec, "not opened yet");
@@ -487,13 +679,15 @@ gst_marudec_close (GstMaruVidDec *marudec)
     return FALSE;
   }
 
-  gst_maru_avcodec_close (marudec->context, marudec->dev);
+  // sink_event cancels requests on the device from the flushing thread
+  GST_OBJECT_LOCK (marudec);
   marudec->opened = FALSE;
+  dev = marudec->dev;
+  marudec->dev = NULL;
+  GST_OBJECT_UNLOCK (marudec);
 
-  if (marudec->dev) {
-    g_free(marudec->dev);
-    marudec->dev = NULL;
-  }
+  gst_maru_avcodec_close (marudec->context, dev);
+  g_free(dev);
 
   // reset profile resource
   RESET_CODEC_PROFILE();
@@ -603,6 +797,147 @@ no_par:
 }
 
 
+static gboolean
+gst_marudec_accept_format (const GValue *value, enum PixelFormat pix_fmt,
+    GstVideoFormat native, GstVideoFormat *fmt)
+{
+  GstVideoFormat format;
+
+  if (!G_VALUE_HOLDS_STRING (value)) {
+    return FALSE;
+  }
+
+  format = gst_video_format_from_string (g_value_get_string (value));
+  if (format == native || gst_maru_picture_can_convert (pix_fmt, format)) {
+    *fmt = format;
+    return TRUE;
+  }
+
+  return FALSE;
+}
+
+/* the format of s we output, the one the codec outputs or one we can
+ * convert it into during the picture copy. */
+static gboolean
+gst_marudec_structure_format (GstMaruVidDec *marudec, const GstStructure *s,
+    GstVideoFormat native, GstVideoFormat *fmt)
+{
+  const GValue *formats = gst_structure_get_value (s, "format");
+  guint i;
+
+  if (!formats) {
+    *fmt = native;
+    return TRUE;
+  }
+
+  if (gst_marudec_accept_format (formats, marudec->ctx_pix_fmt,
+        native, fmt)) {
+    return TRUE;
+  }
+
+  if (GST_VALUE_HOLDS_LIST (formats)) {
+    for (i = 0; i < gst_value_list_get_size (formats); i++) {
+      if (gst_marudec_accept_format (gst_value_list_get_value (formats, i),
+            marudec->ctx_pix_fmt, native, fmt)) {
+        return TRUE;
+      }
+    }
+  }
+
+  return FALSE;
+}
+
+/* pick the first structure downstream prefers that takes a format we can
+ * output, and the size it asks for if we can scale down to it while
+ * copying, e.g. for thumbnails. the format, the size and the
+ * pixel-aspect-ratio all come from the returned structure, fixated
+ * towards the picture of the codec. */
+static GstStructure *
+gst_marudec_choose_output (GstMaruVidDec *marudec, GstVideoFormat native,
+    GstVideoFormat *fmt, gint *width, gint *height)
+{
+  GstCaps *allowed;
+  GstStructure *s = NULL;
+  gint w, h;
+  guint i;
+
+  *fmt = native;
+  *width = marudec->ctx_width;
+  *height = marudec->ctx_height;
+
+  allowed = gst_pad_get_allowed_caps (GST_VIDEO_DECODER_SRC_PAD (marudec));
+  if (!allowed) {
+    return NULL;
+  }
+
+  for (i = 0; i < gst_caps_get_size (allowed); i++) {
+    if (gst_marudec_structure_format (marudec,
+          gst_caps_get_structure (allowed, i), native, fmt)) {
+      s = gst_structure_copy (gst_caps_get_structure (allowed, i));
+      break;
+    }
+  }
+  gst_caps_unref (allowed);
+
+  if (!s) {
+    *fmt = native;
+    return NULL;
+  }
+
+  if (gst_maru_picture_can_scale (marudec->ctx_pix_fmt)) {
+    gst_structure_fixate_field_nearest_int (s, "width", marudec->ctx_width);
+    gst_structure_fixate_field_nearest_int (s, "height", marudec->ctx_height);
+
+    if (gst_structure_get_int (s, "width", &w) &&
+        gst_structure_get_int (s, "height", &h) &&
+        w > 0 && h > 0 &&
+        w <= marudec->ctx_width && h <= marudec->ctx_height) {
+      *width = w;
+      *height = h;
+    }
+  }
+
+  if (*fmt != native) {
+    GST_DEBUG_OBJECT (marudec, "convert %s to %s while copying pictures",
+        gst_video_format_to_string (native), gst_video_format_to_string (*fmt));
+  }
+  if (*width != marudec->ctx_width || *height != marudec->ctx_height) {
+    GST_DEBUG_OBJECT (marudec, "scale %dx%d to %dx%d while copying pictures",
+        marudec->ctx_width, marudec->ctx_height, *width, *height);
+  }
+
+  return s;
+}
+
+/* a scaled picture keeps the display aspect ratio of the codec picture,
+ * unless the chosen structure asks for another pixel-aspect-ratio. */
+static void
+gst_marudec_update_output_par (GstMaruVidDec *marudec, GstStructure *s,
+    GstVideoInfo *out_info)
+{
+  gint par_n = out_info->par_n, par_d = out_info->par_d;
+
+  if (out_info->width != marudec->ctx_width ||
+      out_info->height != marudec->ctx_height) {
+    if (!gst_util_fraction_multiply (par_n, par_d,
+          marudec->ctx_width * out_info->height,
+          out_info->width * marudec->ctx_height, &par_n, &par_d)) {
+      par_n = out_info->par_n;
+      par_d = out_info->par_d;
+    }
+  }
+
+  if (s && gst_structure_has_field (s, "pixel-aspect-ratio")) {
+    gst_structure_fixate_field_nearest_fraction (s, "pixel-aspect-ratio",
+        par_n, par_d);
+    gst_structure_get_fraction (s, "pixel-aspect-ratio", &par_n, &par_d);
+  }
+
+  GST_DEBUG_OBJECT (marudec, "output pixel-aspect-ratio %d:%d", par_n, par_d);
+  out_info->par_n = par_n;
+  out_info->par_d = par_d;
+}
+
 static gboolean
 gst_marudec_negotiate (GstMaruVidDec *marudec, gboolean force)
 {
@@ -612,6 +947,8 @@ gst_marudec_negotiate (GstMaruVidDec *marudec, gboolean force)
   GstVideoInfo *in_info, *out_info;
   GstVideoCodecState *output_state;
   gint fps_n, fps_d;
+  gint width, height;
+  GstStructure *chosen;
 
   if (!update_video_context (marudec, context, force))
     return TRUE;
@@ -620,9 +957,11 @@ gst_marudec_negotiate (GstMaruVidDec *marudec, gboolean force)
   if (G_UNLIKELY (fmt == GST_VIDEO_FORMAT_UNKNOWN))
     goto unknown_format;
 
+  chosen = gst_marudec_choose_output (marudec, fmt, &fmt, &width, &height);
+
   output_state =
       gst_video_decoder_set_output_state (GST_VIDEO_DECODER (marudec), fmt,
-      marudec->ctx_width, marudec->ctx_height, marudec->input_state);
+      width, height, marudec->input_state);
   if (marudec->output_state)
     gst_video_codec_state_unref (marudec->output_state);
   marudec->output_state = output_state;
@@ -659,6 +998,10 @@ gst_marudec_negotiate (GstMaruVidDec *marudec, gboolean force)
 
   /* calculate and update par now */
   gst_maruviddec_update_par (marudec, in_info, out_info);
+  gst_marudec_update_output_par (marudec, chosen, out_info);
+  if (chosen) {
+    gst_structure_free (chosen);
+  }
 
   if (!gst_video_decoder_negotiate (GST_VIDEO_DECODER (marudec)))
     goto negotiate_failed;
@@ -689,6 +1032,38 @@ negotiate_failed:
   }
 }
 
+/* with fd-memory, the pool of downstream is not taken and the default
+ * pool allocates from the fd allocator, so the picture copied out of the
+ * device goes straight into memory another process can map. */
+static gboolean
+gst_maruviddec_decide_allocation (GstVideoDecoder * decoder, GstQuery * query)
+{
+  GST_DEBUG (" >> ENTER ");
+  GstMaruVidDec *marudec = (GstMaruVidDec *) decoder;
+  GstAllocationParams params;
+
+  if (marudec->fd_memory) {
+    if (!marudec->fd_allocator) {
+      marudec->fd_allocator = gst_maru_fd_allocator_new ();
+    }
+
+    while (gst_query_get_n_allocation_pools (query) > 0) {
+      gst_query_remove_nth_allocation_pool (query, 0);
+    }
+
+    gst_allocation_params_init (&params);
+    if (gst_query_get_n_allocation_params (query) > 0) {
+      gst_query_set_nth_allocation_param (query, 0, marudec->fd_allocator,
+          &params);
+    } else {
+      gst_query_add_allocation_param (query, marudec->fd_allocator, &params);
+    }
+  }
+
+  return GST_VIDEO_DECODER_CLASS (parent_class)->decide_allocation (decoder,
+      query);
+}
+
 static GstFlowReturn
 get_output_buffer (GstMaruVidDec *marudec, GstVideoCodecFrame * frame)
 {
@@ -714,15 +1089,68 @@ get_output_buffer (GstMaruVidDec *marudec, GstVideoCodecFrame * frame)
 
   ret = gst_video_decoder_allocate_output_frame (GST_VIDEO_DECODER (marudec), frame);
 
-  alloc_and_copy(marudec, 0, pict_size, NULL, &(frame->output_buffer));
-
   if (G_UNLIKELY (ret != GST_FLOW_OK)) {
     GST_ERROR ("alloc output buffer failed");
+    return ret;
   }
 
+  ret = alloc_and_copy(marudec, 0, pict_size, NULL, &(frame->output_buffer));
+
   return ret;
 }
 
+/* posts the checksum of the picture instead of copying it out, the frame
+ * is released without being pushed. */
+static GstFlowReturn
+gst_maruviddec_post_checksum (GstMaruVidDec *marudec,
+    const GstTSInfo *dec_info, GstVideoCodecFrame * frame)
+{
+  GST_DEBUG (" >> ENTER ");
+  GstClockTime timestamp;
+  GstStructure *s;
+  gchar *checksum;
+  gint pict_size;
+
+  pict_size = gst_maru_avpicture_size (marudec->context->video.pix_fmt,
+    marudec->context->video.width, marudec->context->video.height);
+  if (pict_size < 0) {
+    GST_DEBUG_OBJECT (marudec, "size of a picture is negative. "
+      "pixel format: %d, width: %d, height: %d",
+      marudec->context->video.pix_fmt, marudec->context->video.width,
+      marudec->context->video.height);
+    return GST_FLOW_ERROR;
+  }
+
+  checksum = checksum_picture (marudec, pict_size);
+  if (!checksum) {
+    return GST_FLOW_ERROR;
+  }
+
+  timestamp = gst_ts_info_get (marudec, dec_info->idx)->timestamp;
+  if (!GST_CLOCK_TIME_IS_VALID (timestamp)) {
+    timestamp = dec_info->timestamp;
+  }
+
+  s = gst_structure_new ("maru-checksum",
+      "timestamp", G_TYPE_UINT64, timestamp,
+      "frame", G_TYPE_UINT, frame ? frame->system_frame_number : 0,
+      "width", G_TYPE_INT, marudec->context->video.width,
+      "height", G_TYPE_INT, marudec->context->video.height,
+      "format", G_TYPE_STRING, gst_video_format_to_string (
+        gst_maru_pixfmt_to_videoformat (marudec->context->video.pix_fmt)),
+      "crc32c", G_TYPE_STRING, checksum, NULL);
+  g_free (checksum);
+
+  gst_element_post_message (GST_ELEMENT_CAST (marudec),
+      gst_message_new_element (GST_OBJECT_CAST (marudec), s));
+
+  if (frame) {
+    gst_video_decoder_release_frame (GST_VIDEO_DECODER (marudec), frame);
+  }
+
+  return GST_FLOW_OK;
+}
+
 static gint
 gst_maruviddec_video_frame (GstMaruVidDec *marudec, guint8 *data, guint size,
     const GstTSInfo *dec_info, gint64 in_offset,
@@ -745,8 +1173,14 @@ gst_maruviddec_video_frame (GstMaruVidDec *marudec, guint8 *data, guint size,
   // begin video decode profile
   BEGIN_VIDEO_DECODE_PROFILE();
 
-  len = interface->decode_video (marudec, data, size,
-        dec_info->idx, in_offset, NULL, &have_data);
+  if (!data && frame) {
+    // written to the device memory block by block
+    len = interface->decode_video_buffer (marudec, frame->input_buffer,
+          dec_info->idx, in_offset, NULL, &have_data);
+  } else {
+    len = interface->decode_video (marudec, data, size,
+          dec_info->idx, in_offset, NULL, &have_data);
+  }
   if (len < 0 || !have_data) {
     GST_ERROR ("decode video failed, len = %d", len);
     return len;
@@ -755,6 +1189,11 @@ gst_maruviddec_video_frame (GstMaruVidDec *marudec, guint8 *data, guint size,
   // end video decode profile
   END_VIDEO_DECODE_PROFILE();
 
+  if (marudec->checksum_only) {
+    *ret = gst_maruviddec_post_checksum (marudec, dec_info, frame);
+    return *ret == GST_FLOW_OK ? len : -1;
+  }
+
   *ret = get_output_buffer (marudec, frame);
   if (G_UNLIKELY (*ret != GST_FLOW_OK)) {
     GST_DEBUG_OBJECT (marudec, "no output buffer");
@@ -902,6 +1341,7 @@ gst_maruviddec_handle_frame (GstVideoDecoder * decoder, GstVideoCodecFrame * fra
   GstMaruVidDec *marudec = (GstMaruVidDec *) decoder;
   gint have_data;
   GstMapInfo mapinfo;
+  gboolean scatter;
   GstFlowReturn ret = GST_FLOW_OK;
 
   guint8 *in_buf;
@@ -912,7 +1352,22 @@ gst_maruviddec_handle_frame (GstVideoDecoder * decoder, GstVideoCodecFrame * fra
   const GstTSInfo *in_info;
   const GstTSInfo *dec_info;
 
-  if (!gst_buffer_map (frame->input_buffer, &mapinfo, GST_MAP_READ)) {
+  // drop what would be skipped anyway before it is sent to the device.
+  if (marudec->skip_frame == SKIP_FRAME_ALL ||
+      (marudec->skip_frame >= SKIP_FRAME_NONKEY &&
+       !GST_VIDEO_CODEC_FRAME_IS_SYNC_POINT (frame))) {
+    GST_LOG_OBJECT (marudec, "skip frame %d", frame->system_frame_number);
+    return gst_video_decoder_drop_frame (decoder, frame);
+  }
+
+  // mapping a buffer of several memories would merge them into a copy
+  // first, so such input is handed over unmapped.
+  scatter = interface->decode_video_buffer &&
+    gst_buffer_n_memory (frame->input_buffer) > 1;
+  if (scatter) {
+    mapinfo.data = NULL;
+    mapinfo.size = gst_buffer_get_size (frame->input_buffer);
+  } else if (!gst_buffer_map (frame->input_buffer, &mapinfo, GST_MAP_READ)) {
     GST_ERROR_OBJECT (marudec, "Failed to map buffer");
     return GST_FLOW_ERROR;
   }
@@ -933,13 +1388,35 @@ gst_maruviddec_handle_frame (GstVideoDecoder * decoder, GstVideoCodecFrame * fra
 
   dec_info = in_info;
 
-  gst_buffer_unmap (frame->input_buffer, &mapinfo);
+  if (!scatter) {
+    gst_buffer_unmap (frame->input_buffer, &mapinfo);
+  }
 
   gst_maruviddec_frame (marudec, in_buf, in_size, &have_data, dec_info, in_offset, frame, &ret);
 
   return ret;
 }
 
+static gboolean
+gst_maruviddec_sink_event (GstVideoDecoder * decoder, GstEvent * event)
+{
+  GST_DEBUG (" >> ENTER ");
+  GstMaruVidDec *marudec = (GstMaruVidDec *) decoder;
+
+  // a seek must not wait for the request the streaming thread is in.
+  // the request fails and handle_frame returns without a picture.
+  if (GST_EVENT_TYPE (event) == GST_EVENT_FLUSH_START &&
+      interface->cancel_requests) {
+    GST_OBJECT_LOCK (marudec);
+    if (marudec->opened) {
+      interface->cancel_requests (marudec->context, marudec->dev);
+    }
+    GST_OBJECT_UNLOCK (marudec);
+  }
+
+  return GST_VIDEO_DECODER_CLASS (parent_class)->sink_event (decoder, event);
+}
+
 gboolean
 gst_maruviddec_register (GstPlugin *plugin, GList *element)
 {
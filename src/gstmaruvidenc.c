@@ -28,7 +28,13 @@
 enum
 {
   ARG_0,
-  ARG_BIT_RATE
+  ARG_BIT_RATE,
+  ARG_BATCH_SIZE,
+  ARG_MEMORY_WAITS,
+  ARG_SPIN_HITS,
+  ARG_SPIN_MISSES,
+  ARG_WAIT_LATENCY,
+  ARG_PRIORITY
 };
 
 typedef struct _GstMaruVidEnc
@@ -51,7 +57,10 @@ typedef struct _GstMaruVidEnc
   guint8 *working_buf;
   gulong working_buf_size;
 
+  /* frames waiting for a batched encode */
   GQueue *delay;
+  guint batch_size;
+  gsize batch_bytes;
 
 } GstMaruVidEnc;
 
@@ -116,6 +125,9 @@ static gboolean gst_maruvidenc_propose_allocation (GstVideoEncoder * encoder,
 static GstCaps *gst_maruvidenc_getcaps (GstVideoEncoder * encoder, GstCaps * filter);
 static GstFlowReturn gst_maruvidenc_handle_frame (GstVideoEncoder * encoder,
     GstVideoCodecFrame * frame);
+static GstFlowReturn gst_maruvidenc_finish (GstVideoEncoder * encoder);
+static gboolean gst_maruvidenc_flush (GstVideoEncoder * encoder);
+static GstFlowReturn gst_maruvidenc_encode_batch (GstMaruVidEnc *maruenc);
 
 static void gst_maruvidenc_set_property (GObject * object,
     guint prop_id, const GValue * value, GParamSpec * pspec);
@@ -124,6 +136,9 @@ static void gst_maruvidenc_get_property (GObject * object,
 
 #define DEFAULT_VIDEO_BITRATE   300000
 #define DEFAULT_VIDEO_GOP_SIZE  15
+#define DEFAULT_BATCH_SIZE      1
+#define DEFAULT_PRIORITY        CODEC_PRIORITY_NORMAL
+#define MAX_BATCH_SIZE          16
 
 #define DEFAULT_WIDTH 352
 #define DEFAULT_HEIGHT 288
@@ -201,7 +216,44 @@ gst_maruvidenc_class_init (GstMaruVidEncClass *klass)
       "Target VIDEO Bitrate", 0, G_MAXULONG, DEFAULT_VIDEO_BITRATE,
       G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (G_OBJECT_CLASS (klass), ARG_BATCH_SIZE,
+      g_param_spec_uint ("batch-size", "Batch Size",
+      "Number of frames sent to the device in one request, "
+      "1 sends each frame as it comes", 1, MAX_BATCH_SIZE, DEFAULT_BATCH_SIZE,
+      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (G_OBJECT_CLASS (klass), ARG_MEMORY_WAITS,
+      g_param_spec_uint ("memory-waits", "Memory waits",
+      "How many times the encoder waited for device memory",
+      0, G_MAXUINT, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (G_OBJECT_CLASS (klass), ARG_SPIN_HITS,
+      g_param_spec_uint ("spin-hits", "Spin hits",
+      "How many replies came while the encoder spun for them, "
+      "with GST_MARU_CODEC_WAIT=hybrid",
+      0, G_MAXUINT, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (G_OBJECT_CLASS (klass), ARG_SPIN_MISSES,
+      g_param_spec_uint ("spin-misses", "Spin misses",
+      "How many times the encoder spun in vain and blocked, "
+      "with GST_MARU_CODEC_WAIT=hybrid",
+      0, G_MAXUINT, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (G_OBJECT_CLASS (klass), ARG_WAIT_LATENCY,
+      g_param_spec_int64 ("wait-latency", "Wait latency",
+      "Average time in usec the encoder waited for a reply, "
+      "with GST_MARU_CODEC_WAIT=hybrid",
+      0, G_MAXINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (G_OBJECT_CLASS (klass), ARG_PRIORITY,
+      g_param_spec_enum ("priority", "Priority",
+      "Which streams the device serves first",
+      GST_MARU_TYPE_PRIORITY, DEFAULT_PRIORITY,
+      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
   venc_class->handle_frame = gst_maruvidenc_handle_frame;
+  venc_class->finish = gst_maruvidenc_finish;
+  venc_class->flush = gst_maruvidenc_flush;
   venc_class->getcaps = gst_maruvidenc_getcaps;
   venc_class->set_format = gst_maruvidenc_set_format;
   venc_class->propose_allocation = gst_maruvidenc_propose_allocation;
@@ -225,6 +277,9 @@ gst_maruvidenc_init (GstMaruVidEnc *maruenc)
   maruenc->bitrate = DEFAULT_VIDEO_BITRATE;
   maruenc->buffer_size = 512 * 1024;
   maruenc->gop_size = DEFAULT_VIDEO_GOP_SIZE;
+
+  maruenc->delay = g_queue_new ();
+  maruenc->batch_size = DEFAULT_BATCH_SIZE;
 }
 
 static void
@@ -239,6 +294,15 @@ gst_maruvidenc_finalize (GObject *object)
     maruenc->opened = FALSE;
   }
 
+  if (maruenc->delay) {
+    g_queue_free_full (maruenc->delay,
+        (GDestroyNotify) gst_video_codec_frame_unref);
+    maruenc->delay = NULL;
+  }
+
+  g_free (maruenc->working_buf);
+  maruenc->working_buf = NULL;
+
   if (maruenc->context) {
     g_free (maruenc->context);
     maruenc->context = NULL;
@@ -282,6 +346,7 @@ gst_maruvidenc_set_format (GstVideoEncoder * encoder,
 
   /* close old session */
   if (maruenc->opened) {
+    gst_maruvidenc_encode_batch (maruenc);
     gst_maru_avcodec_close (maruenc->context, maruenc->dev);
     maruenc->opened = FALSE;
   }
@@ -396,13 +461,9 @@ gst_maruvidenc_propose_allocation (GstVideoEncoder * encoder,
 }
 
 static void
-gst_maruenc_setup_working_buf (GstMaruVidEnc *maruenc)
+gst_maruenc_setup_working_buf (GstMaruVidEnc *maruenc, guint wanted_size)
 {
   GST_DEBUG (" >> ENTER");
-  guint wanted_size =
-      maruenc->context->video.width * maruenc->context->video.height * 6 +
-      FF_MIN_BUFFER_SIZE;
-
   if (maruenc->working_buf == NULL ||
     maruenc->working_buf_size != wanted_size) {
     if (maruenc->working_buf) {
@@ -414,27 +475,178 @@ gst_maruenc_setup_working_buf (GstMaruVidEnc *maruenc)
   maruenc->buffer_size = wanted_size;
 }
 
+/* wrap one encoded packet into the oldest pending frame and push it. */
+static GstFlowReturn
+gst_maruvidenc_finish_oldest_frame (GstMaruVidEnc *maruenc,
+    const guint8 *data, gint size, int coded_frame, int is_keyframe)
+{
+  GstVideoEncoder *encoder = GST_VIDEO_ENCODER (maruenc);
+  GstVideoCodecFrame *frame;
+
+  /* Get oldest frame */
+  frame = gst_video_encoder_get_oldest_frame (encoder);
+  if (G_UNLIKELY(frame == NULL)) {
+    GST_ERROR ("failed to get oldest frame");
+    return GST_FLOW_ERROR;
+  }
+
+  /* Allocate output buffer */
+  if (gst_video_encoder_allocate_output_frame (encoder, frame,
+          size) != GST_FLOW_OK) {
+    gst_video_codec_frame_unref (frame);
+    GstMaruVidEncClass *oclass =
+      (GstMaruVidEncClass *) (G_OBJECT_GET_CLASS (maruenc));
+    GST_ERROR_OBJECT (maruenc,
+        "maru_%senc: failed to alloc buffer", oclass->codec->name);
+    return GST_FLOW_ERROR;
+  }
+
+  gst_buffer_fill (frame->output_buffer, 0, data, size);
+
+  /* buggy codec may not set coded_frame */
+  if (coded_frame) {
+    if (is_keyframe)
+      GST_VIDEO_CODEC_FRAME_SET_SYNC_POINT (frame);
+  } else
+    GST_WARNING_OBJECT (maruenc, "codec did not provide keyframe info");
+
+  return gst_video_encoder_finish_frame (encoder, frame);
+}
+
+/* send all queued frames to the device in one request. */
+static GstFlowReturn
+gst_maruvidenc_encode_batch (GstMaruVidEnc *maruenc)
+{
+  GST_DEBUG (" >> ENTER");
+  GstVideoCodecFrame *frame;
+  GstMapInfo mapinfo[MAX_BATCH_SIZE];
+  uint8_t *in_bufs[MAX_BATCH_SIZE];
+  int in_sizes[MAX_BATCH_SIZE];
+  int64_t in_timestamps[MAX_BATCH_SIZE];
+  VideoEncodePacket packets[MAX_BATCH_SIZE];
+  GstFlowReturn ret = GST_FLOW_OK;
+  guint8 *data;
+  gint i, nb_frames, nb_packets;
+  guint out_size = 0;
+
+  nb_frames = g_queue_get_length (maruenc->delay);
+  if (!nb_frames) {
+    return GST_FLOW_OK;
+  }
+
+  for (i = 0; i < nb_frames; i++) {
+    frame = g_queue_peek_nth (maruenc->delay, i);
+    gst_buffer_map (frame->input_buffer, &mapinfo[i], GST_MAP_READ);
+    in_bufs[i] = mapinfo[i].data;
+    in_sizes[i] = mapinfo[i].size;
+    in_timestamps[i] = GST_BUFFER_TIMESTAMP (frame->input_buffer);
+    out_size += in_sizes[i] + FF_MIN_BUFFER_SIZE;
+  }
+
+  // a packet is not larger than its raw frame, and all of them have to
+  // fit the device memory of the request anyway
+  gst_maruenc_setup_working_buf (maruenc, MIN (out_size, CODEC_VIDEO_BATCH_MAX_SIZE));
+
+  nb_packets =
+    interface->encode_video_batch (maruenc->context, maruenc->working_buf,
+                maruenc->working_buf_size, in_bufs, in_sizes, in_timestamps,
+                nb_frames, packets, maruenc->dev);
+
+  maruenc->batch_bytes = 0;
+  for (i = 0; i < nb_frames; i++) {
+    frame = g_queue_pop_head (maruenc->delay);
+    gst_buffer_unmap (frame->input_buffer, &mapinfo[i]);
+    if (nb_packets < 0) {
+      // without an output buffer the frame is dropped
+      gst_video_encoder_finish_frame (GST_VIDEO_ENCODER (maruenc), frame);
+    } else {
+      gst_video_codec_frame_unref (frame);
+    }
+  }
+
+  if (nb_packets < 0) {
+    GstMaruVidEncClass *oclass =
+      (GstMaruVidEncClass *) (G_OBJECT_GET_CLASS (maruenc));
+    GST_ELEMENT_ERROR (maruenc, STREAM, ENCODE, (NULL),
+        ("maru_%senc: failed to encode %d buffers", oclass->codec->name,
+        nb_frames));
+    return GST_FLOW_ERROR;
+  }
+
+  data = maruenc->working_buf;
+  for (i = 0; i < nb_packets && ret == GST_FLOW_OK; i++) {
+    /* Encoder needs more data */
+    if (!packets[i].len) {
+      continue;
+    }
+    ret = gst_maruvidenc_finish_oldest_frame (maruenc, data, packets[i].len,
+        packets[i].coded_frame, packets[i].key_frame);
+    data += packets[i].len;
+  }
+
+  return ret;
+}
+
 static GstFlowReturn
 gst_maruvidenc_handle_frame (GstVideoEncoder * encoder,
     GstVideoCodecFrame * frame)
 {
   GST_DEBUG (" >> ENTER");
   GstMaruVidEnc *maruenc = (GstMaruVidEnc *) encoder;
-  GstBuffer *outbuf;
   gint ret_size = 0;
   int coded_frame = 0, is_keyframe = 0;
   GstMapInfo mapinfo;
 
-  gst_buffer_map (frame->input_buffer, &mapinfo, GST_MAP_READ);
+  if (maruenc->batch_size > 1 && interface->encode_video_batch) {
+    gsize frame_bytes = gst_buffer_get_size (frame->input_buffer) +
+      CODEC_VIDEO_BATCH_FRAME_HEADER;
+    GstFlowReturn ret = GST_FLOW_OK;
 
-  gst_maruenc_setup_working_buf (maruenc);
+    // a request holds its frames in one block of device memory, so the
+    // queued ones go first when this one would not fit anymore
+    if (maruenc->batch_bytes + frame_bytes > CODEC_VIDEO_BATCH_MAX_SIZE) {
+      ret = gst_maruvidenc_encode_batch (maruenc);
+    }
 
-  ret_size =
-    interface->encode_video (maruenc->context, maruenc->working_buf,
-                maruenc->working_buf_size, mapinfo.data,
-                mapinfo.size, GST_BUFFER_TIMESTAMP (frame->input_buffer),
-                &coded_frame, &is_keyframe, maruenc->dev);
-  gst_buffer_unmap (frame->input_buffer, &mapinfo);
+    if (frame_bytes <= CODEC_VIDEO_BATCH_MAX_SIZE) {
+      g_queue_push_tail (maruenc->delay, frame);
+      maruenc->batch_bytes += frame_bytes;
+      if (ret != GST_FLOW_OK ||
+          g_queue_get_length (maruenc->delay) < maruenc->batch_size) {
+        return ret;
+      }
+      return gst_maruvidenc_encode_batch (maruenc);
+    }
+
+    // a frame larger than a block is encoded on its own
+    if (ret != GST_FLOW_OK) {
+      gst_video_codec_frame_unref (frame);
+      return ret;
+    }
+  }
+
+  gst_maruenc_setup_working_buf (maruenc,
+      maruenc->context->video.width * maruenc->context->video.height * 6 +
+      FF_MIN_BUFFER_SIZE);
+
+  if (interface->encode_video_buffer &&
+      gst_buffer_n_memory (frame->input_buffer) > 1) {
+    // copied to the device memory block by block instead of merged by
+    // gst_buffer_map first
+    ret_size =
+      interface->encode_video_buffer (maruenc->context, maruenc->working_buf,
+                  maruenc->working_buf_size, frame->input_buffer,
+                  GST_BUFFER_TIMESTAMP (frame->input_buffer),
+                  &coded_frame, &is_keyframe, maruenc->dev);
+  } else {
+    gst_buffer_map (frame->input_buffer, &mapinfo, GST_MAP_READ);
+    ret_size =
+      interface->encode_video (maruenc->context, maruenc->working_buf,
+                  maruenc->working_buf_size, mapinfo.data,
+                  mapinfo.size, GST_BUFFER_TIMESTAMP (frame->input_buffer),
+                  &coded_frame, &is_keyframe, maruenc->dev);
+    gst_buffer_unmap (frame->input_buffer, &mapinfo);
+  }
 
   if (ret_size < 0) {
     GstMaruVidEncClass *oclass =
@@ -451,37 +663,32 @@ gst_maruvidenc_handle_frame (GstVideoEncoder * encoder,
 
   gst_video_codec_frame_unref (frame);
 
-  /* Get oldest frame */
-  frame = gst_video_encoder_get_oldest_frame (encoder);
-  if (G_UNLIKELY(frame == NULL)) {
-    GST_ERROR ("failed to get oldest frame");
-    return GST_FLOW_ERROR;
-  }
+  return gst_maruvidenc_finish_oldest_frame (maruenc, maruenc->working_buf,
+      ret_size, coded_frame, is_keyframe);
+}
 
-  /* Allocate output buffer */
-  if (gst_video_encoder_allocate_output_frame (encoder, frame,
-          ret_size) != GST_FLOW_OK) {
-    gst_video_codec_frame_unref (frame);
-    GstMaruVidEncClass *oclass =
-      (GstMaruVidEncClass *) (G_OBJECT_GET_CLASS (maruenc));
-    GST_ERROR_OBJECT (maruenc,
-        "maru_%senc: failed to alloc buffer", oclass->codec->name);
-    return GST_FLOW_ERROR;
-  }
+static GstFlowReturn
+gst_maruvidenc_finish (GstVideoEncoder * encoder)
+{
+  GST_DEBUG (" >> ENTER");
 
-  outbuf = frame->output_buffer;
-  gst_buffer_fill (outbuf, 0, maruenc->working_buf, ret_size);
+  return gst_maruvidenc_encode_batch ((GstMaruVidEnc *) encoder);
+}
 
-  /* buggy codec may not set coded_frame */
-  if (coded_frame) {
-    if (is_keyframe)
-      GST_VIDEO_CODEC_FRAME_SET_SYNC_POINT (frame);
-  } else
-    GST_WARNING_OBJECT (maruenc, "codec did not provide keyframe info");
+static gboolean
+gst_maruvidenc_flush (GstVideoEncoder * encoder)
+{
+  GST_DEBUG (" >> ENTER");
+  GstMaruVidEnc *maruenc = (GstMaruVidEnc *) encoder;
+  GstVideoCodecFrame *frame;
 
-  return gst_video_encoder_finish_frame (encoder, frame);
-}
+  while ((frame = g_queue_pop_head (maruenc->delay))) {
+    gst_video_codec_frame_unref (frame);
+  }
+  maruenc->batch_bytes = 0;
 
+  return TRUE;
+}
 
 static void
 gst_maruvidenc_set_property (GObject *object,
@@ -492,6 +699,12 @@ gst_maruvidenc_set_property (GObject *object,
 
   maruenc = (GstMaruVidEnc *) (object);
 
+  if (prop_id == ARG_PRIORITY) {
+    // read at every request, so it can change while encoding
+    maruenc->context->priority = g_value_get_enum (value);
+    return;
+  }
+
   if (maruenc->opened) {
     GST_WARNING_OBJECT (maruenc,
       "Can't change properties one decoder is setup !");
@@ -502,6 +715,9 @@ gst_maruvidenc_set_property (GObject *object,
     case ARG_BIT_RATE:
       maruenc->bitrate = g_value_get_ulong (value);
       break;
+    case ARG_BATCH_SIZE:
+      maruenc->batch_size = g_value_get_uint (value);
+      break;
     default:
       break;
   }
@@ -520,6 +736,24 @@ gst_maruvidenc_get_property (GObject *object,
     case ARG_BIT_RATE:
       g_value_set_ulong (value, maruenc->bitrate);
       break;
+    case ARG_BATCH_SIZE:
+      g_value_set_uint (value, maruenc->batch_size);
+      break;
+    case ARG_MEMORY_WAITS:
+      g_value_set_uint (value, maruenc->context->wait.mem_waits);
+      break;
+    case ARG_SPIN_HITS:
+      g_value_set_uint (value, maruenc->context->wait.spin_hits);
+      break;
+    case ARG_SPIN_MISSES:
+      g_value_set_uint (value, maruenc->context->wait.spin_misses);
+      break;
+    case ARG_WAIT_LATENCY:
+      g_value_set_int64 (value, maruenc->context->wait.latency);
+      break;
+    case ARG_PRIORITY:
+      g_value_set_enum (value, maruenc->context->priority);
+      break;
     default:
       break;
   }